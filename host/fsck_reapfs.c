@@ -0,0 +1,189 @@
+/* fsck.reapfs — contrôle d'une image reAPFS depuis Linux, en lecture seule.
+ *
+ * Même vérificateur que la commande fsck du kernel (kernel/reapfs_check.c).
+ * Table d'inodes et bitmaps sont lues par gros lots séquentiels ; les
+ * répertoires passent ensuite par une file partagée entre plusieurs
+ * threads : chaque sous-répertoire trouvé y entre, si bien que les
+ * sous-arbres indépendants sont vérifiés en parallèle.
+ *
+ * Code de sortie : 0 propre, 1 avertissements seulement, 4 erreurs,
+ * 8 image illisible ou usage incorrect.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reapfs_check.h"
+
+#define DEFAULT_BATCH 2048   /* secteurs par lecture séquentielle (1 Mio) */
+#define DIR_BATCH 256        /* secteurs de répertoire lus d'un coup, par thread */
+#define MAX_THREADS 64
+
+static int g_fd = -1;
+static int g_quiet = 0;
+static reapfs_check_t g_ck;
+
+/* File des répertoires à vérifier : chacun n'y entre qu'une fois */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_more = PTHREAD_COND_INITIALIZER;
+static uint32_t* g_queue = NULL;
+static uint32_t g_head = 0;
+static uint32_t g_tail = 0;
+static uint32_t g_active = 0;    /* threads en train de vérifier un répertoire */
+
+static pthread_mutex_t g_out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* pread peut s'arrêter en route : on boucle jusqu'au transfert complet */
+static int img_read(void* ctx, uint32_t lba, void* buf, uint32_t count) {
+    (void)ctx;
+    uint8_t* p = buf;
+    size_t left = (size_t)count * SECTOR_SIZE;
+    off_t off = (off_t)lba * SECTOR_SIZE;
+    while (left > 0) {
+        ssize_t n = pread(g_fd, p, left, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += n;
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+static void report(void* ctx, const char* msg) {
+    (void)ctx;
+    if (g_quiet) return;
+    pthread_mutex_lock(&g_out_lock);
+    fputs(msg, stdout);
+    pthread_mutex_unlock(&g_out_lock);
+}
+
+/* Tables du contrôle : rendues à la sortie du processus */
+static void* work_alloc(void* ctx, uint32_t bytes) {
+    (void)ctx;
+    return malloc(bytes);
+}
+
+static void dir_found(void* ctx, uint32_t ino) {
+    (void)ctx;
+    pthread_mutex_lock(&g_lock);
+    g_queue[g_tail++] = ino;
+    pthread_cond_signal(&g_more);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* Prend un répertoire, le vérifie, recommence ; s'arrête quand la file est
+ * vide et que plus personne ne peut en ajouter */
+static void* worker(void* arg) {
+    (void)arg;
+    uint8_t* buf = malloc((size_t)DIR_BATCH * SECTOR_SIZE);
+    if (!buf) return NULL;
+    pthread_mutex_lock(&g_lock);
+    for (;;) {
+        while (g_head == g_tail && g_active > 0) pthread_cond_wait(&g_more, &g_lock);
+        if (g_head == g_tail) break;
+        uint32_t ino = g_queue[g_head++];
+        g_active++;
+        pthread_mutex_unlock(&g_lock);
+
+        reapfs_check_dir(&g_ck, ino, buf, DIR_BATCH);
+
+        pthread_mutex_lock(&g_lock);
+        g_active--;
+        if (g_active == 0 && g_head == g_tail) pthread_cond_broadcast(&g_more);
+    }
+    pthread_mutex_unlock(&g_lock);
+    free(buf);
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage : fsck.reapfs [-j threads] [-b secteurs] [-q] image\n"
+            "  -j  threads du parcours des répertoires (défaut : un par CPU)\n"
+            "  -b  secteurs par lecture de la table d'inodes et des bitmaps (défaut %d)\n"
+            "  -q  résumé seulement\n"
+            "Sortie : 0 propre, 1 avertissements, 4 erreurs, 8 illisible\n",
+            DEFAULT_BATCH);
+    exit(8);
+}
+
+int main(int argc, char** argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t batch = DEFAULT_BATCH;
+    int c;
+    while ((c = getopt(argc, argv, "j:b:qh")) != -1) {
+        switch (c) {
+            case 'j': threads = strtol(optarg, NULL, 0); break;
+            case 'b': batch = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'q': g_quiet = 1; break;
+            default: usage();
+        }
+    }
+    if (optind + 1 != argc || batch == 0) usage();
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    const char* image = argv[optind];
+    g_fd = open(image, O_RDONLY);
+    struct stat st;
+    if (g_fd < 0 || fstat(g_fd, &st) != 0) {
+        fprintf(stderr, "fsck.reapfs: %s : %s\n", image, strerror(errno));
+        return 8;
+    }
+
+    g_ck.read = img_read;
+    g_ck.report = report;
+    g_ck.dir_found = dir_found;
+    g_ck.alloc = work_alloc;
+    g_ck.buf = malloc((size_t)batch * SECTOR_SIZE);
+    g_ck.buf_sectors = batch;
+    g_ck.dev_sectors = (uint32_t)(st.st_size / SECTOR_SIZE);
+    if (!g_ck.buf) return 8;
+
+    uint64_t t0 = now_us();
+    if (reapfs_check_super(&g_ck) != 0) {
+        printf("fsck.reapfs: %s : volume illisible\n", image);
+        return 8;
+    }
+    uint64_t t1 = now_us();
+    int walk = reapfs_check_inodes(&g_ck) == 0;
+    uint64_t t2 = now_us();
+
+    if (walk) {
+        g_queue = malloc(sizeof(uint32_t) * (g_ck.sb.inode_count + 1));
+        if (!g_queue) return 8;
+        g_queue[g_tail++] = 0;
+        pthread_t tid[MAX_THREADS];
+        for (long i = 0; i < threads; ++i) pthread_create(&tid[i], NULL, worker, NULL);
+        for (long i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+    }
+    uint64_t t3 = now_us();
+    reapfs_check_finish(&g_ck);
+    uint64_t t4 = now_us();
+
+    printf("fsck.reapfs: %s : %u fichiers, %u répertoires, %u/%u secteurs de données\n",
+           image, g_ck.files, g_ck.dirs, g_ck.used_sectors,
+           g_ck.sb.total_sectors - g_ck.sb.data_start_sector);
+    printf("fsck.reapfs: %u erreurs, %u avertissements\n", g_ck.errors, g_ck.warnings);
+    if (!g_quiet)
+        printf("fsck.reapfs: %.1f ms (super %.1f, inodes %.1f, arbre %.1f sur %ld threads, bitmaps %.1f)\n",
+               (t4 - t0) / 1000.0, (t1 - t0) / 1000.0, (t2 - t1) / 1000.0,
+               (t3 - t2) / 1000.0, threads, (t4 - t3) / 1000.0);
+    close(g_fd);
+    return g_ck.errors ? 4 : g_ck.warnings ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ata.h"
+#include "timer.h"
+#include "src/mem/pfa.h"
+#include "hostdev.h"
+
+#define SECTOR_SIZE 512
+
+static int g_fd = -1;
+static uint64_t g_sectors = 0;
+static int g_durable = 0;
+static int g_quiet = 0;
+static hostdev_stats_t g_stats;
+
+int hostdev_open(const char* path, uint32_t sectors) {
+    hostdev_close();
+    int flags = O_RDWR | (sectors ? O_CREAT | O_TRUNC : 0);
+    g_fd = open(path, flags, 0644);
+    if (g_fd < 0) return -1;
+    if (sectors && ftruncate(g_fd, (off_t)sectors * SECTOR_SIZE) != 0) {
+        hostdev_close();
+        return -1;
+    }
+    struct stat st;
+    if (fstat(g_fd, &st) != 0) {
+        hostdev_close();
+        return -1;
+    }
+    g_sectors = (uint64_t)st.st_size / SECTOR_SIZE;
+    return 0;
+}
+
+void hostdev_close(void) {
+    if (g_fd >= 0) close(g_fd);
+    g_fd = -1;
+    g_sectors = 0;
+}
+
+void hostdev_set_durable(int on) {
+    g_durable = on ? 1 : 0;
+}
+
+void hostdev_set_quiet(int on) {
+    g_quiet = on ? 1 : 0;
+}
+
+const hostdev_stats_t* hostdev_get_stats(void) {
+    return &g_stats;
+}
+
+void hostdev_reset_stats(void) {
+    g_stats = (hostdev_stats_t){0};
+}
+
+/* Transfert complet ou échec : pread/pwrite peuvent s'arrêter en route */
+static int xfer(int write, uint32_t lba, void* buf, uint32_t count) {
+    if (g_fd < 0 || (uint64_t)lba + count > g_sectors) return -1;
+    uint8_t* p = (uint8_t*)buf;
+    size_t left = (size_t)count * SECTOR_SIZE;
+    off_t off = (off_t)lba * SECTOR_SIZE;
+    while (left > 0) {
+        ssize_t n = write ? pwrite(g_fd, p, left, off) : pread(g_fd, p, left, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += n;
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+/* ---------- Ce que le kernel fournirait ---------- */
+
+int ata_read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    g_stats.reads++;
+    g_stats.sectors_read += count;
+    return xfer(0, lba, buffer, count);
+}
+
+int ata_write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    g_stats.writes++;
+    g_stats.sectors_written += count;
+    return xfer(1, lba, (void*)buffer, count);
+}
+
+int ata_flush(void) {
+    g_stats.flushes++;
+    if (g_durable && g_fd >= 0 && fdatasync(g_fd) != 0) return -1;
+    return 0;
+}
+
+uint64_t ata_sector_count(void) {
+    return g_sectors;
+}
+
+int timer_running(void) {
+    return 0;
+}
+
+uint32_t timer_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+uint32_t timer_ticks(void) {
+    return timer_ms();
+}
+
+void print_string(const char* s) {
+    if (!g_quiet) fputs(s, stdout);
+}
+
+/* Pas de mémoire physique à gérer : les cadres viennent du tas */
+uintptr_t pfa_alloc_run(size_t count) {
+    return (uintptr_t)aligned_alloc(PFA_FRAME_SIZE, count * PFA_FRAME_SIZE);
+}
+
+void pfa_free_run(uintptr_t addr, size_t count) {
+    (void)count;
+    free((void*)addr);
+}
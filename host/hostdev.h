@@ -0,0 +1,41 @@
+#ifndef HOSTDEV_H
+#define HOSTDEV_H
+
+#include <stdint.h>
+
+/*
+ * hostdev — disque reAPFS sur un fichier image, pour construire le FS du
+ * kernel comme bibliothèque Linux (libreapfs).
+ *
+ * Fournit ce que reAPFS.c, bcache.c et blkq.c attendent du kernel :
+ * ata_read / ata_write / ata_flush / ata_sector_count (pread / pwrite /
+ * fdatasync), timer_ms / timer_ticks / timer_running, print_string et
+ * pfa_alloc_run / pfa_free_run (sur le tas).
+ * Le PIT est vu comme arrêté : rien n'est écrit en tâche de fond, seul
+ * fs_sync() vide le cache, ce qui rend les comptes d'E/S reproductibles.
+ */
+
+typedef struct {
+    uint64_t reads;            /* commandes ata_read */
+    uint64_t writes;           /* commandes ata_write */
+    uint64_t flushes;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+} hostdev_stats_t;
+
+// Ouvre l'image. sectors > 0 : la crée (ou la tronque) à cette taille.
+// Retourne 0, ou -1 (errno positionné)
+int hostdev_open(const char* path, uint32_t sectors);
+
+void hostdev_close(void);
+
+// 1 : fdatasync à chaque FLUSH CACHE (défaut 0, le benchmark mesure le FS)
+void hostdev_set_durable(int on);
+
+// 1 : print_string n'écrit rien (défaut 0)
+void hostdev_set_quiet(int on);
+
+const hostdev_stats_t* hostdev_get_stats(void);
+void hostdev_reset_stats(void);
+
+#endif
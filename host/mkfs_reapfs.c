@@ -0,0 +1,380 @@
+/* mkfs.reapfs — construit une image disque TetraOS complète en une passe.
+ *
+ * Secteur 0 : bootloader ; 1..511 : kernel (BOOT_SECTORS) ; puis un volume
+ * reAPFS déjà formaté et rempli depuis une arborescence hôte. Tout est
+ * calculé avant d'écrire (inodes, tailles de répertoires, extents), puis
+ * l'image sort dans l'ordre des LBA, par secteurs entiers, sans jamais
+ * relire ni revenir en arrière : on peut l'envoyer dans un tube.
+ *
+ * Chaque fichier et chaque répertoire occupe un seul extent. Les fichiers
+ * sont écrits non compressés ; le kernel les relit et les modifie comme
+ * n'importe quel autre.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reapfs_format.h"
+#include "crc32c.h"
+
+#define BOOT_SECTORS SUPERBLOCK_SECTOR   /* MBR + kernel avant le superbloc */
+#define OUT_BUF_SECTORS 2048             /* 1 Mio par write */
+
+typedef struct {
+    char name[MAX_FILENAME];
+    char* host;          /* chemin hôte, NULL pour une racine vide */
+    uint32_t parent;
+    uint8_t is_dir;
+    uint32_t size;       /* fichier : octets ; répertoire : nb * 512 */
+    uint32_t first;      /* répertoire : enfants en [first, first + nchild) */
+    uint32_t nchild;
+    uint32_t lba;
+    uint32_t sectors;
+} node_t;
+
+static node_t* g_nodes = NULL;
+static uint32_t g_count = 0;
+static uint32_t g_cap = 0;
+static int g_verbose = 0;
+
+static FILE* g_out = NULL;
+static uint8_t g_buf[OUT_BUF_SECTORS * SECTOR_SIZE];
+static uint32_t g_buf_n = 0;     /* secteurs en attente dans g_buf */
+static uint32_t g_lba = 0;       /* prochain secteur à sortir */
+
+static void die(const char* msg, const char* arg) {
+    fprintf(stderr, "mkfs.reapfs: %s%s%s\n", msg, arg ? " " : "", arg ? arg : "");
+    exit(1);
+}
+
+static node_t* node_add(void) {
+    if (g_count == g_cap) {
+        g_cap = g_cap ? g_cap * 2 : 256;
+        g_nodes = realloc(g_nodes, g_cap * sizeof(node_t));
+        if (!g_nodes) die("mémoire insuffisante", NULL);
+    }
+    node_t* n = &g_nodes[g_count++];
+    memset(n, 0, sizeof(*n));
+    return n;
+}
+
+/* ---------- Sortie séquentielle ---------- */
+
+static void out_flush(void) {
+    if (g_buf_n && fwrite(g_buf, SECTOR_SIZE, g_buf_n, g_out) != g_buf_n)
+        die("écriture de l'image impossible :", strerror(errno));
+    g_buf_n = 0;
+}
+
+/* Prochain secteur à remplir, déjà à zéro */
+static uint8_t* out_sector(void) {
+    if (g_buf_n == OUT_BUF_SECTORS) out_flush();
+    uint8_t* p = g_buf + g_buf_n * SECTOR_SIZE;
+    memset(p, 0, SECTOR_SIZE);
+    g_buf_n++;
+    g_lba++;
+    return p;
+}
+
+static void out_zero(uint32_t n) {
+    while (n--) out_sector();
+}
+
+static void seal(void* p, uint32_t size) {
+    uint32_t c = crc32c(0, p, size - 4);
+    memcpy((uint8_t*)p + size - 4, &c, 4);
+}
+
+/* Fichier hôte en secteurs, complété de zéros jusqu'à `sectors` */
+static void out_file(const char* path, uint32_t max_bytes, uint32_t sectors, int exact) {
+    FILE* f = fopen(path, "rb");
+    if (!f) die("lecture impossible :", path);
+    uint64_t got = 0;
+    for (uint32_t s = 0; s < sectors; ++s) {
+        uint8_t* p = out_sector();
+        if (got < max_bytes) {
+            size_t want = max_bytes - got < SECTOR_SIZE ? (size_t)(max_bytes - got) : SECTOR_SIZE;
+            got += fread(p, 1, want, f);
+        }
+    }
+    if (exact && (got != max_bytes || fgetc(f) != EOF))
+        fprintf(stderr, "mkfs.reapfs: %s a changé pendant la construction\n", path);
+    fclose(f);
+}
+
+/* ---------- Arborescence ---------- */
+
+static int cmp_name(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Enfants du répertoire `d`, triés par nom, ajoutés à la suite : les
+ * numéros d'inode suivent un parcours en largeur */
+static void scan_dir(uint32_t d) {
+    g_nodes[d].first = g_count;
+    if (!g_nodes[d].host) return;
+    DIR* dir = opendir(g_nodes[d].host);
+    if (!dir) die("ouverture impossible :", g_nodes[d].host);
+
+    char** names = NULL;
+    uint32_t n = 0, cap = 0;
+    struct dirent* e;
+    while ((e = readdir(dir)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 32;
+            names = realloc(names, cap * sizeof(char*));
+            if (!names) die("mémoire insuffisante", NULL);
+        }
+        names[n++] = strdup(e->d_name);
+    }
+    closedir(dir);
+    if (n) qsort(names, n, sizeof(char*), cmp_name);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t hl = strlen(g_nodes[d].host) + strlen(names[i]) + 2;
+        char* host = malloc(hl);
+        snprintf(host, hl, "%s/%s", g_nodes[d].host, names[i]);
+        struct stat st;
+        if (strlen(names[i]) >= MAX_FILENAME) {
+            fprintf(stderr, "mkfs.reapfs: %s ignoré (nom de plus de %d caractères)\n", host, MAX_FILENAME - 1);
+        } else if (stat(host, &st) != 0) {
+            fprintf(stderr, "mkfs.reapfs: %s ignoré (%s)\n", host, strerror(errno));
+        } else if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "mkfs.reapfs: %s ignoré (ni fichier ni répertoire)\n", host);
+        } else if (S_ISREG(st.st_mode) && (uint64_t)st.st_size > 0xFFFFFFFFull - SECTOR_SIZE) {
+            fprintf(stderr, "mkfs.reapfs: %s ignoré (4 Gio ou plus)\n", host);
+        } else {
+            node_t* c = node_add();   /* peut déplacer g_nodes */
+            strcpy(c->name, names[i]);
+            c->host = host;
+            c->parent = d;
+            c->is_dir = S_ISDIR(st.st_mode) ? 1 : 0;
+            c->size = c->is_dir ? 0 : (uint32_t)st.st_size;
+            g_nodes[d].nchild++;
+            host = NULL;
+        }
+        free(host);
+        free(names[i]);
+    }
+    free(names);
+}
+
+/* Plus petite table de hachage (puissance de 2) où aucun seau ne déborde */
+static uint32_t dir_size_blocks(uint32_t d) {
+    static uint16_t fill[DIR_MAX_BLOCKS];
+    node_t* dir = &g_nodes[d];
+    for (uint32_t nb = 1; nb <= DIR_MAX_BLOCKS; nb *= 2) {
+        memset(fill, 0, nb * sizeof(fill[0]));
+        int ok = ++fill[dir_hash(".") & (nb - 1)] <= DIR_ENTRIES_PER_BLOCK
+              && ++fill[dir_hash("..") & (nb - 1)] <= DIR_ENTRIES_PER_BLOCK;
+        for (uint32_t i = 0; ok && i < dir->nchild; ++i)
+            ok = ++fill[dir_hash(g_nodes[dir->first + i].name) & (nb - 1)] <= DIR_ENTRIES_PER_BLOCK;
+        if (ok) return nb;
+    }
+    die("répertoire trop grand :", dir->host ? dir->host : "/");
+    return 0;
+}
+
+static void dirent_put(reapfs_dirblock_t* blk, uint32_t nb, const char* name, uint32_t ino) {
+    reapfs_dirblock_t* b = &blk[dir_hash(name) & (nb - 1)];
+    reapfs_dirent_t* e = &b->ent[b->count++];
+    strncpy(e->name, name, MAX_FILENAME - 1);
+    e->ino = ino;
+}
+
+static void out_dir(uint32_t d) {
+    node_t* dir = &g_nodes[d];
+    uint32_t nb = dir->sectors;
+    reapfs_dirblock_t* blk = calloc(nb, sizeof(reapfs_dirblock_t));
+    if (!blk) die("mémoire insuffisante", NULL);
+    dirent_put(blk, nb, ".", d);
+    dirent_put(blk, nb, "..", dir->parent);
+    for (uint32_t i = 0; i < dir->nchild; ++i)
+        dirent_put(blk, nb, g_nodes[dir->first + i].name, dir->first + i);
+    for (uint32_t b = 0; b < nb; ++b) {
+        seal(&blk[b], sizeof(blk[b]));
+        memcpy(out_sector(), &blk[b], SECTOR_SIZE);
+    }
+    free(blk);
+}
+
+/* ---------- Image ---------- */
+
+static void out_blob(const char* path, uint32_t sectors, const char* what) {
+    if (!path) {
+        out_zero(sectors);
+        return;
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) die("introuvable :", path);
+    if ((uint64_t)st.st_size > (uint64_t)sectors * SECTOR_SIZE) {
+        fprintf(stderr, "mkfs.reapfs: %s dépasse la place du %s (%u secteurs)\n", path, what, sectors);
+        exit(1);
+    }
+    out_file(path, (uint32_t)st.st_size, sectors, 0);
+}
+
+/* Un bit par unité : 1 pour [0, used) et à partir de `limit` */
+static void out_bitmap(uint32_t sectors, uint32_t used, uint32_t limit) {
+    for (uint32_t s = 0; s < sectors; ++s) {
+        uint8_t* p = out_sector();
+        for (uint32_t i = 0; i < BM_BITS_PER_SECTOR; ++i) {
+            uint32_t bit = s * BM_BITS_PER_SECTOR + i;
+            if (bit < used || bit >= limit) p[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage : mkfs.reapfs -o image [-b bootloader.bin] [-k kernel.bin]\n"
+            "                    [-d répertoire] [-s Mio] [-N inodes] [-v]\n"
+            "  -o  image à produire (- : sortie standard)\n"
+            "  -b  secteur 0 (512 octets au plus)\n"
+            "  -k  kernel, à partir du secteur 1 (%d secteurs au plus)\n"
+            "  -d  arborescence hôte copiée à la racine du volume\n"
+            "  -s  taille de l'image en Mio (défaut 16, %d au plus)\n"
+            "  -N  nombre d'inodes (défaut : un par %d Kio, au moins un par entrée)\n",
+            BOOT_SECTORS - 1, FS_MAX_SECTORS / 2048, FS_BYTES_PER_INODE / 1024);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char *out = NULL, *boot = NULL, *kernel = NULL, *tree = NULL;
+    uint32_t mib = 16, inodes = 0;
+    int c;
+    while ((c = getopt(argc, argv, "o:b:k:d:s:N:vh")) != -1) {
+        switch (c) {
+            case 'o': out = optarg; break;
+            case 'b': boot = optarg; break;
+            case 'k': kernel = optarg; break;
+            case 'd': tree = optarg; break;
+            case 's': mib = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'N': inodes = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'v': g_verbose = 1; break;
+            default: usage();
+        }
+    }
+    if (!out || optind != argc) usage();
+    uint32_t total = mib * 2048;
+    if (total == 0 || total > FS_MAX_SECTORS) usage();
+
+    /* 1. Arborescence : inodes en largeur, la racine en 0 */
+    node_t* root = node_add();
+    strcpy(root->name, "/");
+    root->is_dir = 1;
+    if (tree) {
+        struct stat st;
+        if (stat(tree, &st) != 0 || !S_ISDIR(st.st_mode)) die("pas un répertoire :", tree);
+        root->host = strdup(tree);
+    }
+    for (uint32_t i = 0; i < g_count; ++i)
+        if (g_nodes[i].is_dir) scan_dir(i);
+
+    /* 2. Géométrie, puis un extent par entrée dans l'ordre des inodes */
+    if (g_count > FS_MAX_INODES) die("trop d'entrées pour un volume reAPFS", NULL);
+    reapfs_super_t sb;
+    memset(&sb, 0, sizeof(sb));
+    reapfs_layout(&sb, total, inodes);
+    if (sb.inode_count < g_count) {
+        if (inodes) die("-N plus petit que le nombre d'entrées", NULL);
+        reapfs_layout(&sb, total, g_count);
+    }
+    uint32_t lba = sb.data_start_sector;
+    for (uint32_t i = 0; i < g_count; ++i) {
+        node_t* n = &g_nodes[i];
+        if (n->is_dir) {
+            n->sectors = dir_size_blocks(i);
+            n->size = n->sectors * SECTOR_SIZE;
+        } else {
+            n->sectors = (n->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        }
+        n->lba = n->sectors ? lba : 0;
+        if ((uint64_t)lba + n->sectors > total) {
+            fprintf(stderr, "mkfs.reapfs: le contenu ne tient pas dans %u Mio\n", mib);
+            return 1;
+        }
+        lba += n->sectors;
+    }
+    uint32_t data_end = lba;
+    sb.free_sectors = total - data_end;
+    seal(&sb, sizeof(sb));
+
+    if (strcmp(out, "-") == 0) {
+        g_out = stdout;
+    } else {
+        g_out = fopen(out, "wb");
+        if (!g_out) die("création impossible :", out);
+    }
+
+    /* 3. Sortie, dans l'ordre des LBA */
+    out_blob(boot, 1, "MBR");
+    out_blob(kernel, BOOT_SECTORS - 1, "kernel");
+
+    memcpy(out_sector(), &sb, SECTOR_SIZE);
+
+    for (uint32_t s = 0; s < sb.inode_table_sectors; ++s) {
+        reapfs_inode_t* t = (reapfs_inode_t*)out_sector();
+        for (uint32_t k = 0; k < INODES_PER_SECTOR; ++k) {
+            uint32_t ino = s * INODES_PER_SECTOR + (uint32_t)k;
+            t[k].ino = ino;
+            if (ino < g_count) {
+                node_t* n = &g_nodes[ino];
+                t[k].used = 1;
+                t[k].is_dir = n->is_dir;
+                t[k].size = n->size;
+                memcpy(t[k].name, n->name, MAX_FILENAME);
+                if (n->sectors) {
+                    t[k].ext_count = 1;
+                    t[k].ext[0].start = n->lba;
+                    t[k].ext[0].len = n->sectors;
+                }
+            }
+            seal(&t[k], sizeof(t[k]));
+        }
+    }
+    out_bitmap(sb.ibitmap_sectors, g_count, sb.inode_count);
+    out_bitmap(sb.bitmap_sectors, data_end, total);
+
+    /* Journal vide : aucun descripteur valide à la position 0 */
+    jnl_header_t* h = (jnl_header_t*)out_sector();
+    h->magic = JNL_HDR_MAGIC;
+    h->seq = 1;
+    h->tail = 0;
+    out_zero(sb.journal_sectors - 1);
+
+    for (uint32_t i = 0; i < g_count; ++i) {
+        node_t* n = &g_nodes[i];
+        if (g_lba != n->lba && n->sectors) die("ordre des données incohérent", NULL);
+        if (n->is_dir) out_dir(i);
+        else if (n->sectors) out_file(n->host, n->size, n->sectors, 1);
+        if (g_verbose)
+            fprintf(stderr, "%6u %s%s  %u octets @%u\n", i, n->host ? n->host : "/",
+                    n->is_dir ? "/" : "", n->size, n->lba);
+    }
+
+    /* Reste du volume : zéros, ou simple extension d'un fichier ordinaire */
+    struct stat st;
+    if (g_out != stdout && fstat(fileno(g_out), &st) == 0 && S_ISREG(st.st_mode)) {
+        out_flush();
+        fflush(g_out);
+        if (ftruncate(fileno(g_out), (off_t)total * SECTOR_SIZE) != 0)
+            die("extension de l'image impossible :", strerror(errno));
+    } else {
+        out_zero(total - g_lba);
+        out_flush();
+    }
+    if (g_out != stdout && fclose(g_out) != 0) die("fermeture de l'image impossible", NULL);
+    else if (g_out == stdout) fflush(stdout);
+
+    fprintf(stderr, "mkfs.reapfs: %u entrées, %u/%u inodes, données %u..%u, %u secteurs libres\n",
+            g_count, g_count, sb.inode_count, sb.data_start_sector, data_end, sb.free_sectors);
+    return 0;
+}
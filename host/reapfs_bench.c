@@ -0,0 +1,312 @@
+/* reapfs_bench — mesures de reAPFS sur une image fichier, hors QEMU.
+ *
+ * Pour chaque couple (nombre de fichiers, taille) : volume neuf, puis
+ * create, write, sync, lookup, readdir et read, les trois derniers à
+ * cache froid (remontage). Par phase : latence moyenne / p50 / p99 par
+ * opération, débit, et commandes ATA et secteurs par opération.
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reapfs.h"
+#include "hostdev.h"
+
+#define MAX_LIST 16
+
+typedef struct {
+    const char* name;
+    uint32_t ops;
+    uint64_t bytes;
+    uint64_t* lat;      /* ns par opération */
+    hostdev_stats_t io;
+} phase_t;
+
+static const char* g_image = "/tmp/reapfs_bench.img";
+static uint32_t g_mib = 128;
+static int g_compress = 0;
+static int g_write_through = 0;
+static int g_verbose = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int parse_list(const char* s, uint32_t* out) {
+    int n = 0;
+    while (*s && n < MAX_LIST) {
+        char* end;
+        unsigned long v = strtoul(s, &end, 0);
+        if (end == s) return -1;
+        if (*end == 'k' || *end == 'K') { v <<= 10; end++; }
+        else if (*end == 'm' || *end == 'M') { v <<= 20; end++; }
+        out[n++] = (uint32_t)v;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        s = end;
+    }
+    return n;
+}
+
+/* Texte pseudo-aléatoire mais reproductible : des mots d'un petit
+ * vocabulaire, donc compressible comme un fichier ordinaire */
+static void fill_text(uint8_t* buf, uint32_t len, uint32_t seed) {
+    static const char* words[] = {
+        "secteur ", "inode ", "journal ", "extent ", "bitmap ", "cache ",
+        "TetraOS ", "reAPFS ", "lecture ", "ecriture ", "0x1F7 ", "\n",
+    };
+    uint32_t x = seed * 2654435761u + 1;
+    uint32_t i = 0;
+    while (i < len) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        const char* w = words[x % (sizeof(words) / sizeof(words[0]))];
+        while (*w && i < len) buf[i++] = (uint8_t)*w++;
+    }
+}
+
+/* Ordre de visite mélangé, le même à chaque exécution */
+static void shuffle(uint32_t* v, uint32_t n) {
+    uint32_t x = 12345;
+    for (uint32_t i = 0; i < n; ++i) v[i] = i;
+    for (uint32_t i = n; i > 1; --i) {
+        x = x * 1103515245u + 12345u;
+        uint32_t j = (x >> 8) % i;
+        uint32_t t = v[i - 1];
+        v[i - 1] = v[j];
+        v[j] = t;
+    }
+}
+
+static void file_path(char* out, size_t sz, uint32_t i) {
+    snprintf(out, sz, "/b/f%05u", i);
+}
+
+static int mount(void) {
+    if (fs_init() != 0) return -1;
+    fs_set_writeback(!g_write_through);
+    fs_set_compression(g_compress);
+    return 0;
+}
+
+static void phase_begin(phase_t* p, const char* name, uint32_t ops) {
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    p->ops = ops;
+    p->lat = calloc(ops ? ops : 1, sizeof(uint64_t));
+    hostdev_reset_stats();
+}
+
+static void phase_end(phase_t* p) {
+    p->io = *hostdev_get_stats();
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void phase_print(phase_t* p) {
+    uint32_t n = p->ops ? p->ops : 1;
+    qsort(p->lat, n, sizeof(uint64_t), cmp_u64);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < n; ++i) total += p->lat[i];
+    double mean_us = (double)total / n / 1000.0;
+    double p50_us = (double)p->lat[n / 2] / 1000.0;
+    double p99_us = (double)p->lat[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1] / 1000.0;
+    double secs = (double)total / 1e9;
+    double mbs = secs > 0 && p->bytes ? (double)p->bytes / (1 << 20) / secs : 0.0;
+    double cmds = (double)(p->io.reads + p->io.writes) / n;
+    double sects = (double)(p->io.sectors_read + p->io.sectors_written) / n;
+    printf("  %-8s %7u %10.1f %9.1f %9.1f %9.1f %9.2f %9.2f\n",
+           p->name, p->ops, mean_us, p50_us, p99_us, mbs, cmds, sects);
+    free(p->lat);
+}
+
+static int run_case(uint32_t count, uint32_t size) {
+    uint64_t data_bytes = (uint64_t)count * size;
+    if (data_bytes > (uint64_t)g_mib * (1 << 20) / 4 * 3) {
+        printf("\n%u fichiers x %u octets : trop gros pour %u Mio, ignoré\n", count, size, g_mib);
+        return 0;
+    }
+    if (hostdev_open(g_image, g_mib * 2048) != 0) {
+        perror(g_image);
+        return -1;
+    }
+    if (mount() != 0 || fs_mkdir("/b") < 0) {
+        fprintf(stderr, "format impossible\n");
+        return -1;
+    }
+
+    uint8_t* buf = malloc(size ? size : 1);
+    uint8_t* chk = malloc(size ? size : 1);
+    uint32_t* order = malloc(sizeof(uint32_t) * count);
+    fs_entry_t* ents = malloc(sizeof(fs_entry_t) * (count + 1));
+    char path[64];
+    phase_t p;
+    int err = 0;
+
+    printf("\n%u fichiers x %u octets%s%s\n", count, size,
+           g_compress ? ", lz4" : "", g_write_through ? ", write-through" : "");
+    printf("  %-8s %7s %10s %9s %9s %9s %9s %9s\n",
+           "phase", "ops", "moy(us)", "p50(us)", "p99(us)", "Mio/s", "cmd/op", "sect/op");
+
+    phase_begin(&p, "create", count);
+    for (uint32_t i = 0; i < count && !err; ++i) {
+        file_path(path, sizeof(path), i);
+        uint64_t t = now_ns();
+        if (fs_create(path) < 0) {
+            fprintf(stderr, "fs_create %s échoue (volume plein ?)\n", path);
+            err = 1;
+        }
+        p.lat[i] = now_ns() - t;
+    }
+    phase_end(&p);
+    phase_print(&p);
+
+    if (!err && size > 0) {
+        phase_begin(&p, "write", count);
+        for (uint32_t i = 0; i < count && !err; ++i) {
+            file_path(path, sizeof(path), i);
+            fill_text(buf, size, i);
+            uint64_t t = now_ns();
+            reapfs_fd_t fd = fs_open(path, FS_O_WRITE);
+            if (fd < 0 || fs_write(fd, buf, size) != (int)size) err = 1;
+            fs_close(fd);
+            p.lat[i] = now_ns() - t;
+            p.bytes += size;
+        }
+        phase_end(&p);
+        phase_print(&p);
+        if (err) fprintf(stderr, "fs_write échoue (volume plein ?)\n");
+    }
+
+    if (!err) {
+        phase_begin(&p, "sync", 1);
+        uint64_t t = now_ns();
+        if (fs_sync() != 0) err = 1;
+        p.lat[0] = now_ns() - t;
+        phase_end(&p);
+        phase_print(&p);
+    }
+
+    if (!err) {
+        shuffle(order, count);
+        mount();
+        phase_begin(&p, "lookup", count);
+        for (uint32_t k = 0; k < count && !err; ++k) {
+            file_path(path, sizeof(path), order[k]);
+            uint64_t t = now_ns();
+            reapfs_fd_t fd = fs_open(path, FS_O_RDONLY);
+            if (fd < 0) err = 1;
+            fs_close(fd);
+            p.lat[k] = now_ns() - t;
+        }
+        phase_end(&p);
+        phase_print(&p);
+        if (err) fprintf(stderr, "lookup échoue\n");
+    }
+
+    if (!err) {
+        mount();
+        phase_begin(&p, "readdir", 1);
+        uint64_t t = now_ns();
+        int n = fs_chdir("/b") == 0 ? fs_list_dir(ents, (int)count + 1) : -1;
+        p.lat[0] = now_ns() - t;
+        phase_end(&p);
+        phase_print(&p);
+        if (n != (int)count) {
+            fprintf(stderr, "readdir : %d entrées au lieu de %u\n", n, count);
+            err = 1;
+        }
+        fs_chdir("/");
+    }
+
+    if (!err && size > 0) {
+        mount();
+        phase_begin(&p, "read", count);
+        for (uint32_t k = 0; k < count && !err; ++k) {
+            uint32_t i = order[k];
+            file_path(path, sizeof(path), i);
+            uint64_t t = now_ns();
+            reapfs_fd_t fd = fs_open(path, FS_O_RDONLY);
+            int r = fd < 0 ? -1 : fs_read(fd, chk, size);
+            fs_close(fd);
+            p.lat[k] = now_ns() - t;
+            p.bytes += size;
+            fill_text(buf, size, i);
+            if (r != (int)size || memcmp(buf, chk, size) != 0) {
+                fprintf(stderr, "contenu de %s incorrect\n", path);
+                err = 1;
+            }
+        }
+        phase_end(&p);
+        phase_print(&p);
+    }
+
+    if (g_verbose) {
+        hostdev_set_quiet(0);
+        fs_debug_print();
+        hostdev_set_quiet(1);
+    }
+
+    free(buf);
+    free(chk);
+    free(order);
+    free(ents);
+    hostdev_close();
+    return err ? -1 : 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage : %s [-i image] [-m Mio] [-n nombres] [-s tailles] [-z] [-w] [-v]\n"
+            "  -i  image de travail (défaut %s, recréée à chaque cas)\n"
+            "  -m  taille du volume en Mio (défaut %u, 128 au plus)\n"
+            "  -n  nombres de fichiers, ex. 100,1000\n"
+            "  -s  tailles de fichier, ex. 0,4k,64k,1m\n"
+            "  -z  compression LZ4\n"
+            "  -w  write-through (un commit par opération)\n"
+            "  -v  fs_debug_print après chaque cas\n",
+            prog, g_image, g_mib);
+}
+
+int main(int argc, char** argv) {
+    uint32_t counts[MAX_LIST] = {100, 1000};
+    uint32_t sizes[MAX_LIST] = {0, 4096, 65536};
+    int ncounts = 2, nsizes = 3;
+    int c;
+
+    while ((c = getopt(argc, argv, "i:m:n:s:zwvh")) != -1) {
+        switch (c) {
+            case 'i': g_image = optarg; break;
+            case 'm': g_mib = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'n': ncounts = parse_list(optarg, counts); break;
+            case 's': nsizes = parse_list(optarg, sizes); break;
+            case 'z': g_compress = 1; break;
+            case 'w': g_write_through = 1; break;
+            case 'v': g_verbose = 1; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (ncounts <= 0 || nsizes <= 0 || g_mib == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    hostdev_set_quiet(1);
+    printf("reapfs_bench : volume %u Mio sur %s\n", g_mib, g_image);
+    int rc = 0;
+    for (int a = 0; a < ncounts; ++a)
+        for (int b = 0; b < nsizes; ++b)
+            if (run_case(counts[a], sizes[b]) != 0) rc = 1;
+    unlink(g_image);
+    return rc;
+}
@@ -0,0 +1,527 @@
+/* reapfs_fuse — monte une image reAPFS sous Linux (libfuse 3).
+ *
+ * Le FS est celui du kernel, compilé avec hostdev.c comme pour libreapfs,
+ * mais avec un pool de cache agrandi (voir la cible fuse du Makefile) :
+ * tout le volume tient en mémoire, les métadonnées ne sont relues qu'une
+ * fois et les écritures partent au disque par fs_sync, en gros lots.
+ *
+ * reAPFS.c n'est pas réentrant : un verrou unique entoure chaque appel au
+ * FS. Les threads de libfuse servent à recouvrir les échanges avec le
+ * noyau Linux (copie des tampons, attente sur /dev/fuse) pendant qu'un
+ * autre thread est dans le FS. Écritures jusqu'à 1 Mio par requête et
+ * cache d'écriture du noyau : un cp -r envoie de gros blocs contigus.
+ *
+ *   reapfs_fuse image point_de_montage [options FUSE] [-o cache=Mio]
+ *       [-o compress] [-o durable] [-o sync_interval=s] [-o format=Mio]
+ *       [-o verbose]
+ *
+ * Limites du FS : noms de 31 octets, fichiers de 4 Gio (bien moins une fois
+ * compressés : FS_MAX_EXTENTS blocs de 16 Kio), volume de 128 Mio.
+ * Pas de rename (le FS n'a pas de déplacement d'entrée), pas de droits ni
+ * de dates : tout appartient à l'utilisateur qui monte, date du montage.
+ */
+#define FUSE_USE_VERSION 31
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reapfs.h"
+#include "reapfs_format.h"
+#include "ata.h"
+#include "bcache.h"
+#include "hostdev.h"
+
+#define DEFAULT_CACHE_MIB 64
+#define DEFAULT_SYNC_S 5
+#define MAX_WRITE (1u << 20)
+#define FS_MAX_FILE 0xFFFFFFFFull
+
+typedef struct {
+    char* image;
+    unsigned cache_mib;
+    unsigned format_mib;
+    unsigned sync_interval;
+    int compress;
+    int durable;
+    int verbose;
+} options_t;
+
+static options_t g_opt = { NULL, DEFAULT_CACHE_MIB, 0, DEFAULT_SYNC_S, 0, 0, 0 };
+
+#define OPT(t, p) { t, offsetof(options_t, p), 1 }
+static const struct fuse_opt g_opt_spec[] = {
+    { "cache=%u", offsetof(options_t, cache_mib), 0 },
+    { "format=%u", offsetof(options_t, format_mib), 0 },
+    { "sync_interval=%u", offsetof(options_t, sync_interval), 0 },
+    OPT("compress", compress),
+    OPT("durable", durable),
+    OPT("verbose", verbose),
+    FUSE_OPT_END
+};
+
+static pthread_mutex_t g_fs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t g_sync_tid;
+static int g_sync_started = 0;
+static int g_stopping = 0;
+static pthread_cond_t g_stop_cond = PTHREAD_COND_INITIALIZER;
+static struct timespec g_mount_time;
+static uid_t g_uid;
+static gid_t g_gid;
+
+/* Tampon de readdir : un répertoire plein, sous le verrou */
+static fs_entry_t g_entries[DIR_MAX_BLOCKS * DIR_ENTRIES_PER_BLOCK];
+
+#define LOCK() pthread_mutex_lock(&g_fs_lock)
+#define UNLOCK() pthread_mutex_unlock(&g_fs_lock)
+
+/* Le FS tronque en silence les composants trop longs : on refuse avant */
+static int check_path(const char* path) {
+    if (strlen(path) >= 256) return -ENAMETOOLONG;
+    size_t n = 0;
+    for (const char* p = path; *p; ++p) {
+        n = *p == '/' ? 0 : n + 1;
+        if (n >= MAX_FILENAME) return -ENAMETOOLONG;
+    }
+    return 0;
+}
+
+static void fill_stat(const fs_stat_t* fs, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_ino = fs->ino + 1;   /* 0 n'est pas un numéro d'inode valide */
+    st->st_mode = fs->is_dir ? S_IFDIR | 0755 : S_IFREG | 0644;
+    st->st_nlink = fs->is_dir ? 2 : 1;
+    st->st_uid = g_uid;
+    st->st_gid = g_gid;
+    st->st_size = fs->size;
+    st->st_blksize = SECTOR_SIZE;
+    st->st_blocks = fs->sectors;
+    st->st_atim = st->st_mtim = st->st_ctim = g_mount_time;
+}
+
+/* Échec d'un appel qui voulait `need` secteurs : plus de place, ou vraie
+ * erreur d'E/S. Le FS a déjà rendu ce qu'il avait pris en route. */
+static int alloc_error(uint32_t need) {
+    fs_statfs_t sf;
+    if (fs_statfs(&sf) == 0 && (sf.free_sectors < need || sf.free_inodes == 0)) return -ENOSPC;
+    return -EIO;
+}
+
+/* ---------- Synchronisation périodique ---------- */
+
+static void* sync_thread(void* arg) {
+    (void)arg;
+    LOCK();
+    while (!g_stopping) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += g_opt.sync_interval;
+        while (!g_stopping && pthread_cond_timedwait(&g_stop_cond, &g_fs_lock, &until) != ETIMEDOUT) {}
+        if (!g_stopping && fs_sync() != 0) fprintf(stderr, "reapfs_fuse: sync failed\n");
+    }
+    UNLOCK();
+    return NULL;
+}
+
+/* ---------- Opérations ---------- */
+
+static void* rf_init(struct fuse_conn_info* conn, struct fuse_config* cfg) {
+    cfg->use_ino = 1;
+    cfg->kernel_cache = 1;   /* personne d'autre n'écrit dans l'image */
+    cfg->entry_timeout = 60.0;
+    cfg->attr_timeout = 60.0;
+    cfg->negative_timeout = 1.0;
+    conn->max_write = MAX_WRITE;
+    conn->max_readahead = MAX_WRITE;
+    if (conn->capable & FUSE_CAP_WRITEBACK_CACHE) conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    if (conn->capable & FUSE_CAP_ASYNC_READ) conn->want |= FUSE_CAP_ASYNC_READ;
+
+    if (g_opt.sync_interval > 0 && pthread_create(&g_sync_tid, NULL, sync_thread, NULL) == 0)
+        g_sync_started = 1;
+    return NULL;
+}
+
+static void rf_destroy(void* data) {
+    (void)data;
+    LOCK();
+    g_stopping = 1;
+    pthread_cond_signal(&g_stop_cond);
+    UNLOCK();
+    if (g_sync_started) pthread_join(g_sync_tid, NULL);
+    LOCK();
+    if (fs_sync() != 0) fprintf(stderr, "reapfs_fuse: final sync failed\n");
+    hostdev_close();
+    UNLOCK();
+}
+
+static int rf_getattr(const char* path, struct stat* st, struct fuse_file_info* fi) {
+    (void)fi;
+    int r = check_path(path);
+    if (r) return r;
+    fs_stat_t fs;
+    LOCK();
+    r = fs_stat(path, &fs);
+    UNLOCK();
+    if (r != 0) return -ENOENT;
+    fill_stat(&fs, st);
+    return 0;
+}
+
+static int rf_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t off,
+                      struct fuse_file_info* fi, enum fuse_readdir_flags flags) {
+    (void)off; (void)fi; (void)flags;
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    LOCK();
+    if (fs_chdir(path) != 0) {
+        UNLOCK();
+        return -ENOTDIR;
+    }
+    int n = fs_list_dir(g_entries, (int)(sizeof(g_entries) / sizeof(g_entries[0])));
+    if (n < 0) {
+        UNLOCK();
+        return -EIO;
+    }
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    for (int i = 0; i < n; ++i) {
+        st.st_ino = g_entries[i].ino + 1;
+        st.st_mode = g_entries[i].is_dir ? S_IFDIR : S_IFREG;
+        if (filler(buf, g_entries[i].name, &st, 0, 0)) break;
+    }
+    UNLOCK();
+    return 0;
+}
+
+static int rf_mkdir(const char* path, mode_t mode) {
+    (void)mode;
+    int r = check_path(path);
+    if (r) return r;
+    fs_stat_t fs;
+    LOCK();
+    if (fs_stat(path, &fs) == 0) r = -EEXIST;
+    else if (fs_mkdir(path) < 0) r = alloc_error(1);
+    UNLOCK();
+    return r;
+}
+
+static int rf_remove(const char* path, int want_dir) {
+    int r = check_path(path);
+    if (r) return r;
+    fs_stat_t fs;
+    LOCK();
+    if (fs_stat(path, &fs) != 0) r = -ENOENT;
+    else if (fs.is_dir && !want_dir) r = -EISDIR;
+    else if (!fs.is_dir && want_dir) r = -ENOTDIR;
+    else if (fs.ino == 0) r = -EBUSY;
+    else if (fs_remove(path) != 0) {
+        /* fs_remove ne refuse un répertoire existant que s'il est plein */
+        r = fs.is_dir ? -ENOTEMPTY : -EIO;
+    }
+    UNLOCK();
+    return r;
+}
+
+static int rf_unlink(const char* path) {
+    return rf_remove(path, 0);
+}
+
+static int rf_rmdir(const char* path) {
+    return rf_remove(path, 1);
+}
+
+static int rf_create(const char* path, mode_t mode, struct fuse_file_info* fi) {
+    (void)mode;
+    int r = check_path(path);
+    if (r) return r;
+    fs_stat_t fs;
+    LOCK();
+    if (fs_stat(path, &fs) == 0) {
+        r = -EEXIST;
+    } else if (fs_create(path) < 0) {
+        r = alloc_error(1);
+    } else {
+        reapfs_fd_t fd = fs_open(path, FS_O_WRITE);
+        if (fd < 0) r = -EMFILE;
+        else fi->fh = (uint64_t)fd;
+    }
+    UNLOCK();
+    return r;
+}
+
+static int rf_open(const char* path, struct fuse_file_info* fi) {
+    int r = check_path(path);
+    if (r) return r;
+    /* Le cache d'écriture du noyau peut relire par un descripteur ouvert
+     * en écriture seule : tous nos descripteurs lisent */
+    int flags = (fi->flags & O_ACCMODE) == O_RDONLY ? FS_O_RDONLY : FS_O_WRITE;
+    if (fi->flags & O_TRUNC) flags |= FS_O_TRUNC;
+    fs_stat_t fs;
+    LOCK();
+    if (fs_stat(path, &fs) != 0) r = -ENOENT;
+    else if (fs.is_dir) r = -EISDIR;
+    else {
+        reapfs_fd_t fd = fs_open(path, flags);
+        if (fd < 0) r = (flags & FS_O_TRUNC) ? -EIO : -EMFILE;
+        else fi->fh = (uint64_t)fd;
+    }
+    UNLOCK();
+    if (r == 0 && !(flags & FS_O_TRUNC)) fi->keep_cache = 1;
+    return r;
+}
+
+static int rf_read(const char* path, char* buf, size_t size, off_t off, struct fuse_file_info* fi) {
+    (void)path;
+    if (off < 0) return -EINVAL;
+    if ((uint64_t)off >= FS_MAX_FILE) return 0;
+    LOCK();
+    int n = fs_pread((reapfs_fd_t)fi->fh, buf, (uint32_t)size, (uint32_t)off);
+    UNLOCK();
+    return n < 0 ? -EIO : n;
+}
+
+static int rf_write(const char* path, const char* buf, size_t size, off_t off,
+                    struct fuse_file_info* fi) {
+    if (off < 0) return -EINVAL;
+    if ((uint64_t)off + size > FS_MAX_FILE) return -EFBIG;
+    LOCK();
+    int r = fs_pwrite((reapfs_fd_t)fi->fh, buf, (uint32_t)size, (uint32_t)off);
+    if (r < 0) {
+        /* Un fichier compressé a au plus FS_MAX_EXTENTS blocs */
+        fs_stat_t fs;
+        if (path && fs_stat(path, &fs) == 0 && fs.compressed &&
+            (uint64_t)off + size > (uint64_t)FS_MAX_EXTENTS * ZCHUNK_SIZE)
+            r = -EFBIG;
+        else
+            r = alloc_error((uint32_t)((size + SECTOR_SIZE - 1) / SECTOR_SIZE));
+    }
+    UNLOCK();
+    return r;
+}
+
+static int rf_release(const char* path, struct fuse_file_info* fi) {
+    (void)path;
+    LOCK();
+    fs_close((reapfs_fd_t)fi->fh);
+    UNLOCK();
+    return 0;
+}
+
+/* Réduire à une taille non nulle : le FS ne sait que vider un fichier, on
+ * garde le début et on le réécrit */
+static int shrink(const char* path, uint32_t size) {
+    uint8_t* keep = malloc(size);
+    if (!keep) return -ENOMEM;
+    int r = -EIO;
+    reapfs_fd_t fd = fs_open(path, FS_O_RDONLY);
+    if (fd >= 0) {
+        int n = fs_pread(fd, keep, size, 0);
+        fs_close(fd);
+        if (n == (int)size && (fd = fs_open(path, FS_O_WRITE | FS_O_TRUNC)) >= 0) {
+            r = fs_pwrite(fd, keep, size, 0) == (int)size
+                    ? 0 : alloc_error((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+            fs_close(fd);
+        }
+    }
+    free(keep);
+    return r;
+}
+
+static int rf_truncate(const char* path, off_t size, struct fuse_file_info* fi) {
+    (void)fi;
+    if (size < 0) return -EINVAL;
+    if ((uint64_t)size > FS_MAX_FILE) return -EFBIG;
+    int r = check_path(path);
+    if (r) return r;
+    fs_stat_t fs;
+    LOCK();
+    if (fs_stat(path, &fs) != 0) r = -ENOENT;
+    else if (fs.is_dir) r = -EISDIR;
+    else if ((uint64_t)size > fs.size) {
+        /* Le trou laissé avant l'octet écrit se lit comme des zéros */
+        static const uint8_t zero = 0;
+        reapfs_fd_t fd = fs_open(path, FS_O_WRITE);
+        if (fd < 0) r = -EMFILE;
+        else {
+            if (fs_pwrite(fd, &zero, 1, (uint32_t)(size - 1)) != 1) r = alloc_error(1);
+            fs_close(fd);
+        }
+    } else if (size == 0) {
+        reapfs_fd_t fd = fs_open(path, FS_O_WRITE | FS_O_TRUNC);
+        if (fd < 0) r = -EIO;
+        else fs_close(fd);
+    } else if ((uint64_t)size < fs.size) {
+        r = shrink(path, (uint32_t)size);
+    }
+    UNLOCK();
+    return r;
+}
+
+static int rf_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+    (void)path; (void)datasync; (void)fi;
+    LOCK();
+    int r = fs_sync() == 0 ? 0 : -EIO;
+    UNLOCK();
+    return r;
+}
+
+static int rf_statfs(const char* path, struct statvfs* sv) {
+    (void)path;
+    fs_statfs_t sf;
+    LOCK();
+    int r = fs_statfs(&sf);
+    UNLOCK();
+    if (r != 0) return -EIO;
+    memset(sv, 0, sizeof(*sv));
+    sv->f_bsize = SECTOR_SIZE;
+    sv->f_frsize = SECTOR_SIZE;
+    sv->f_blocks = sf.data_sectors;
+    sv->f_bfree = sf.free_sectors;
+    sv->f_bavail = sf.free_sectors;
+    sv->f_files = sf.inode_count;
+    sv->f_ffree = sf.free_inodes;
+    sv->f_favail = sf.free_inodes;
+    sv->f_namemax = MAX_FILENAME - 1;
+    return 0;
+}
+
+/* Ni droits ni dates sur disque : acceptés pour que cp -p et tar passent */
+static int rf_chmod(const char* path, mode_t mode, struct fuse_file_info* fi) {
+    (void)mode; (void)fi;
+    return rf_getattr(path, &(struct stat){0}, NULL);
+}
+
+static int rf_chown(const char* path, uid_t uid, gid_t gid, struct fuse_file_info* fi) {
+    (void)uid; (void)gid; (void)fi;
+    return rf_getattr(path, &(struct stat){0}, NULL);
+}
+
+static int rf_utimens(const char* path, const struct timespec tv[2], struct fuse_file_info* fi) {
+    (void)tv; (void)fi;
+    return rf_getattr(path, &(struct stat){0}, NULL);
+}
+
+static int rf_rename(const char* from, const char* to, unsigned int flags) {
+    (void)from; (void)to; (void)flags;
+    return -ENOSYS;
+}
+
+static const struct fuse_operations g_ops = {
+    .init = rf_init,
+    .destroy = rf_destroy,
+    .getattr = rf_getattr,
+    .readdir = rf_readdir,
+    .mkdir = rf_mkdir,
+    .unlink = rf_unlink,
+    .rmdir = rf_rmdir,
+    .create = rf_create,
+    .open = rf_open,
+    .read = rf_read,
+    .write = rf_write,
+    .release = rf_release,
+    .truncate = rf_truncate,
+    .fsync = rf_fsync,
+    .statfs = rf_statfs,
+    .chmod = rf_chmod,
+    .chown = rf_chown,
+    .utimens = rf_utimens,
+    .rename = rf_rename,
+};
+
+/* ---------- Montage ---------- */
+
+/* Premier argument libre : l'image ; le second (point de montage) va à FUSE */
+static int opt_proc(void* data, const char* arg, int key, struct fuse_args* out) {
+    (void)data; (void)out;
+    if (key == FUSE_OPT_KEY_NONOPT && !g_opt.image) {
+        g_opt.image = strdup(arg);
+        return 0;
+    }
+    return 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage : reapfs_fuse image point_de_montage [options]\n"
+            "  -o cache=Mio          cache de blocs (défaut %d, de 1 à %u)\n"
+            "  -o compress           fichiers créés compressés en LZ4\n"
+            "  -o durable            fdatasync à chaque sync du FS\n"
+            "  -o sync_interval=s    sync périodique, 0 : au démontage seulement (défaut %d)\n"
+            "  -o format=Mio         crée l'image et la formate (au plus %u)\n"
+            "  -o verbose            messages du FS sur stderr\n"
+            "  -f -d -s ...          options habituelles de FUSE\n",
+            DEFAULT_CACHE_MIB, BCACHE_MAX_BLOCKS / 2048, DEFAULT_SYNC_S, FS_MAX_SECTORS / 2048);
+}
+
+/* Le superbloc avant fs_init : un disque inconnu y serait formaté */
+static int looks_like_reapfs(void) {
+    uint8_t sec[SECTOR_SIZE];
+    reapfs_super_t sb;
+    if (ata_read(SUPERBLOCK_SECTOR, sec, 1) != 0) return 0;
+    memcpy(&sb, sec, sizeof(sb));
+    return sb.magic == FS_SUPER_MAGIC;
+}
+
+int main(int argc, char** argv) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    if (fuse_opt_parse(&args, &g_opt, g_opt_spec, opt_proc) != 0) return 1;
+    if (!g_opt.image) {
+        usage();
+        return 1;
+    }
+
+    uint32_t sectors = 0;
+    if (g_opt.format_mib) {
+        if (g_opt.format_mib > FS_MAX_SECTORS / 2048) {
+            fprintf(stderr, "reapfs_fuse: format=%u : au plus %u Mio\n",
+                    g_opt.format_mib, FS_MAX_SECTORS / 2048);
+            return 1;
+        }
+        sectors = g_opt.format_mib * 2048;
+    }
+    if (hostdev_open(g_opt.image, sectors) != 0) {
+        fprintf(stderr, "reapfs_fuse: %s : %s\n", g_opt.image, strerror(errno));
+        return 1;
+    }
+    hostdev_set_quiet(!g_opt.verbose);
+    hostdev_set_durable(g_opt.durable);
+    if (!sectors && !looks_like_reapfs()) {
+        fprintf(stderr, "reapfs_fuse: %s : pas un volume reAPFS (-o format=Mio pour en créer un)\n",
+                g_opt.image);
+        return 1;
+    }
+    if (fs_init() != 0) {
+        fprintf(stderr, "reapfs_fuse: %s : volume refusé au montage, voir fsck.reapfs\n",
+                g_opt.image);
+        return 1;
+    }
+    fs_set_compression(g_opt.compress);
+
+    /* Au-delà du budget par défaut : tout le volume peut tenir en cache.
+     * En deçà de 1 Mio, les épinglés du journal n'y tiendraient plus */
+    if (g_opt.cache_mib < 1) {
+        fprintf(stderr, "reapfs_fuse: cache=%u : au moins 1 Mio\n", g_opt.cache_mib);
+        g_opt.cache_mib = 1;
+    }
+    uint64_t blocks = (uint64_t)g_opt.cache_mib * 2048;
+    bcache_set_budget(blocks > BCACHE_MAX_BLOCKS ? BCACHE_MAX_BLOCKS : (uint32_t)blocks);
+
+    clock_gettime(CLOCK_REALTIME, &g_mount_time);
+    g_uid = getuid();
+    g_gid = getgid();
+
+    int r = fuse_main(args.argc, args.argv, &g_ops, NULL);
+    fuse_opt_free_args(&args);
+    free(g_opt.image);
+    return r;
+}
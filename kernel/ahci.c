@@ -0,0 +1,461 @@
+#include "ahci.h"
+#include "idt.h"
+#include "pci.h"
+#include "screen.h"
+#include "vga.h"
+#include "timer.h"
+#include "utils.h"
+
+/* ---------- Registres HBA (MMIO, BAR5) ---------- */
+#define HBA_GHC_AE          (1u << 31)
+#define HBA_GHC_IE          (1u << 1)
+#define HBA_CAP_SNCQ        (1u << 30)
+
+#define PORT_CMD_ST         (1u << 0)
+#define PORT_CMD_FRE        (1u << 4)
+#define PORT_CMD_FR         (1u << 14)
+#define PORT_CMD_CR         (1u << 15)
+#define PORT_IS_TFES        (1u << 30)
+#define PORT_IE_DEFAULT     0x7DC0007Fu
+#define PORT_TFD_ERR        0x01
+#define PORT_TFD_BSY        0x80
+#define PORT_TFD_DRQ        0x08
+
+#define SATA_SIG_ATA        0x00000101u
+#define SSTS_DET_PRESENT    0x3
+
+#define FIS_TYPE_REG_H2D    0x27
+
+#define ATA_CMD_READ_DMA_EXT     0x25
+#define ATA_CMD_WRITE_DMA_EXT    0x35
+#define ATA_CMD_READ_FPDMA       0x60
+#define ATA_CMD_WRITE_FPDMA      0x61
+#define ATA_CMD_IDENTIFY         0xEC
+#define ATA_CMD_FLUSH_CACHE      0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT  0xEA
+
+/* 128 secteurs (64 KiB) par commande : un gros transfert occupe plusieurs tags */
+#define AHCI_MAX_SECTORS_PER_CMD 128
+#define AHCI_PRDT_MAX            8
+#define AHCI_TIMEOUT_MS          5000
+
+typedef volatile struct {
+    uint32_t clb, clbu, fb, fbu;
+    uint32_t is, ie, cmd, rsv0;
+    uint32_t tfd, sig, ssts, sctl;
+    uint32_t serr, sact, ci, sntf;
+    uint32_t fbs;
+    uint32_t rsv1[11];
+    uint32_t vendor[4];
+} ahci_port_regs_t;
+
+typedef volatile struct {
+    uint32_t cap, ghc, is, pi;
+    uint32_t vs, ccc_ctl, ccc_pts, em_loc;
+    uint32_t em_ctl, cap2, bohc;
+    uint8_t  rsv[0x100 - 0x2C];
+    ahci_port_regs_t ports[32];
+} ahci_hba_t;
+
+/* ---------- Structures en mémoire partagées avec le HBA ---------- */
+typedef struct {
+    uint16_t flags;   /* CFL (longueur FIS en dwords) | A | W | P ... */
+    uint16_t prdtl;   /* nombre d'entrées PRD */
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t rsv[4];
+} ahci_cmd_header_t;
+
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t rsv;
+    uint32_t dbc;     /* octets - 1, bit 31 = interruption à la fin */
+} ahci_prd_t;
+
+typedef struct {
+    uint8_t    cfis[64];
+    uint8_t    acmd[16];
+    uint8_t    rsv[48];
+    ahci_prd_t prdt[AHCI_PRDT_MAX];
+} __attribute__((aligned(128))) ahci_cmd_table_t;
+
+#define CMD_HDR_WRITE       (1u << 6)
+
+static ahci_cmd_header_t g_cmd_list[AHCI_MAX_SLOTS] __attribute__((aligned(1024)));
+static uint8_t g_fis_rx[256] __attribute__((aligned(256)));
+static ahci_cmd_table_t g_cmd_tables[AHCI_MAX_SLOTS];
+
+/* Tampon de rebond pour les buffers non alignés sur 2 octets */
+static uint8_t g_bounce[AHCI_MAX_SECTORS_PER_CMD * 512] __attribute__((aligned(16)));
+
+static ahci_hba_t *g_hba = 0;
+static ahci_port_regs_t *g_port = 0;
+static uint64_t g_sectors = 0;
+static uint32_t g_slot_count = 1;     /* emplacements annoncés par CAP.NCS */
+static uint32_t g_max_inflight = 1;   /* 1 sans NCQ, sinon min(NCS, profondeur disque) */
+static int g_ncq = 0;
+static int g_irq_mode = 0;
+static volatile uint32_t g_slots_busy = 0;
+static volatile uint32_t g_slots_failed = 0;
+
+/* ---------- Attente ---------- */
+
+typedef struct {
+    uint32_t start;
+    uint32_t spins;
+} ahci_deadline_t;
+
+static void deadline_start(ahci_deadline_t *d) {
+    d->start = timer_ms();
+    d->spins = 0;
+}
+
+static int deadline_expired(ahci_deadline_t *d) {
+    if (timer_running()) return (timer_ms() - d->start) >= AHCI_TIMEOUT_MS;
+    return ++d->spins >= AHCI_TIMEOUT_MS * 1000;
+}
+
+/* L'IRQ ne fait qu'acquitter : l'état d'avancement est lu dans CI/SACT */
+static void ahci_irq_handler(interrupt_frame_t *frame) {
+    (void)frame;
+    if (!g_hba || !g_port) return;
+    uint32_t pis = g_port->is;
+    g_port->is = pis;
+    if (pis & PORT_IS_TFES) g_slots_failed |= g_slots_busy;
+    g_hba->is = g_hba->is;
+}
+
+static int wait_reg_clear(volatile uint32_t *reg, uint32_t mask) {
+    ahci_deadline_t d;
+    deadline_start(&d);
+    while (*reg & mask) {
+        if (deadline_expired(&d)) return -1;
+    }
+    return 0;
+}
+
+/* Relance le moteur du port après une erreur de fichier de tâche */
+static void ahci_port_recover(void) {
+    g_port->cmd &= ~PORT_CMD_ST;
+    wait_reg_clear(&g_port->cmd, PORT_CMD_CR);
+    g_port->serr = 0xFFFFFFFFu;
+    g_port->is = 0xFFFFFFFFu;
+    g_port->cmd |= PORT_CMD_ST;
+}
+
+/* Dort jusqu'à ce que tous les emplacements de `mask` soient terminés */
+static int ahci_wait_slots(uint32_t mask) {
+    ahci_deadline_t d;
+    deadline_start(&d);
+    for (;;) {
+        interrupts_disable();
+        uint32_t pending = (g_port->ci | g_port->sact) & mask;
+        if (!pending || (g_port->is & PORT_IS_TFES) || (g_slots_failed & mask)) {
+            interrupts_enable();
+            break;
+        }
+        if (g_irq_mode) cpu_wait_for_interrupt();
+        else interrupts_enable();
+        if (deadline_expired(&d)) return -1;
+    }
+    if ((g_port->is & PORT_IS_TFES) || (g_slots_failed & mask)) {
+        g_slots_failed |= g_slots_busy;
+        ahci_port_recover();
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------- Construction des commandes ---------- */
+
+static void build_fis(uint8_t *fis, uint8_t command, uint64_t lba, uint32_t count, int slot, int ncq) {
+    memset(fis, 0, 20);
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;                 /* C = 1 : registre de commande */
+    fis[2] = command;
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[7] = 0x40;                 /* mode LBA */
+    fis[8] = (uint8_t)(lba >> 24);
+    fis[9] = (uint8_t)(lba >> 32);
+    fis[10] = (uint8_t)(lba >> 40);
+    if (ncq) {
+        /* FPDMA QUEUED : compte dans features, tag dans count[7:3] */
+        fis[3] = (uint8_t)count;
+        fis[11] = (uint8_t)(count >> 8);
+        fis[12] = (uint8_t)(slot << 3);
+    } else {
+        fis[12] = (uint8_t)count;
+        fis[13] = (uint8_t)(count >> 8);
+    }
+}
+
+static int alloc_slot(void) {
+    uint32_t busy = g_slots_busy | g_port->ci | g_port->sact;
+    for (uint32_t i = 0; i < g_max_inflight; ++i) {
+        if (!(busy & (1u << i))) return (int)i;
+    }
+    return -1;
+}
+
+/* Prépare l'en-tête et la table de l'emplacement, puis lance la commande */
+static int ahci_issue(int slot, uint8_t command, uint64_t lba, uint32_t count,
+                      void *buffer, uint32_t bytes, int write, int ncq) {
+    ahci_cmd_header_t *hdr = &g_cmd_list[slot];
+    ahci_cmd_table_t *tbl = &g_cmd_tables[slot];
+
+    memset(tbl, 0, sizeof(*tbl));
+    build_fis(tbl->cfis, command, lba, count, slot, ncq);
+
+    /* Le noyau tourne sans pagination : adresse = adresse physique */
+    uint32_t phys = (uint32_t)(uintptr_t)buffer;
+    uint16_t n = 0;
+    while (bytes > 0 && n < AHCI_PRDT_MAX) {
+        uint32_t len = bytes > 0x400000u ? 0x400000u : bytes; /* 4 MiB max par entrée */
+        tbl->prdt[n].dba = phys;
+        tbl->prdt[n].dbau = 0;
+        tbl->prdt[n].dbc = len - 1;
+        phys += len;
+        bytes -= len;
+        n++;
+    }
+    if (bytes > 0) return -1;
+    if (n > 0) tbl->prdt[n - 1].dbc |= (1u << 31);
+
+    hdr->flags = (uint16_t)(5 | (write ? CMD_HDR_WRITE : 0)); /* FIS H2D = 5 dwords */
+    hdr->prdtl = n;
+    hdr->prdbc = 0;
+
+    g_slots_busy |= (1u << slot);
+    g_slots_failed &= ~(1u << slot);
+    if (ncq) g_port->sact = (1u << slot);
+    g_port->ci = (1u << slot);
+    return 0;
+}
+
+/* ---------- Initialisation ---------- */
+
+static uint16_t g_ident[256] __attribute__((aligned(16)));
+
+static int ahci_identify(void) {
+    uint16_t *ident = g_ident;
+    int slot = 0;
+    if (ahci_issue(slot, ATA_CMD_IDENTIFY, 0, 0, ident, sizeof(g_ident), 0, 0) != 0) return -1;
+    int r = ahci_wait_slots(1u << slot);
+    g_slots_busy &= ~(1u << slot);
+    if (r != 0) return -1;
+
+    /* Mot 83 bit 10 : LBA48, capacité mots 100-103 ; sinon mots 60-61 */
+    if (ident[83] & (1 << 10)) {
+        g_sectors = (uint64_t)ident[100] | ((uint64_t)ident[101] << 16)
+                  | ((uint64_t)ident[102] << 32) | ((uint64_t)ident[103] << 48);
+    } else {
+        g_sectors = (uint64_t)ident[60] | ((uint64_t)ident[61] << 16);
+    }
+
+    /* Mot 76 bit 8 : NCQ ; mot 75 : profondeur de file - 1 */
+    if ((g_hba->cap & HBA_CAP_SNCQ) && (ident[76] & (1 << 8))) {
+        uint32_t depth = (uint32_t)(ident[75] & 0x1F) + 1;
+        g_ncq = 1;
+        g_max_inflight = depth < g_slot_count ? depth : g_slot_count;
+    }
+    return 0;
+}
+
+static int ahci_port_start(ahci_port_regs_t *port) {
+    /* Arrêt du moteur de commandes et de la réception FIS */
+    port->cmd &= ~PORT_CMD_ST;
+    if (wait_reg_clear(&port->cmd, PORT_CMD_CR) != 0) return -1;
+    port->cmd &= ~PORT_CMD_FRE;
+    if (wait_reg_clear(&port->cmd, PORT_CMD_FR) != 0) return -1;
+
+    memset(g_cmd_list, 0, sizeof(g_cmd_list));
+    memset(g_fis_rx, 0, sizeof(g_fis_rx));
+    for (int i = 0; i < AHCI_MAX_SLOTS; ++i) {
+        g_cmd_list[i].ctba = (uint32_t)(uintptr_t)&g_cmd_tables[i];
+        g_cmd_list[i].ctbau = 0;
+    }
+    port->clb = (uint32_t)(uintptr_t)g_cmd_list;
+    port->clbu = 0;
+    port->fb = (uint32_t)(uintptr_t)g_fis_rx;
+    port->fbu = 0;
+    port->serr = 0xFFFFFFFFu;
+    port->is = 0xFFFFFFFFu;
+
+    port->cmd |= PORT_CMD_FRE;
+    if (wait_reg_clear(&port->tfd, PORT_TFD_BSY | PORT_TFD_DRQ) != 0) return -1;
+    port->cmd |= PORT_CMD_ST;
+    return 0;
+}
+
+int ahci_init(void) {
+    pci_device_t dev;
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, &dev) != 0) return -1;
+
+    uint32_t bar5 = pci_bar(&dev, 5);
+    if ((bar5 & 1) || (bar5 & ~0xFu) == 0) return -1;
+    pci_enable_bus_master(&dev);
+
+    g_hba = (ahci_hba_t *)(uintptr_t)(bar5 & ~0xFu);
+    g_hba->ghc |= HBA_GHC_AE;
+    g_slot_count = ((g_hba->cap >> 8) & 0x1F) + 1;
+
+    uint32_t pi = g_hba->pi;
+    for (int i = 0; i < 32; ++i) {
+        if (!(pi & (1u << i))) continue;
+        ahci_port_regs_t *port = &g_hba->ports[i];
+        if ((port->ssts & 0xF) != SSTS_DET_PRESENT) continue;
+        if (port->sig != SATA_SIG_ATA) continue;
+        g_port = port;
+        break;
+    }
+    if (!g_port) {
+        print_string("AHCI: aucun disque SATA\n");
+        g_hba = 0;
+        return -1;
+    }
+    if (ahci_port_start(g_port) != 0) {
+        print_string("AHCI: port bloque\n");
+        g_port = 0;
+        return -1;
+    }
+
+    /* Interruptions : ligne INTx legacy routée sur le PIC par le BIOS */
+    if (timer_running() && dev.irq_line < 16) {
+        irq_register(dev.irq_line, ahci_irq_handler);
+        irq_unmask(dev.irq_line);
+        g_port->ie = PORT_IE_DEFAULT;
+        g_hba->ghc |= HBA_GHC_IE;
+        g_irq_mode = 1;
+    }
+
+    if (ahci_identify() != 0) {
+        print_string("AHCI: identify failed\n");
+        g_port = 0;
+        return -1;
+    }
+
+    print_string("AHCI: disque SATA pret, NCQ=");
+    print_hex(g_ncq ? g_max_inflight : 0);
+    print_string("\n");
+    return 0;
+}
+
+int ahci_present(void) {
+    return g_port != 0;
+}
+
+uint64_t ahci_sector_count(void) {
+    return g_sectors;
+}
+
+const uint16_t* ahci_identify_data(void) {
+    return g_ident;
+}
+
+/* ---------- Entrées / sorties ---------- */
+
+int ahci_submit(uint64_t lba, uint8_t* buffer, uint32_t count, int write) {
+    if (!g_port || count == 0 || count > AHCI_MAX_SECTORS_PER_CMD) return -1;
+    if ((uintptr_t)buffer & 1) return -1;
+
+    /* File pleine : l'appelant doit d'abord retirer une commande (ahci_complete) */
+    int slot = alloc_slot();
+    if (slot < 0) return -1;
+
+    uint8_t cmd;
+    if (g_ncq) cmd = write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+    else       cmd = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+
+    if (ahci_issue(slot, cmd, lba, count, buffer, count * 512, write, g_ncq) != 0) {
+        g_slots_busy &= ~(1u << slot);
+        return -1;
+    }
+    return slot;
+}
+
+int ahci_complete(int slot) {
+    if (!g_port || slot < 0 || slot >= AHCI_MAX_SLOTS) return -1;
+    uint32_t bit = 1u << slot;
+    int r = ahci_wait_slots(bit);
+    if (g_slots_failed & bit) r = -1;
+    g_slots_busy &= ~bit;
+    g_slots_failed &= ~bit;
+    return r;
+}
+
+/* Envoie toutes les commandes d'un transfert (jusqu'à g_max_inflight en vol),
+ * puis attend leur fin. */
+static int ahci_transfer(uint32_t lba, uint8_t* buffer, uint32_t count, int write) {
+    int slots[AHCI_MAX_SLOTS];
+    int inflight = 0;
+    int r = 0;
+
+    while (count > 0 && r == 0) {
+        uint32_t n = count < AHCI_MAX_SECTORS_PER_CMD ? count : AHCI_MAX_SECTORS_PER_CMD;
+        if ((uint32_t)inflight == g_max_inflight) {
+            /* Retire la plus ancienne avant d'en lancer une autre */
+            if (ahci_complete(slots[0]) != 0) r = -1;
+            for (int i = 1; i < inflight; ++i) slots[i - 1] = slots[i];
+            inflight--;
+            if (r != 0) break;
+        }
+        int slot = ahci_submit(lba, buffer, n, write);
+        if (slot < 0) { r = -1; break; }
+        slots[inflight++] = slot;
+        lba += n;
+        buffer += n * 512;
+        count -= n;
+    }
+
+    for (int i = 0; i < inflight; ++i) {
+        if (ahci_complete(slots[i]) != 0) r = -1;
+    }
+    if (r != 0) print_string("AHCI: I/O error\n");
+    return r;
+}
+
+/* Buffers impairs : passage secteur par lot via le tampon de rebond */
+static int ahci_transfer_bounce(uint32_t lba, uint8_t* buffer, uint32_t count, int write) {
+    while (count > 0) {
+        uint32_t n = count < AHCI_MAX_SECTORS_PER_CMD ? count : AHCI_MAX_SECTORS_PER_CMD;
+        if (write) memcpy(g_bounce, buffer, n * 512);
+        if (ahci_transfer(lba, g_bounce, n, write) != 0) return -1;
+        if (!write) memcpy(buffer, g_bounce, n * 512);
+        lba += n;
+        buffer += n * 512;
+        count -= n;
+    }
+    return 0;
+}
+
+int ahci_read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    if (!g_port) return -1;
+    if ((uintptr_t)buffer & 1) return ahci_transfer_bounce(lba, buffer, count, 0);
+    return ahci_transfer(lba, buffer, count, 0);
+}
+
+int ahci_write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    if (!g_port) return -1;
+    if ((uintptr_t)buffer & 1) return ahci_transfer_bounce(lba, (uint8_t*)buffer, count, 1);
+    return ahci_transfer(lba, (uint8_t*)buffer, count, 1);
+}
+
+/* Commande non-NCQ : attend d'abord que la file soit vide */
+int ahci_flush(int ext) {
+    if (!g_port) return -1;
+    if (ahci_wait_slots(0xFFFFFFFFu) != 0) return -1;
+    int slot = alloc_slot();
+    if (slot < 0) return -1;
+    uint8_t cmd = ext ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE;
+    if (ahci_issue(slot, cmd, 0, 0, 0, 0, 0, 0) != 0) {
+        g_slots_busy &= ~(1u << slot);
+        return -1;
+    }
+    int r = ahci_complete(slot);
+    if (r != 0) print_string("AHCI: flush failed\n");
+    return r;
+}
@@ -0,0 +1,37 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+#define PCI_SUBCLASS_SATA   0x06
+
+/* Emplacements de commande par port (= profondeur NCQ max) */
+#define AHCI_MAX_SLOTS      32
+
+// Cherche un contrôleur AHCI et un disque SATA. 0 = prêt, -1 = absent
+int ahci_init(void);
+
+// 1 si ahci_init a trouvé un disque utilisable
+int ahci_present(void);
+
+// Capacité du disque en secteurs de 512 octets (IDENTIFY)
+uint64_t ahci_sector_count(void);
+
+// Les 256 mots bruts d'IDENTIFY DEVICE du disque du port actif
+const uint16_t* ahci_identify_data(void);
+
+// Même contrat que ata_read/ata_write (0 = succès). Les gros transferts
+// sont découpés en plusieurs commandes NCQ envoyées en parallèle.
+int ahci_read(uint32_t lba, uint8_t* buffer, uint32_t count);
+int ahci_write(uint32_t lba, const uint8_t* buffer, uint32_t count);
+
+// FLUSH CACHE (EXT si `ext`) après vidage de la file NCQ, 0 = succès
+int ahci_flush(int ext);
+
+// Interface asynchrone : ahci_submit retourne l'emplacement (tag NCQ)
+// occupé par la commande (-1 si la file est pleine), ahci_complete attend
+// sa fin et le libère.
+int ahci_submit(uint64_t lba, uint8_t* buffer, uint32_t count, int write);
+int ahci_complete(int slot);
+
+#endif
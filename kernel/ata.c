@@ -1,7 +1,13 @@
 #include "ata.h"
+#include "ahci.h"
+#include "idt.h"
 #include "io.h"
+#include "pci.h"
 #include "screen.h"
+#include "vga.h"
+#include "timer.h"
 #include "utils.h"
+#include "virtio_blk.h"
 
 #define ATA_DATA        0x1F0
 #define ATA_ERROR       0x1F1
@@ -13,37 +19,261 @@
 #define ATA_STATUS      0x1F7
 #define ATA_COMMAND     0x1F7
 #define ATA_CTRL        0x3F6
+#define ATA_ALT_STATUS  0x3F6   /* en lecture : n'acquitte pas l'IRQ */
+#define ATA_IRQ         14
 
 #define ATA_BSY  0x80
 #define ATA_DRQ  0x08
 #define ATA_ERR  0x01
 
+#define ATA_CMD_READ_SECTORS    0x20
+#define ATA_CMD_WRITE_SECTORS   0x30
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_WRITE_MULTIPLE  0xC5
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_IDENTIFY        0xEC
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_READ_SECTORS_EXT    0x24
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_READ_MULTIPLE_EXT   0x29
+#define ATA_CMD_WRITE_SECTORS_EXT   0x34
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT  0x39
+#define ATA_CMD_FLUSH_CACHE         0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT     0xEA
+
+#define ATA_SECTOR_WORDS        256
+#define ATA_MAX_SECTORS_PER_CMD 256   /* SECT_COUNT = 0 => 256 secteurs */
+#define ATA_MAX_SECTORS_PER_CMD_EXT 2048  /* limité par la table PRD (1 MiB) */
+#define ATA_LBA28_LIMIT         0x10000000u
+
+/* Timeouts en millisecondes (indépendants de la vitesse du CPU) */
+#define ATA_TIMEOUT_SELECT_MS   100
+#define ATA_TIMEOUT_CMD_MS      5000
+#define ATA_TIMEOUT_FLUSH_MS    30000   /* un flush peut vider tout le cache du disque */
+
+/* Taille de bloc READ/WRITE MULTIPLE (0 = mode multiple indisponible) */
+static uint16_t g_multi_sectors = 0;
+
+/* Capacités du disque actif, issues d'IDENTIFY (ou du backend) */
+static ata_device_t g_dev;
+
+/* Objet de complétion d'une requête : armé avant l'envoi de la commande,
+ * signalé par le handler IRQ14 à chaque bloc DRQ / fin de commande. */
+typedef struct {
+    volatile uint32_t irq_count;
+    volatile uint8_t  status;
+} ata_completion_t;
+
+static ata_completion_t *volatile g_ata_pending = 0;
+static int g_ata_irq_mode = 0;
+
+/* Contrôleur qui sert ata_read/ata_write */
+typedef enum {
+    ATA_BACKEND_IDE = 0,   /* ports legacy 0x1F0 (PIO ou bus-master) */
+    ATA_BACKEND_AHCI,      /* SATA AHCI (q35) */
+    ATA_BACKEND_VIRTIO,    /* virtio-blk paravirtualisé (-drive if=virtio) */
+} ata_backend_t;
+
+static ata_backend_t g_backend = ATA_BACKEND_IDE;
+
+/* ---------- Bus-master IDE (PIIX3/PIIX4), canal primaire ---------- */
+#define BM_CMD          0x00
+#define BM_STATUS       0x02
+#define BM_PRDT         0x04
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08   /* sens disque -> mémoire */
+#define BM_ST_ERR       0x02
+#define BM_ST_IRQ       0x04   /* RW1C, comme BM_ST_ERR */
+
+/* 2048 secteurs = 1 MiB : 17 entrées au plus en coupant aux frontières 64 KiB */
+#define ATA_PRD_MAX     32
+#define PRD_EOT         0x8000
+
+typedef struct {
+    uint32_t phys;
+    uint16_t bytes;  /* 0 => 64 KiB */
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+/* 256 octets alignés sur 256 : la table ne traverse jamais une frontière 64 KiB */
+static ata_prd_t g_prdt[ATA_PRD_MAX] __attribute__((aligned(256)));
+static uint16_t g_bmide = 0;   /* base I/O bus-master, 0 = DMA indisponible */
+
+/* Délai de 400ns : 4 lectures du registre alt status */
 static void io_wait() {
-    for (int i = 0; i < 4; ++i) inb(0x80);
+    for (int i = 0; i < 4; ++i) inb(ATA_ALT_STATUS);
 }
 
-static int wait_bsy_clear(int timeout) {
-    while (--timeout) {
-        uint8_t status = inb(ATA_STATUS);
+/* Échéance mesurée sur le PIT quand il tourne, sinon en nombre de lectures */
+typedef struct {
+    uint32_t start;
+    uint32_t limit_ms;
+    uint32_t spins;
+} ata_deadline_t;
+
+static void deadline_start(ata_deadline_t *d, uint32_t timeout_ms) {
+    d->start = timer_ms();
+    d->limit_ms = timeout_ms;
+    d->spins = 0;
+}
+
+static int deadline_expired(ata_deadline_t *d) {
+    if (timer_running()) return (timer_ms() - d->start) >= d->limit_ms;
+    return ++d->spins >= d->limit_ms * 1000;
+}
+
+static int wait_bsy_clear(uint32_t timeout_ms) {
+    ata_deadline_t d;
+    deadline_start(&d, timeout_ms);
+    do {
+        uint8_t status = inb(ATA_ALT_STATUS);
         if (!(status & ATA_BSY)) return 0;
-    }
+    } while (!deadline_expired(&d));
     return -1;
 }
 
 // Attente que DRQ soit prêt, avec gestion BSY/ERR
-static int ata_wait_drq(int timeout) {
-    while (--timeout) {
-        uint8_t status = inb(ATA_STATUS);
+static int ata_wait_drq(uint32_t timeout_ms) {
+    ata_deadline_t d;
+    deadline_start(&d, timeout_ms);
+    do {
+        uint8_t status = inb(ATA_ALT_STATUS);
         if (status & ATA_ERR) return -1;
         if (!(status & ATA_BSY) && (status & ATA_DRQ)) return 0;
-        io_wait();
-    }
+    } while (!deadline_expired(&d));
     return -2;
 }
 
+static void ata_irq_handler(interrupt_frame_t *frame) {
+    (void)frame;
+    uint8_t status = inb(ATA_STATUS); /* acquitte l'interruption côté disque */
+    ata_completion_t *c = g_ata_pending;
+    if (c) {
+        c->status = status;
+        c->irq_count++;
+    }
+}
+
+/* Dort (hlt) jusqu'à ce que l'IRQ14 incrémente c->irq_count au-delà de `seen` */
+static int ata_wait_irq(ata_completion_t *c, uint32_t seen, uint32_t timeout_ms) {
+    ata_deadline_t d;
+    deadline_start(&d, timeout_ms);
+    for (;;) {
+        interrupts_disable();
+        if (c->irq_count != seen) {
+            interrupts_enable();
+            return 0;
+        }
+        cpu_wait_for_interrupt(); /* réveil par l'IRQ14 ou le tick PIT */
+        if (deadline_expired(&d)) return c->irq_count != seen ? 0 : -1;
+    }
+}
+
+/* Attend l'événement suivant du disque (bloc DRQ prêt ou fin de commande).
+ * Retourne le registre de statut, ou -1 sur timeout. */
+static int ata_wait_event(ata_completion_t *c, uint32_t *seen) {
+    if (g_ata_irq_mode) {
+        if (ata_wait_irq(c, *seen, ATA_TIMEOUT_CMD_MS) != 0) return -1;
+        (*seen)++;
+        return c->status;
+    }
+    if (wait_bsy_clear(ATA_TIMEOUT_CMD_MS) != 0) return -1;
+    return inb(ATA_STATUS);
+}
+
+/* Remplit le descripteur à partir des 256 mots d'IDENTIFY DEVICE */
+static void ata_parse_identify(const uint16_t* ident, ata_device_t* dev) {
+    memset(dev, 0, sizeof(*dev));
+    dev->present = 1;
+
+    /* Mots 27-46 : modèle, 2 caractères par mot, octet fort en premier */
+    for (int i = 0; i < 20; ++i) {
+        dev->model[i * 2]     = (char)(ident[27 + i] >> 8);
+        dev->model[i * 2 + 1] = (char)(ident[27 + i] & 0xFF);
+    }
+    dev->model[40] = '\0';
+    for (int i = 39; i >= 0 && dev->model[i] == ' '; --i) dev->model[i] = '\0';
+
+    dev->max_multi   = ident[47] & 0xFF;
+    dev->dma         = (ident[49] & (1 << 8)) ? 1 : 0;
+    dev->mwdma_modes = (uint8_t)(ident[63] & 0x07);
+    dev->udma_modes  = (ident[53] & (1 << 2)) ? (uint8_t)(ident[88] & 0x7F) : 0;
+    dev->lba48       = (ident[83] & (1 << 10)) ? 1 : 0;
+    dev->write_cache = (ident[82] & (1 << 5)) ? 1 : 0;
+    dev->write_cache_enabled = (ident[85] & (1 << 5)) ? 1 : 0;
+    dev->flush       = (ident[83] & (1 << 12)) ? 1 : 0;
+    dev->flush_ext   = (ident[83] & (1 << 13)) ? 1 : 0;
+
+    if (dev->lba48) {
+        dev->sectors = (uint64_t)ident[100] | ((uint64_t)ident[101] << 16)
+                     | ((uint64_t)ident[102] << 32) | ((uint64_t)ident[103] << 48);
+    } else {
+        dev->sectors = (uint64_t)ident[60] | ((uint64_t)ident[61] << 16);
+    }
+}
+
+static void ata_print_device(const ata_device_t* dev) {
+    print_string("ATA: modele=");
+    print_string(dev->model);
+    print_string(" secteurs=");
+    print_hex((uint32_t)dev->sectors);
+    print_string(dev->lba48 ? " LBA48" : " LBA28");
+    if (dev->dma) print_string(" DMA");
+    if (dev->write_cache) print_string(dev->write_cache_enabled ? " WCACHE" : " wcache(off)");
+    if (dev->flush) print_string(" FLUSH");
+    print_string("\n");
+}
+
+/* Cherche le contrôleur IDE PCI et son BAR4 (registres bus-master) */
+static void ata_dma_init(void) {
+    pci_device_t dev;
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &dev) != 0) {
+        print_string("ATA: pas de controleur IDE PCI, PIO seulement\n");
+        return;
+    }
+    uint32_t bar4 = pci_bar(&dev, 4);
+    if (!(bar4 & 1) || (bar4 & ~3u) == 0) {
+        print_string("ATA: BAR4 bus-master absent, PIO seulement\n");
+        return;
+    }
+    pci_enable_bus_master(&dev);
+    g_bmide = (uint16_t)(bar4 & ~3u);
+    outb(g_bmide + BM_CMD, 0);
+    outb(g_bmide + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+    print_string("ATA: DMA bus-master, BMIDE=");
+    print_hex(g_bmide);
+    print_string("\n");
+}
+
 void ata_init(void) {
     print_string("ATA: initialisation...\n");
 
+    /* virtio-blk évite les sorties VM par accès port I/O : prioritaire */
+    if (virtio_blk_init() == 0) {
+        g_backend = ATA_BACKEND_VIRTIO;
+        memset(&g_dev, 0, sizeof(g_dev));
+        g_dev.present = 1;
+        g_dev.lba48 = 1;
+        g_dev.sectors = virtio_blk_sector_count();
+        strcpy(g_dev.model, "virtio-blk");
+        print_string("ATA: backend virtio-blk\n");
+        return;
+    }
+
+    /* Sur q35 le disque est derrière un HBA AHCI : on le préfère au legacy */
+    if (ahci_init() == 0) {
+        g_backend = ATA_BACKEND_AHCI;
+        ata_parse_identify(ahci_identify_data(), &g_dev);
+        ata_print_device(&g_dev);
+        print_string("ATA: backend AHCI\n");
+        return;
+    }
+
+    /* Le handler acquitte aussi les IRQ des commandes pollées ci-dessous */
+    irq_register(ATA_IRQ, ata_irq_handler);
+
     // Reset du contrôleur
     print_string("ATA: reset controller...\n");
     outb(ATA_CTRL, 0x04);
@@ -80,94 +310,309 @@ void ata_init(void) {
     outb(ATA_COMMAND, 0xEC);  // IDENTIFY command
     io_wait();
 
-    if (ata_wait_drq(1000000) != 0) {
+    if (ata_wait_drq(ATA_TIMEOUT_CMD_MS) != 0) {
         print_string("ATA: identify failed (timeout/err)\n");
         return;
     }
 
     print_string("ATA: disque detecte et identifie!\n");
 
-    for (int i = 0; i < 256; i++) {
-        uint16_t data = inw(ATA_DATA);
-        (void)data;
+    uint16_t ident[ATA_SECTOR_WORDS];
+    insw(ATA_DATA, ident, ATA_SECTOR_WORDS);
+    ata_parse_identify(ident, &g_dev);
+    ata_print_device(&g_dev);
+
+    /* Nombre max de secteurs par bloc DRQ pour READ/WRITE MULTIPLE */
+    uint16_t max_multi = g_dev.max_multi;
+    if (max_multi > 1) {
+        outb(ATA_DRIVE_SEL, 0xE0);
+        outb(ATA_SECT_COUNT, (uint8_t)max_multi);
+        outb(ATA_COMMAND, ATA_CMD_SET_MULTIPLE);
+        io_wait();
+        if (wait_bsy_clear(ATA_TIMEOUT_CMD_MS) == 0 && !(inb(ATA_STATUS) & ATA_ERR)) {
+            g_multi_sectors = max_multi;
+            print_string("ATA: multiple mode, secteurs/bloc=");
+            print_hex(g_multi_sectors);
+            print_string("\n");
+        } else {
+            print_string("ATA: SET MULTIPLE refuse, mode secteur simple\n");
+        }
+    }
+
+    if (g_dev.dma) ata_dma_init();
+
+    /* Complétion par interruption dès que le PIT tourne (IDT + sti faits) */
+    if (timer_running()) {
+        irq_unmask(ATA_IRQ);
+        g_ata_irq_mode = 1;
+        print_string("ATA: completion par IRQ14\n");
     }
 
     print_string("ATA: disque pret\n");
 }
 
-int ata_read_single(uint32_t lba, uint8_t* buffer) {
-    outb(ATA_DRIVE_SEL, 0xE0 | ((lba >> 24) & 0x0F));
+/* Programme les registres de tâche, en LBA28 ou en LBA48 (ext).
+ * LBA28 : count = 0 signifie 256 secteurs ; LBA48 : 0 signifie 65536. */
+static int ata_issue(uint32_t lba, uint32_t count, uint8_t command, int ext) {
+    outb(ATA_DRIVE_SEL, ext ? 0x40 : (0xE0 | ((lba >> 24) & 0x0F)));
     io_wait();
 
-    if (wait_bsy_clear(100000) != 0) { 
-        print_string("ATA: busy after select\n"); 
-        return -1; 
+    if (wait_bsy_clear(ATA_TIMEOUT_SELECT_MS) != 0) {
+        print_string("ATA: busy after select\n");
+        return -1;
     }
 
-    outb(ATA_SECT_COUNT, 1);
+    if (ext) {
+        /* Octets hauts d'abord : les registres sont des FIFO à deux niveaux */
+        outb(ATA_SECT_COUNT, (uint8_t)((count >> 8) & 0xFF));
+        outb(ATA_LBA_LOW,  (uint8_t)((lba >> 24) & 0xFF));
+        outb(ATA_LBA_MID,  0);
+        outb(ATA_LBA_HIGH, 0);
+    }
+    outb(ATA_SECT_COUNT, (uint8_t)(count & 0xFF));
     outb(ATA_LBA_LOW,  (uint8_t)(lba & 0xFF));
     outb(ATA_LBA_MID,  (uint8_t)((lba >> 8) & 0xFF));
     outb(ATA_LBA_HIGH, (uint8_t)((lba >> 16) & 0xFF));
-    outb(ATA_COMMAND, 0x20); // READ SECTORS
+    outb(ATA_COMMAND,  command);
+    return 0;
+}
 
-    if (ata_wait_drq(1000000) != 0) {
-        print_string("ATA: timeout or error (read DRQ)\n");
-        return -1;
-    }
+/* Les commandes EXT ne servent que si le LBA ou le compte dépassent LBA28 */
+static int ata_need_ext(uint32_t lba, uint32_t count) {
+    return count > ATA_MAX_SECTORS_PER_CMD || (uint64_t)lba + count > ATA_LBA28_LIMIT;
+}
+
+/* Une seule commande READ SECTORS / READ MULTIPLE (EXT si besoin) */
+static int ata_read_cmd(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    int ext = ata_need_ext(lba, count);
+    uint8_t cmd = g_multi_sectors ? (ext ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE)
+                                  : (ext ? ATA_CMD_READ_SECTORS_EXT : ATA_CMD_READ_SECTORS);
+    uint32_t block = g_multi_sectors ? g_multi_sectors : 1;
+    ata_completion_t done = { 0, 0 };
+    uint32_t seen = 0;
+    int r = 0;
+
+    g_ata_pending = &done;
+    if (ata_issue(lba, count, cmd, ext) != 0) r = -1;
 
-    for (int i = 0; i < 256; i++) {
-        uint16_t data = inw(ATA_DATA);
-        buffer[i * 2]     = (uint8_t)(data & 0xFF);
-        buffer[i * 2 + 1] = (uint8_t)(data >> 8);
+    /* Le disque lève DRQ (et l'IRQ) une fois par bloc */
+    while (r == 0 && count > 0) {
+        uint32_t n = count < block ? count : block;
+        int st = ata_wait_event(&done, &seen);
+        if (st < 0 || (st & ATA_ERR) || !(st & ATA_DRQ)) {
+            print_string("ATA: timeout or error (read DRQ)\n");
+            r = -1;
+            break;
+        }
+        insw(ATA_DATA, buffer, n * ATA_SECTOR_WORDS);
+        buffer += n * 512;
+        count -= n;
     }
-    return 0;
+
+    g_ata_pending = 0;
+    return r;
 }
 
-int ata_write_single(uint32_t lba, const uint8_t* buffer) {
-    outb(ATA_DRIVE_SEL, 0xE0 | ((lba >> 24) & 0x0F));
-    io_wait();
+/* Une seule commande WRITE SECTORS / WRITE MULTIPLE (EXT si besoin) */
+static int ata_write_cmd(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    int ext = ata_need_ext(lba, count);
+    uint8_t cmd = g_multi_sectors ? (ext ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE)
+                                  : (ext ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_WRITE_SECTORS);
+    uint32_t block = g_multi_sectors ? g_multi_sectors : 1;
+    ata_completion_t done = { 0, 0 };
+    uint32_t seen = 0;
+    int r = 0;
 
-    if (wait_bsy_clear(100000) != 0) { 
-        print_string("ATA: busy after select\n"); 
-        return -1; 
+    g_ata_pending = &done;
+    if (ata_issue(lba, count, cmd, ext) != 0) r = -1;
+
+    /* Pas d'IRQ pour le premier bloc : DRQ arrive juste après la commande */
+    if (r == 0 && ata_wait_drq(ATA_TIMEOUT_CMD_MS) != 0) {
+        print_string("ATA: timeout or error (write DRQ)\n");
+        r = -1;
     }
 
-    outb(ATA_SECT_COUNT, 1);
-    outb(ATA_LBA_LOW,  lba & 0xFF);
-    outb(ATA_LBA_MID,  (lba >> 8) & 0xFF);
-    outb(ATA_LBA_HIGH, (lba >> 16) & 0xFF);
-    outb(ATA_COMMAND,  0x30);  // WRITE SECTOR
+    /* Ensuite une IRQ après chaque bloc ; la dernière signale la fin */
+    while (r == 0 && count > 0) {
+        uint32_t n = count < block ? count : block;
+        outsw(ATA_DATA, buffer, n * ATA_SECTOR_WORDS);
+        buffer += n * 512;
+        count -= n;
 
-    if (ata_wait_drq(1000000) != 0) {
-        print_string("ATA: timeout or error (write DRQ)\n");
-        return -1;
+        int st = ata_wait_event(&done, &seen);
+        if (st < 0) {
+            print_string("ATA: timeout (write finish)\n");
+            r = -1;
+        } else if (st & ATA_ERR) {
+            print_string("ATA: write error\n");
+            r = -1;
+        } else if (count > 0 && !(st & ATA_DRQ)) {
+            print_string("ATA: timeout or error (write DRQ)\n");
+            r = -1;
+        }
     }
 
-    for (int i = 0; i < 256; i++) {
-        uint16_t data = (buffer[i * 2 + 1] << 8) | buffer[i * 2];
-        outw(ATA_DATA, data);
+    g_ata_pending = 0;
+    return r;
+}
+
+/* Découpe [phys, phys+bytes) en entrées PRD sans traverser de frontière 64 KiB.
+ * Le noyau n'active pas la pagination : adresse du buffer = adresse physique,
+ * donc tout buffer noyau est physiquement contigu. */
+static int ata_build_prdt(uint32_t phys, uint32_t bytes) {
+    int n = 0;
+    while (bytes > 0) {
+        if (n == ATA_PRD_MAX) return -1;
+        uint32_t len = ((phys & ~0xFFFFu) + 0x10000u) - phys;
+        if (len > bytes) len = bytes;
+        g_prdt[n].phys = phys;
+        g_prdt[n].bytes = (uint16_t)(len & 0xFFFF);
+        g_prdt[n].flags = 0;
+        phys += len;
+        bytes -= len;
+        n++;
     }
+    if (n == 0) return -1;
+    g_prdt[n - 1].flags = PRD_EOT;
+    return n;
+}
 
-    if (wait_bsy_clear(1000000) != 0) {
-        print_string("ATA: timeout (write finish)\n");
-        return -1;
+/* Une commande READ DMA / WRITE DMA (EXT si besoin), fin signalée par IRQ14 */
+static int ata_dma_cmd(uint32_t lba, uint8_t* buffer, uint32_t count, int write) {
+    int ext = ata_need_ext(lba, count);
+    uint8_t cmd = write ? (ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA)
+                        : (ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    ata_completion_t done = { 0, 0 };
+    uint32_t seen = 0;
+    int r = 0;
+
+    if (ata_build_prdt((uint32_t)(uintptr_t)buffer, count * 512) < 0) return -1;
+
+    outl(g_bmide + BM_PRDT, (uint32_t)(uintptr_t)g_prdt);
+    outb(g_bmide + BM_CMD, dir);
+    outb(g_bmide + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+
+    g_ata_pending = &done;
+    if (ata_issue(lba, count, cmd, ext) != 0) {
+        r = -1;
+    } else {
+        outb(g_bmide + BM_CMD, dir | BM_CMD_START);
+        /* BSY reste levé pendant le transfert : même attente qu'en PIO */
+        int st = ata_wait_event(&done, &seen);
+        if (st < 0 || (st & ATA_ERR)) r = -1;
     }
 
-    return 0;
+    outb(g_bmide + BM_CMD, dir);
+    uint8_t bm = inb(g_bmide + BM_STATUS);
+    outb(g_bmide + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+    g_ata_pending = 0;
+
+    if (r == 0 && (bm & BM_ST_ERR)) r = -1;
+    if (r != 0) print_string("ATA: DMA error\n");
+    return r;
+}
+
+/* DMA si le contrôleur est présent et le buffer aligné sur 2 octets */
+static int ata_dma_usable(const void* buffer) {
+    return g_bmide != 0 && ((uintptr_t)buffer & 1) == 0;
+}
+
+int ata_read_single(uint32_t lba, uint8_t* buffer) {
+    if (g_backend == ATA_BACKEND_VIRTIO) return virtio_blk_read(lba, buffer, 1);
+    if (g_backend == ATA_BACKEND_AHCI) return ahci_read(lba, buffer, 1);
+    return ata_read_cmd(lba, buffer, 1);
+}
+
+int ata_write_single(uint32_t lba, const uint8_t* buffer) {
+    if (g_backend == ATA_BACKEND_VIRTIO) return virtio_blk_write(lba, buffer, 1);
+    if (g_backend == ATA_BACKEND_AHCI) return ahci_write(lba, buffer, 1);
+    return ata_write_cmd(lba, buffer, 1);
+}
+
+/* Taille du prochain lot pour une commande ; 0 si la zone est inaccessible */
+static uint32_t ata_chunk(uint32_t lba, uint32_t count) {
+    uint32_t max = g_dev.lba48 ? ATA_MAX_SECTORS_PER_CMD_EXT : ATA_MAX_SECTORS_PER_CMD;
+    uint32_t n = count < max ? count : max;
+    if (!g_dev.lba48 && (uint64_t)lba + n > ATA_LBA28_LIMIT) {
+        print_string("ATA: LBA au-dela de 28 bits sans LBA48\n");
+        return 0;
+    }
+    return n;
 }
 
 int ata_read(uint32_t lba, uint8_t* buffer, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        int r = ata_read_single(lba + i, buffer + i * 512);
+    if (g_backend == ATA_BACKEND_VIRTIO) return virtio_blk_read(lba, buffer, count);
+    if (g_backend == ATA_BACKEND_AHCI) return ahci_read(lba, buffer, count);
+    while (count > 0) {
+        uint32_t n = ata_chunk(lba, count);
+        if (n == 0) return -1;
+        int r = -1;
+        if (ata_dma_usable(buffer)) r = ata_dma_cmd(lba, buffer, n, 0);
+        if (r != 0) r = ata_read_cmd(lba, buffer, n); /* repli PIO */
         if (r != 0) return r;
+        lba += n;
+        buffer += n * 512;
+        count -= n;
     }
     return 0;
 }
 
 int ata_write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        int r = ata_write_single(lba + i, buffer + i * 512);
+    if (g_backend == ATA_BACKEND_VIRTIO) return virtio_blk_write(lba, buffer, count);
+    if (g_backend == ATA_BACKEND_AHCI) return ahci_write(lba, buffer, count);
+    while (count > 0) {
+        uint32_t n = ata_chunk(lba, count);
+        if (n == 0) return -1;
+        int r = -1;
+        if (ata_dma_usable(buffer)) r = ata_dma_cmd(lba, (uint8_t*)buffer, n, 1);
+        if (r != 0) r = ata_write_cmd(lba, buffer, n); /* repli PIO */
         if (r != 0) return r;
+        lba += n;
+        buffer += n * 512;
+        count -= n;
     }
     return 0;
 }
+
+/* FLUSH CACHE : ne revient qu'une fois le cache d'écriture du disque sur le média */
+int ata_flush(void) {
+    if (g_backend == ATA_BACKEND_VIRTIO) return virtio_blk_flush();
+    if (g_backend == ATA_BACKEND_AHCI) return ahci_flush(g_dev.flush_ext);
+    if (!g_dev.present) return -1;
+
+    uint8_t cmd = g_dev.flush_ext ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE;
+    ata_completion_t done = { 0, 0 };
+    int r = 0;
+
+    g_ata_pending = &done;
+    outb(ATA_DRIVE_SEL, 0xE0);
+    io_wait();
+    if (wait_bsy_clear(ATA_TIMEOUT_SELECT_MS) != 0) {
+        print_string("ATA: busy after select\n");
+        r = -1;
+    } else {
+        outb(ATA_COMMAND, cmd);
+        int st;
+        if (g_ata_irq_mode) {
+            st = ata_wait_irq(&done, 0, ATA_TIMEOUT_FLUSH_MS) == 0 ? done.status : -1;
+        } else {
+            st = wait_bsy_clear(ATA_TIMEOUT_FLUSH_MS) == 0 ? inb(ATA_STATUS) : -1;
+        }
+        if (st < 0 || (st & ATA_ERR)) {
+            print_string("ATA: flush failed\n");
+            r = -1;
+        }
+    }
+
+    g_ata_pending = 0;
+    return r;
+}
+
+const ata_device_t* ata_get_device(void) {
+    return &g_dev;
+}
+
+uint64_t ata_sector_count(void) {
+    return g_dev.sectors;
+}
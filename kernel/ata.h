@@ -3,6 +3,22 @@
 
 #include <stdint.h>
 
+/* Capacités du disque, décodées depuis IDENTIFY DEVICE */
+typedef struct {
+    uint64_t sectors;          /* capacité en secteurs de 512 octets */
+    uint8_t  present;
+    uint8_t  lba48;            /* commandes EXT disponibles */
+    uint16_t max_multi;        /* secteurs/bloc READ/WRITE MULTIPLE (0 = non) */
+    uint8_t  dma;              /* DMA supporté (mot 49) */
+    uint8_t  mwdma_modes;      /* bits des modes multiword DMA 0-2 (mot 63) */
+    uint8_t  udma_modes;       /* bits des modes Ultra DMA 0-6 (mot 88) */
+    uint8_t  write_cache;      /* cache d'écriture supporté */
+    uint8_t  write_cache_enabled;
+    uint8_t  flush;            /* FLUSH CACHE (0xE7) */
+    uint8_t  flush_ext;        /* FLUSH CACHE EXT (0xEA) */
+    char     model[41];
+} ata_device_t;
+
 // Prototpyes de ata init
 void ata_init();
 // Prototypes (0 = success, non-0 = error)
@@ -10,5 +26,12 @@ int ata_read(uint32_t lba, uint8_t* buffer, uint32_t count);
 int ata_write(uint32_t lba, const uint8_t* buffer, uint32_t count);
 int ata_read_single(uint32_t lba, uint8_t* buffer);
 int ata_write_single(uint32_t lba, const uint8_t* buffer);
+// FLUSH CACHE (0xE7, ou 0xEA en LBA48) sur le backend actif
+int ata_flush(void);
+
+// Descripteur du disque actif (valide après ata_init)
+const ata_device_t* ata_get_device(void);
+// Capacité en secteurs de 512 octets (0 si inconnue)
+uint64_t ata_sector_count(void);
 
 #endif
@@ -0,0 +1,483 @@
+#include "bcache.h"
+#include "blkq.h"
+#include "screen.h"
+#include "vga.h"
+#include "utils.h"
+#include "src/mem/pfa.h"
+
+#define SECTOR_SIZE 512
+#define NIL (-1)
+
+typedef struct {
+    uint32_t lba;
+    int      hnext;     /* chaînage du seau */
+    int      prev;      /* LRU : vers le plus récent */
+    int      next;      /* LRU : vers le plus ancien */
+    uint8_t  valid;
+    uint8_t  loading;   /* lecture en file, pas encore arrivée */
+    uint8_t  dirty;     /* plus récent que le disque */
+    uint8_t  pinned;    /* sale mais interdit d'écriture (journal pas encore commité) */
+} bc_entry_t;
+
+/* Copie à faire vers l'appelant quand le secteur en chargement sera arrivé */
+typedef struct {
+    int      idx;
+    uint8_t* dst;
+} bc_copy_t;
+
+/* Pool pris au pfa (au-dessus de 1 Mio) au premier usage : données,
+ * copies, entrées et pile libre d'un seul tenant. Sans pfa, une petite
+ * réserve statique garde le FS utilisable */
+#define BCACHE_FALLBACK_BLOCKS 16
+
+/* Épinglés écrits faute de place (pinned overflow) : le prochain commit doit
+ * encore les journaliser, sinon un rejeu y remettrait une version plus
+ * ancienne */
+#define BCACHE_SPILL_MAX 64
+
+static uint8_t (*g_data)[SECTOR_SIZE] = 0;
+static bc_copy_t* g_copies = 0;
+static bc_entry_t* g_ent = 0;
+static int* g_free = 0;
+static int g_max = 0;          /* secteurs du pool */
+static int g_hash[BCACHE_HASH_SIZE];
+static int g_nfree = 0;
+static int g_lru_head = NIL;   /* plus récent */
+static int g_lru_tail = NIL;   /* plus ancien : victime */
+static int g_ready = 0;
+static int g_writeback = 0;
+static uint32_t g_spill[BCACHE_SPILL_MAX];
+static int g_nspill = 0;
+
+static bcache_stats_t g_stats;
+
+static uint32_t bucket_of(uint32_t lba) {
+    return lba & (BCACHE_HASH_SIZE - 1);
+}
+
+static void bc_pool(void) {
+    static uint8_t fb_data[BCACHE_FALLBACK_BLOCKS][SECTOR_SIZE] __attribute__((aligned(16)));
+    static bc_copy_t fb_copies[BCACHE_FALLBACK_BLOCKS];
+    static bc_entry_t fb_ent[BCACHE_FALLBACK_BLOCKS];
+    static int fb_free[BCACHE_FALLBACK_BLOCKS];
+
+    uint32_t bytes = (uint32_t)BCACHE_MAX_BLOCKS
+                   * (SECTOR_SIZE + sizeof(bc_copy_t) + sizeof(bc_entry_t) + sizeof(int));
+    uintptr_t p = pfa_alloc_run((bytes + PFA_FRAME_SIZE - 1) / PFA_FRAME_SIZE);
+    if (!p) {
+        print_string("BCACHE: no memory for the pool, 16 sectors only\n");
+        g_data = fb_data;
+        g_copies = fb_copies;
+        g_ent = fb_ent;
+        g_free = fb_free;
+        g_max = BCACHE_FALLBACK_BLOCKS;
+        return;
+    }
+    g_data = (uint8_t (*)[SECTOR_SIZE])p;
+    g_copies = (bc_copy_t*)(g_data + BCACHE_MAX_BLOCKS);
+    g_ent = (bc_entry_t*)(g_copies + BCACHE_MAX_BLOCKS);
+    g_free = (int*)(g_ent + BCACHE_MAX_BLOCKS);
+    g_max = BCACHE_MAX_BLOCKS;
+}
+
+static void bc_setup(void) {
+    if (!g_ent) bc_pool();
+    for (int i = 0; i < BCACHE_HASH_SIZE; ++i) g_hash[i] = NIL;
+    g_nfree = 0;
+    for (int i = g_max - 1; i >= 0; --i) {
+        g_ent[i].valid = 0;
+        g_ent[i].loading = 0;
+        g_ent[i].dirty = 0;
+        g_ent[i].pinned = 0;
+        g_free[g_nfree++] = i;
+    }
+    g_lru_head = g_lru_tail = NIL;
+    g_stats.used = 0;
+    g_stats.dirty = 0;
+    g_stats.pinned = 0;
+    g_nspill = 0;
+    if (g_stats.budget == 0) g_stats.budget = BCACHE_DEFAULT_BUDGET;
+    if (g_stats.budget > (uint32_t)g_max) g_stats.budget = (uint32_t)g_max;
+    g_ready = 1;
+}
+
+static void lru_unlink(int i) {
+    bc_entry_t* e = &g_ent[i];
+    if (e->prev != NIL) g_ent[e->prev].next = e->next; else g_lru_head = e->next;
+    if (e->next != NIL) g_ent[e->next].prev = e->prev; else g_lru_tail = e->prev;
+    e->prev = e->next = NIL;
+}
+
+static void lru_push_front(int i) {
+    g_ent[i].prev = NIL;
+    g_ent[i].next = g_lru_head;
+    if (g_lru_head != NIL) g_ent[g_lru_head].prev = i;
+    g_lru_head = i;
+    if (g_lru_tail == NIL) g_lru_tail = i;
+}
+
+static void touch(int i) {
+    if (g_lru_head == i) return;
+    lru_unlink(i);
+    lru_push_front(i);
+}
+
+static int lookup(uint32_t lba) {
+    for (int i = g_hash[bucket_of(lba)]; i != NIL; i = g_ent[i].hnext)
+        if (g_ent[i].lba == lba) return i;
+    return NIL;
+}
+
+static void set_unpinned(int i) {
+    if (!g_ent[i].pinned) return;
+    g_ent[i].pinned = 0;
+    g_stats.pinned--;
+}
+
+static void set_clean(int i) {
+    set_unpinned(i);
+    if (!g_ent[i].dirty) return;
+    g_ent[i].dirty = 0;
+    g_stats.dirty--;
+}
+
+static void set_dirty(int i) {
+    if (g_ent[i].dirty) return;
+    g_ent[i].dirty = 1;
+    g_stats.dirty++;
+}
+
+/* Met un secteur sale en file d'écriture (blkq en garde une copie) */
+static int write_back(int i) {
+    if (blkq_submit(g_ent[i].lba, g_data[i], 1, 1) != 0) return -1;
+    set_clean(i);
+    g_stats.writebacks++;
+    return 0;
+}
+
+static void bc_remove(int i) {
+    int* link = &g_hash[bucket_of(g_ent[i].lba)];
+    while (*link != i) link = &g_ent[*link].hnext;
+    *link = g_ent[i].hnext;
+    lru_unlink(i);
+    set_clean(i);
+    g_ent[i].valid = 0;
+    g_ent[i].loading = 0;
+    g_free[g_nfree++] = i;
+    g_stats.used--;
+}
+
+static void settle(void);
+static int g_nloading = 0;   /* secteurs du lot en cours pas encore arrivés */
+
+/* Ni épinglé (attend le journal) ni en chargement (g_copies y renvoie
+ * encore) : le plus ancien secteur qu'on peut rendre */
+static int victim(void) {
+    int i = g_lru_tail;
+    while (i != NIL && (g_ent[i].pinned || g_ent[i].loading)) i = g_ent[i].prev;
+    return i;
+}
+
+/* Rend un secteur. Retourne -1 si rien n'est évinçable alors que le pool a
+ * encore de la place : l'appelant dépasse le budget plutôt que d'écrire
+ * des métadonnées avant leur commit */
+static int evict_one(void) {
+    int i = victim();
+    if (i == NIL && g_nloading > 0) {
+        /* Rien d'autre que des secteurs en vol : le lot doit se terminer */
+        settle();
+        i = victim();
+    }
+    if (i == NIL && g_nfree > 0) return -1;
+    if (i == NIL) {
+        /* Pool plein d'épinglés malgré pin_room (commit déjà en cours, ou
+         * échoué) : mieux vaut écrire trop tôt que bloquer */
+        i = g_lru_tail;
+        if (i == NIL) return -1;
+        print_string("BCACHE: pinned overflow\n");
+        if (g_nspill < BCACHE_SPILL_MAX) g_spill[g_nspill++] = g_ent[i].lba;
+        else print_string("BCACHE: spill list full\n");
+        set_unpinned(i);
+    }
+    if (g_ent[i].dirty && write_back(i) != 0)
+        print_string("BCACHE: write-back failed\n");
+    bc_remove(i);
+    g_stats.evictions++;
+    return 0;
+}
+
+static int (*g_pin_flush)(void) = 0;
+static int g_pin_flushing = 0;
+
+/* Avant de chercher quoi que ce soit : si `count` secteurs ne trouvent plus
+ * de place hors des épinglés, le journal les commite d'abord. Plus tard,
+ * depuis bc_alloc, le commit pourrait remettre en cache le secteur que
+ * l'appelant vient de ne pas trouver */
+static void pin_room(uint32_t count) {
+    if (!g_pin_flush || g_pin_flushing) return;
+    if (g_stats.used - g_stats.pinned - (uint32_t)g_nloading + (uint32_t)g_nfree >= count) return;
+    settle();
+    g_pin_flushing = 1;
+    g_pin_flush();
+    g_pin_flushing = 0;
+}
+
+static int bc_alloc(uint32_t lba) {
+    while (g_stats.used >= g_stats.budget || g_nfree == 0)
+        if (evict_one() != 0) break;
+    int i = g_free[--g_nfree];
+    bc_entry_t* e = &g_ent[i];
+    uint32_t b = bucket_of(lba);
+    e->lba = lba;
+    e->valid = 1;
+    e->loading = 0;
+    e->dirty = 0;
+    e->pinned = 0;
+    e->hnext = g_hash[b];
+    g_hash[b] = i;
+    lru_push_front(i);
+    g_stats.used++;
+    return i;
+}
+
+/* Requête trop grosse pour le budget : pas de mise en cache, sinon elle
+ * évincerait ses propres secteurs avant la fin du dispatch */
+static int too_big(uint32_t count) {
+    return count > g_stats.budget / 2;
+}
+
+/* ---------- Lots de lectures ---------- */
+
+static int g_ncopies = 0;
+static int g_batch = 0;       /* lectures en file depuis le dernier complete */
+static int g_batch_err = 0;   /* erreur collante jusqu'au prochain complete */
+
+int bcache_complete(void) {
+    int r = g_batch_err ? -1 : 0;
+    if (g_batch && blkq_dispatch() != 0) r = -1;
+    if (r == 0) {
+        for (int k = 0; k < g_ncopies; ++k)
+            memcpy(g_copies[k].dst, g_data[g_copies[k].idx], SECTOR_SIZE);
+    }
+    if (g_nloading > 0) {
+        for (int i = 0; i < g_max; ++i) {
+            if (!g_ent[i].valid || !g_ent[i].loading) continue;
+            if (r != 0) bc_remove(i); /* contenu inconnu : on oublie */
+            else g_ent[i].loading = 0;
+        }
+    }
+    g_ncopies = 0;
+    g_nloading = 0;
+    g_batch = 0;
+    g_batch_err = 0;
+    return r;
+}
+
+/* Termine le lot en cours sans perdre son erreur pour l'appelant final */
+static void settle(void) {
+    if (!g_batch && !g_batch_err) return;
+    if (bcache_complete() != 0) g_batch_err = 1;
+}
+
+static void queue_fill(int i) {
+    g_ent[i].loading = 1;
+    g_nloading++;
+    g_batch = 1;
+    if (blkq_submit(g_ent[i].lba, g_data[i], 1, 0) != 0) g_batch_err = 1;
+}
+
+static void add_copy(int i, uint8_t* dst) {
+    if (g_ncopies == g_max) settle();
+    if (!g_ent[i].loading) {
+        memcpy(dst, g_data[i], SECTOR_SIZE);
+        return;
+    }
+    g_copies[g_ncopies].idx = i;
+    g_copies[g_ncopies].dst = dst;
+    g_ncopies++;
+}
+
+int bcache_queue_read(uint32_t lba, uint8_t* buf, uint32_t count, int direct) {
+    if (!g_ready) bc_setup();
+    if (too_big(count)) direct = 1;
+    if (!direct) pin_room(count);
+
+    uint32_t s = 0;
+    while (s < count) {
+        int i = lookup(lba + s);
+        if (i != NIL) {
+            g_stats.hits++;
+            touch(i);
+            add_copy(i, buf + s * SECTOR_SIZE);
+            s++;
+            continue;
+        }
+        if (direct) {
+            /* Plage absente du cache : lue droit dans le buffer de l'appelant */
+            uint32_t run = 1;
+            while (s + run < count && lookup(lba + s + run) == NIL) run++;
+            g_stats.misses += run;
+            g_batch = 1;
+            if (blkq_submit(lba + s, buf + s * SECTOR_SIZE, run, 0) != 0) g_batch_err = 1;
+            s += run;
+            continue;
+        }
+        g_stats.misses++;
+        i = bc_alloc(lba + s);
+        queue_fill(i);
+        add_copy(i, buf + s * SECTOR_SIZE);
+        s++;
+    }
+    return g_batch_err ? -1 : 0;
+}
+
+int bcache_prefetch(uint32_t lba, uint32_t count) {
+    if (!g_ready) bc_setup();
+    /* Jamais plus d'un quart du budget : ne pas chasser le lot en cours */
+    if (count > g_stats.budget / 4) count = g_stats.budget / 4;
+    pin_room(count);
+    for (uint32_t s = 0; s < count; ++s) {
+        if (lookup(lba + s) != NIL) continue;
+        queue_fill(bc_alloc(lba + s));
+        g_stats.prefetched++;
+    }
+    return g_batch_err ? -1 : 0;
+}
+
+int bcache_read(uint32_t lba, uint8_t* buf, uint32_t count) {
+    if (count == 0) return 0;
+    bcache_queue_read(lba, buf, count, 0);
+    return bcache_complete();
+}
+
+int bcache_write(uint32_t lba, const uint8_t* buf, uint32_t count) {
+    if (!g_ready) bc_setup();
+    if (count == 0) return 0;
+    settle(); /* une lecture en vol écraserait la nouvelle donnée */
+
+    int big = too_big(count);
+    if (!big) pin_room(count);
+    for (uint32_t s = 0; s < count; ++s) {
+        int i = lookup(lba + s);
+        if (i == NIL) {
+            if (big) continue;
+            i = bc_alloc(lba + s);
+        }
+        memcpy(g_data[i], buf + s * SECTOR_SIZE, SECTOR_SIZE);
+        touch(i);
+        if (g_ent[i].pinned) continue;   /* reste au journal */
+        if (g_writeback && !big) set_dirty(i);
+        else set_clean(i);
+    }
+
+    if (g_writeback && !big) {
+        if (g_stats.dirty * 100 > g_stats.budget * BCACHE_DIRTY_HIGH_PCT) return bcache_sync();
+        return 0;
+    }
+
+    if (blkq_submit(lba, (uint8_t*)buf, count, 1) != 0) {
+        /* Le disque n'a pas suivi : le cache ne doit pas mentir */
+        for (uint32_t s = 0; s < count; ++s) {
+            int i = lookup(lba + s);
+            if (i != NIL) bc_remove(i);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int bcache_write_pinned(uint32_t lba, const uint8_t* buf, uint32_t count) {
+    if (!g_ready) bc_setup();
+    settle();
+    pin_room(count);
+    for (uint32_t s = 0; s < count; ++s) {
+        int i = lookup(lba + s);
+        if (i == NIL) i = bc_alloc(lba + s);
+        memcpy(g_data[i], buf + s * SECTOR_SIZE, SECTOR_SIZE);
+        touch(i);
+        set_dirty(i);
+        if (!g_ent[i].pinned) {
+            g_ent[i].pinned = 1;
+            g_stats.pinned++;
+        }
+    }
+    return 0;
+}
+
+int bcache_pinned(uint32_t* lbas, int max) {
+    int n = 0;
+    for (int i = 0; i < g_max && n < max; ++i)
+        if (g_ent[i].valid && g_ent[i].pinned) lbas[n++] = g_ent[i].lba;
+    return n;
+}
+
+int bcache_spilled(uint32_t* lbas, int max) {
+    int n = 0;
+    for (int k = 0; k < g_nspill && n < max; ++k) {
+        int i = lookup(g_spill[k]);
+        if (i == NIL || !g_ent[i].pinned) lbas[n++] = g_spill[k];   /* sinon déjà listé */
+    }
+    return n;
+}
+
+void bcache_unpin_all(void) {
+    for (int i = 0; i < g_max && g_stats.pinned > 0; ++i)
+        if (g_ent[i].valid) set_unpinned(i);
+    g_nspill = 0;
+}
+
+void bcache_discard(uint32_t lba, uint32_t count) {
+    if (!g_ready) return;
+    settle();
+    for (uint32_t s = 0; s < count; ++s) {
+        int i = lookup(lba + s);
+        if (i != NIL) bc_remove(i);
+    }
+}
+
+void bcache_set_budget(uint32_t blocks) {
+    if (!g_ready) bc_setup();
+    if (blocks == 0) blocks = 1;
+    if (blocks > (uint32_t)g_max) blocks = (uint32_t)g_max;
+    settle();
+    g_stats.budget = blocks;
+    while (g_stats.used > g_stats.budget)
+        if (evict_one() != 0) break;
+}
+
+void bcache_set_pin_flush(int (*commit)(void)) {
+    g_pin_flush = commit;
+}
+
+int bcache_sync(void) {
+    if (!g_ready) bc_setup();
+    settle();
+    int r = 0;
+    /* blkq trie par LBA et fusionne les secteurs voisins */
+    for (int i = 0; i < g_max && g_stats.dirty > 0; ++i) {
+        if (g_ent[i].valid && g_ent[i].dirty && !g_ent[i].pinned && write_back(i) != 0) r = -1;
+    }
+    if (blkq_dispatch() != 0) r = -1;
+    return r;
+}
+
+void bcache_set_writeback(int on) {
+    if (!g_ready) bc_setup();
+    if (!on && g_writeback) bcache_sync();
+    g_writeback = on ? 1 : 0;
+}
+
+int bcache_writeback_enabled(void) {
+    return g_writeback;
+}
+
+void bcache_invalidate(void) {
+    settle();
+    g_batch_err = 0;
+    bc_setup();
+}
+
+const bcache_stats_t* bcache_get_stats(void) {
+    if (!g_ready) bc_setup();
+    return &g_stats;
+}
@@ -0,0 +1,91 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+
+/*
+ * bcache — cache de secteurs au-dessus de blkq.
+ *
+ * Index par table de hachage sur le LBA, éviction LRU, budget mémoire
+ * réglable (en secteurs) dans la limite du pool. Le pool est pris au pfa,
+ * au-dessus de 1 Mio, au premier appel : pfa doit être initialisé avant.
+ *
+ * En write-through, les écritures mettent le cache à jour puis partent vers
+ * blkq. En write-back, elles marquent seulement les secteurs sales ; ceux-ci
+ * rejoignent le disque sur bcache_sync(), à l'éviction, ou quand la part de
+ * secteurs sales dépasse BCACHE_DIRTY_HIGH_PCT du budget.
+ *
+ * Les secteurs épinglés (métadonnées pas encore journalisées) sont sales
+ * mais ne partent ni à l'éviction ni au sync, jusqu'à bcache_unpin_all().
+ * Quand ils occupent tout le cache, le budget est dépassé tant que le pool
+ * a de la place ; au-delà, le journal est prié de commiter (voir
+ * bcache_set_pin_flush).
+ */
+
+/* Pool et table de hachage : les outils hôte (host/) les agrandissent à
+ * la compilation */
+#ifndef BCACHE_MAX_BLOCKS
+#define BCACHE_MAX_BLOCKS     512   /* pool : 256 Kio de données */
+#endif
+#define BCACHE_DEFAULT_BUDGET 256
+#ifndef BCACHE_HASH_SIZE
+#define BCACHE_HASH_SIZE      256   /* puissance de 2 */
+#endif
+#define BCACHE_DIRTY_HIGH_PCT 75    /* pression : écriture des sales au-delà */
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t budget;   /* secteurs autorisés */
+    uint32_t used;     /* secteurs occupés */
+    uint32_t dirty;    /* secteurs pas encore écrits (write-back) */
+    uint32_t writebacks;
+    uint32_t prefetched;   /* secteurs lus par anticipation */
+    uint32_t pinned;       /* secteurs retenus pour le journal */
+} bcache_stats_t;
+
+// Même contrat que ata_read/ata_write (0 = succès)
+int bcache_read(uint32_t lba, uint8_t* buf, uint32_t count);
+int bcache_write(uint32_t lba, const uint8_t* buf, uint32_t count);
+
+// Lots de lectures : bcache_queue_read et bcache_prefetch ne font que mettre
+// en file ; tout part en un seul dispatch blkq (requêtes voisines fusionnées)
+// au bcache_complete(), qui remplit alors les buffers. Avec `direct`, les
+// secteurs absents du cache sont lus dans `buf` sans y être gardés.
+int bcache_queue_read(uint32_t lba, uint8_t* buf, uint32_t count, int direct);
+int bcache_prefetch(uint32_t lba, uint32_t count);
+int bcache_complete(void);
+
+// Journal : écrit dans le cache en épinglant (toujours write-back), liste
+// les LBA épinglés (au plus `max`), puis les relâche une fois le commit fait
+int bcache_write_pinned(uint32_t lba, const uint8_t* buf, uint32_t count);
+int bcache_pinned(uint32_t* lbas, int max);
+// Épinglés déjà écrits à leur place faute de mémoire : à journaliser quand
+// même (relus du disque), mais leur place est déjà à jour
+int bcache_spilled(uint32_t* lbas, int max);
+void bcache_unpin_all(void);
+// Commit demandé quand une lecture ou écriture ne trouverait plus de place
+// hors des secteurs épinglés ; il finit par bcache_unpin_all(). Sans lui,
+// ils partent sans journal.
+void bcache_set_pin_flush(int (*commit)(void));
+
+// Oublie des secteurs libérés sans les écrire, même sales ou épinglés
+void bcache_discard(uint32_t lba, uint32_t count);
+
+// Change le budget (borné à BCACHE_MAX_BLOCKS), évince si besoin
+void bcache_set_budget(uint32_t blocks);
+
+// Active (1) ou non (0) le write-back ; le désactiver écrit les sales
+void bcache_set_writeback(int on);
+int bcache_writeback_enabled(void);
+
+// Envoie tous les secteurs sales non épinglés au disque via blkq (sans FLUSH CACHE)
+int bcache_sync(void);
+
+// Vide tout le cache (après un formatage par exemple). Les sales sont perdus.
+void bcache_invalidate(void);
+
+const bcache_stats_t* bcache_get_stats(void);
+
+#endif
@@ -0,0 +1,171 @@
+#include "blkq.h"
+#include "ata.h"
+#include "screen.h"
+#include "vga.h"
+#include "utils.h"
+#include "src/mem/pfa.h"
+
+#define SECTOR_SIZE 512
+
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+    uint8_t  write;
+    uint8_t* buf;   /* lecture : buffer de l'appelant ; écriture : copie en staging */
+} blkq_req_t;
+
+static blkq_req_t g_reqs[BLKQ_MAX_REQS];
+static int g_nreqs = 0;
+
+/* Staging et bounce : 256 Kio pris au pfa (au-dessus de 1 Mio) au premier
+ * usage, pas dans le .bss qui doit rester sous la pile du kernel */
+#define STAGING_FRAMES ((BLKQ_STAGING_SECTORS * SECTOR_SIZE) / PFA_FRAME_SIZE)
+#define BOUNCE_FRAMES  ((BLKQ_MAX_MERGE * SECTOR_SIZE) / PFA_FRAME_SIZE)
+
+static uint8_t* g_staging = 0;
+static uint32_t g_staging_used = 0;   /* en secteurs */
+
+static uint8_t* g_bounce = 0;
+
+static blkq_stats_t g_stats;
+
+static int blkq_setup(void) {
+    if (g_staging) return 0;
+    uintptr_t staging = pfa_alloc_run(STAGING_FRAMES);
+    uintptr_t bounce = pfa_alloc_run(BOUNCE_FRAMES);
+    if (!staging || !bounce) {
+        if (staging) pfa_free_run(staging, STAGING_FRAMES);
+        if (bounce) pfa_free_run(bounce, BOUNCE_FRAMES);
+        return -1;
+    }
+    g_staging = (uint8_t*)staging;
+    g_bounce = (uint8_t*)bounce;
+    return 0;
+}
+
+static int overlaps(const blkq_req_t* r, uint32_t lba, uint32_t count) {
+    return lba < r->lba + r->count && r->lba < lba + count;
+}
+
+/* Envoie le groupe reqs[first..last] (LBA contigus, même sens) en une commande */
+static int issue_group(int first, int last) {
+    blkq_req_t* f = &g_reqs[first];
+    uint32_t total = 0;
+    int contiguous = 1;
+    for (int i = first; i <= last; ++i) {
+        if (i > first && g_reqs[i].buf != g_reqs[i - 1].buf + g_reqs[i - 1].count * SECTOR_SIZE)
+            contiguous = 0;
+        total += g_reqs[i].count;
+    }
+
+    g_stats.commands++;
+    g_stats.merged += (uint32_t)(last - first);
+
+    /* Buffers déjà contigus en mémoire : pas de copie */
+    if (contiguous) {
+        return f->write ? ata_write(f->lba, f->buf, total) : ata_read(f->lba, f->buf, total);
+    }
+
+    if (f->write) {
+        uint8_t* p = g_bounce;
+        for (int i = first; i <= last; ++i) {
+            memcpy(p, g_reqs[i].buf, g_reqs[i].count * SECTOR_SIZE);
+            p += g_reqs[i].count * SECTOR_SIZE;
+        }
+        return ata_write(f->lba, g_bounce, total);
+    }
+
+    if (ata_read(f->lba, g_bounce, total) != 0) return -1;
+    uint8_t* p = g_bounce;
+    for (int i = first; i <= last; ++i) {
+        memcpy(g_reqs[i].buf, p, g_reqs[i].count * SECTOR_SIZE);
+        p += g_reqs[i].count * SECTOR_SIZE;
+    }
+    return 0;
+}
+
+int blkq_dispatch(void) {
+    int r = 0;
+    int i = 0;
+    /* La file est déjà triée : une passe suffit pour former les groupes */
+    while (i < g_nreqs) {
+        int j = i;
+        uint32_t total = g_reqs[i].count;
+        while (j + 1 < g_nreqs
+               && g_reqs[j + 1].write == g_reqs[i].write
+               && g_reqs[j + 1].lba == g_reqs[j].lba + g_reqs[j].count
+               && total + g_reqs[j + 1].count <= BLKQ_MAX_MERGE) {
+            total += g_reqs[j + 1].count;
+            j++;
+        }
+        if (issue_group(i, j) != 0) {
+            print_string("BLKQ: I/O error\n");
+            r = -1;
+        }
+        i = j + 1;
+    }
+    g_nreqs = 0;
+    g_staging_used = 0;
+    return r;
+}
+
+int blkq_submit(uint32_t lba, uint8_t* buf, uint32_t count, int write) {
+    if (count == 0) return 0;
+    g_stats.submitted++;
+
+    /* Trop gros pour la file, ou pas de mémoire pour la file : envoi direct
+     * après vidage (ordre préservé) */
+    if (count > BLKQ_MAX_MERGE || (write && count > BLKQ_STAGING_SECTORS)
+        || blkq_setup() != 0) {
+        if (blkq_dispatch() != 0) return -1;
+        g_stats.commands++;
+        return write ? ata_write(lba, buf, count) : ata_read(lba, buf, count);
+    }
+
+    for (int i = 0; i < g_nreqs; ++i) {
+        blkq_req_t* q = &g_reqs[i];
+        if (!overlaps(q, lba, count)) continue;
+        /* Réécriture exacte d'une écriture en attente : on remplace la copie */
+        if (write && q->write && q->lba == lba && q->count == count) {
+            memcpy(q->buf, buf, count * SECTOR_SIZE);
+            g_stats.coalesced++;
+            return 0;
+        }
+        /* Tout autre recouvrement : l'ordre compte, on vide la file d'abord */
+        if (blkq_dispatch() != 0) return -1;
+        break;
+    }
+
+    if (g_nreqs == BLKQ_MAX_REQS || (write && g_staging_used + count > BLKQ_STAGING_SECTORS)) {
+        if (blkq_dispatch() != 0) return -1;
+    }
+
+    uint8_t* data = buf;
+    if (write) {
+        data = g_staging + g_staging_used * SECTOR_SIZE;
+        memcpy(data, buf, count * SECTOR_SIZE);
+        g_staging_used += count;
+    }
+
+    /* Insertion triée par LBA */
+    int pos = g_nreqs;
+    while (pos > 0 && g_reqs[pos - 1].lba > lba) {
+        g_reqs[pos] = g_reqs[pos - 1];
+        pos--;
+    }
+    g_reqs[pos].lba = lba;
+    g_reqs[pos].count = count;
+    g_reqs[pos].write = (uint8_t)(write ? 1 : 0);
+    g_reqs[pos].buf = data;
+    g_nreqs++;
+    return 0;
+}
+
+int blkq_read(uint32_t lba, uint8_t* buf, uint32_t count) {
+    if (blkq_submit(lba, buf, count, 0) != 0) return -1;
+    return blkq_dispatch();
+}
+
+const blkq_stats_t* blkq_get_stats(void) {
+    return &g_stats;
+}
@@ -0,0 +1,41 @@
+#ifndef BLKQ_H
+#define BLKQ_H
+
+#include <stdint.h>
+
+/*
+ * blkq — file de requêtes bloc entre le FS et ata_read/ata_write.
+ *
+ * Les requêtes sont gardées triées par LBA (ascenseur) ; au dispatch, les
+ * requêtes adjacentes de même sens sont fusionnées en une seule commande
+ * multi-secteurs. Les écritures sont copiées dans une zone de staging :
+ * l'appelant peut réutiliser son buffer dès le retour de blkq_submit.
+ * Un buffer de lecture n'est rempli qu'après blkq_dispatch().
+ *
+ * Staging et bounce viennent du pfa au premier blkq_submit ; sans pfa
+ * initialisé, chaque requête part directement au disque.
+ */
+
+#define BLKQ_MAX_REQS        64
+#define BLKQ_STAGING_SECTORS 256   /* données d'écriture en attente (128 Kio) */
+#define BLKQ_MAX_MERGE       256   /* secteurs max par commande fusionnée */
+
+typedef struct {
+    uint32_t submitted;   /* requêtes reçues */
+    uint32_t coalesced;   /* écritures remplacées sur place (même LBA) */
+    uint32_t merged;      /* requêtes absorbées dans une commande voisine */
+    uint32_t commands;    /* commandes envoyées au disque */
+} blkq_stats_t;
+
+// Met une requête en file (0 = ok, -1 = erreur disque lors d'un dispatch forcé)
+int blkq_submit(uint32_t lba, uint8_t* buf, uint32_t count, int write);
+
+// Trie, fusionne et envoie toutes les requêtes en attente
+int blkq_dispatch(void);
+
+// Raccourci : met la lecture en file puis dispatch
+int blkq_read(uint32_t lba, uint8_t* buf, uint32_t count);
+
+const blkq_stats_t* blkq_get_stats(void);
+
+#endif
@@ -8,7 +8,7 @@
 %define VESA_MODE        0x118
 %define DAP_ADDR         0x0200       ; éviter d’écraser le bootloader
 %define VBE_INFO_ADDR    0x07A00
-%define KERNEL_SECTORS   16250
+%define KERNEL_SECTORS   511          ; zone de boot 1..511, superbloc reAPFS au 512 (reapfs_format.h)
 %define CHUNK_MAX        127
 
 start:
@@ -0,0 +1,80 @@
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t g_table[8][256];
+static int g_ready = 0;
+static int g_hw = 0;
+
+/* CPUID.1 : ECX bit 20 = SSE4.2 */
+static int cpu_has_sse42(void) {
+    uint32_t a = 1, b, c = 0, d;
+    asm volatile ("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    return (int)((c >> 20) & 1);
+}
+
+static void crc_setup(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1)));
+        g_table[0][i] = c;
+    }
+    /* table k : effet de l'octet suivi de k octets nuls */
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int k = 1; k < 8; ++k)
+            g_table[k][i] = (g_table[k - 1][i] >> 8) ^ g_table[0][g_table[k - 1][i] & 0xFF];
+    }
+    g_hw = cpu_has_sse42();
+    g_ready = 1;
+}
+
+static uint32_t crc_hw(uint32_t crc, const uint8_t* p, uint32_t len) {
+    while (len && ((uint32_t)(uintptr_t)p & 3)) {
+        asm ("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+        len--;
+    }
+    while (len >= 4) {
+        asm ("crc32l %1, %0" : "+r"(crc) : "rm"(*(const uint32_t*)p));
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        asm ("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+    }
+    return crc;
+}
+
+/* 8 octets par tour, une lecture de table par octet, sans dépendance entre
+ * les huit lectures */
+static uint32_t crc_soft(uint32_t crc, const uint8_t* p, uint32_t len) {
+    while (len && ((uint32_t)(uintptr_t)p & 3)) {
+        crc = (crc >> 8) ^ g_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo = *(const uint32_t*)p ^ crc;
+        uint32_t hi = *(const uint32_t*)(p + 4);
+        crc = g_table[7][lo & 0xFF] ^ g_table[6][(lo >> 8) & 0xFF]
+            ^ g_table[5][(lo >> 16) & 0xFF] ^ g_table[4][lo >> 24]
+            ^ g_table[3][hi & 0xFF] ^ g_table[2][(hi >> 8) & 0xFF]
+            ^ g_table[1][(hi >> 16) & 0xFF] ^ g_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = (crc >> 8) ^ g_table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, uint32_t len) {
+    if (!g_ready) crc_setup();
+    crc = ~crc;
+    crc = g_hw ? crc_hw(crc, (const uint8_t*)buf, len) : crc_soft(crc, (const uint8_t*)buf, len);
+    return ~crc;
+}
+
+int crc32c_hw(void) {
+    if (!g_ready) crc_setup();
+    return g_hw;
+}
@@ -0,0 +1,20 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+
+/*
+ * crc32c — somme CRC32C (polynôme de Castagnoli, forme réfléchie 0x82F63B78).
+ *
+ * Instruction crc32 de SSE4.2 quand CPUID la signale, sinon tables
+ * slice-by-8 (8 Kio, construites au premier appel). Les deux chemins
+ * donnent le même résultat.
+ */
+
+// Chaînable : crc32c(crc32c(0, a, na), b, nb) == somme de a puis b
+uint32_t crc32c(uint32_t crc, const void* buf, uint32_t len);
+
+// 1 si l'instruction matérielle est utilisée
+int crc32c_hw(void);
+
+#endif
@@ -0,0 +1,191 @@
+#include "idt.h"
+#include "io.h"
+#include "screen.h"
+#include "vga.h"
+#include "utils.h"
+
+#define PIC1_CMD   0x20
+#define PIC1_DATA  0x21
+#define PIC2_CMD   0xA0
+#define PIC2_DATA  0xA1
+#define PIC_EOI    0x20
+#define PIC_READ_ISR 0x0B
+
+#define IDT_ENTRIES   48
+#define KERNEL_CS     0x08   /* segment code du GDT du bootloader */
+#define GATE_INT32    0x8E   /* présent, ring 0, interrupt gate 32 bits */
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t  zero;
+    uint8_t  type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+static idt_entry_t g_idt[IDT_ENTRIES];
+static irq_handler_t g_irq_handlers[16];
+
+/* ---------- Stubs assembleur ----------
+ * Chaque stub pousse (err_code, vector) puis saute vers isr_common qui
+ * sauvegarde les registres et appelle interrupt_dispatch(frame).
+ * Les exceptions 8, 10-14, 17, 21, 29 et 30 poussent déjà un code d'erreur.
+ */
+asm (
+    ".pushsection .text\n"
+    ".macro ISR_NOERR n\n"
+    "isr\\n:\n"
+    "    pushl $0\n"
+    "    pushl $\\n\n"
+    "    jmp isr_common\n"
+    ".endm\n"
+    ".macro ISR_ERR n\n"
+    "isr\\n:\n"
+    "    pushl $\\n\n"
+    "    jmp isr_common\n"
+    ".endm\n"
+    ".irp n, 0,1,2,3,4,5,6,7,9,15,16,18,19,20,22,23,24,25,26,27,28,31\n"
+    "    ISR_NOERR \\n\n"
+    ".endr\n"
+    ".irp n, 8,10,11,12,13,14,17,21,29,30\n"
+    "    ISR_ERR \\n\n"
+    ".endr\n"
+    ".irp n, 32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47\n"
+    "    ISR_NOERR \\n\n"
+    ".endr\n"
+    "isr_common:\n"
+    "    pusha\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    mov $0x10, %ax\n"
+    "    mov %ax, %ds\n"
+    "    mov %ax, %es\n"
+    "    cld\n"
+    "    pushl %esp\n"
+    "    call interrupt_dispatch\n"
+    "    addl $4, %esp\n"
+    "    popl %gs\n"
+    "    popl %fs\n"
+    "    popl %es\n"
+    "    popl %ds\n"
+    "    popa\n"
+    "    addl $8, %esp\n"
+    "    iret\n"
+    ".popsection\n"
+    ".pushsection .rodata\n"
+    ".align 4\n"
+    "isr_stub_table:\n"
+    ".irp n, 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,"
+    "24,25,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47\n"
+    "    .long isr\\n\n"
+    ".endr\n"
+    ".popsection\n"
+);
+
+extern const uint32_t isr_stub_table[IDT_ENTRIES];
+
+void interrupt_dispatch(interrupt_frame_t *frame);
+
+static void idt_set_gate(uint8_t vector, uint32_t handler) {
+    g_idt[vector].offset_low  = (uint16_t)(handler & 0xFFFF);
+    g_idt[vector].selector    = KERNEL_CS;
+    g_idt[vector].zero        = 0;
+    g_idt[vector].type_attr   = GATE_INT32;
+    g_idt[vector].offset_high = (uint16_t)(handler >> 16);
+}
+
+static void pic_remap(void) {
+    /* ICW1 : init + ICW4 attendu */
+    outb(PIC1_CMD, 0x11);
+    outb(PIC2_CMD, 0x11);
+    /* ICW2 : vecteurs de base */
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    /* ICW3 : esclave sur IRQ2 */
+    outb(PIC1_DATA, 0x04);
+    outb(PIC2_DATA, 0x02);
+    /* ICW4 : mode 8086 */
+    outb(PIC1_DATA, 0x01);
+    outb(PIC2_DATA, 0x01);
+    /* Tout masquer : chaque driver démasque sa propre ligne */
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
+void idt_init(void) {
+    memset(g_idt, 0, sizeof(g_idt));
+    memset(g_irq_handlers, 0, sizeof(g_irq_handlers));
+    for (int i = 0; i < IDT_ENTRIES; ++i)
+        idt_set_gate((uint8_t)i, isr_stub_table[i]);
+
+    pic_remap();
+
+    idt_ptr_t ptr;
+    ptr.limit = (uint16_t)(sizeof(g_idt) - 1);
+    ptr.base  = (uint32_t)(uintptr_t)g_idt;
+    asm volatile ("lidt %0" : : "m"(ptr));
+}
+
+void irq_register(uint8_t irq, irq_handler_t handler) {
+    if (irq >= 16) return;
+    g_irq_handlers[irq] = handler;
+}
+
+void irq_unmask(uint8_t irq) {
+    if (irq >= 16) return;
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = 2; /* la cascade doit être ouverte pour les IRQ esclaves */
+    }
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+}
+
+void irq_mask(uint8_t irq) {
+    if (irq >= 16) return;
+    if (irq >= 8) outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (irq - 8)));
+    else          outb(PIC1_DATA, inb(PIC1_DATA) | (1 << irq));
+}
+
+/* IRQ7/IRQ15 peuvent être fausses : on vérifie l'ISR du PIC concerné */
+static int pic_is_spurious(uint8_t irq) {
+    if (irq == 7) {
+        outb(PIC1_CMD, PIC_READ_ISR);
+        return !(inb(PIC1_CMD) & 0x80);
+    }
+    if (irq == 15) {
+        outb(PIC2_CMD, PIC_READ_ISR);
+        if (!(inb(PIC2_CMD) & 0x80)) {
+            outb(PIC1_CMD, PIC_EOI); /* le maître a bien vu la cascade */
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void interrupt_dispatch(interrupt_frame_t *frame) {
+    if (frame->vector < IRQ_BASE_VECTOR) {
+        print_string("\nEXCEPTION CPU vector=");
+        print_hex(frame->vector);
+        print_string(" err=");
+        print_hex(frame->err_code);
+        print_string(" eip=");
+        print_hex(frame->eip);
+        print_string("\nSysteme arrete.\n");
+        for (;;) asm volatile ("cli; hlt");
+    }
+
+    uint8_t irq = (uint8_t)(frame->vector - IRQ_BASE_VECTOR);
+    if (pic_is_spurious(irq)) return;
+
+    if (g_irq_handlers[irq]) g_irq_handlers[irq](frame);
+
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
@@ -0,0 +1,34 @@
+#ifndef IDT_H
+#define IDT_H
+
+#include <stdint.h>
+
+/* Les IRQ matérielles sont remappées après les 32 exceptions CPU */
+#define IRQ_BASE_VECTOR 32
+
+/* Pile construite par isr_common (gs en bas, eflags en haut) */
+typedef struct {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t vector, err_code;
+    uint32_t eip, cs, eflags;
+} interrupt_frame_t;
+
+typedef void (*irq_handler_t)(interrupt_frame_t *frame);
+
+// Installe l'IDT, remappe le PIC (toutes les IRQ masquées)
+void idt_init(void);
+
+// Handler appelé pour l'IRQ donnée (0..15), EOI envoyé par le dispatcher
+void irq_register(uint8_t irq, irq_handler_t handler);
+void irq_unmask(uint8_t irq);
+void irq_mask(uint8_t irq);
+
+static inline void interrupts_enable(void)  { asm volatile ("sti"); }
+static inline void interrupts_disable(void) { asm volatile ("cli"); }
+
+/* Attend la prochaine interruption. sti;hlt est atomique (shadow de sti) :
+ * à appeler avec IF=0 après avoir testé la condition d'attente. */
+static inline void cpu_wait_for_interrupt(void) { asm volatile ("sti; hlt"); }
+
+#endif
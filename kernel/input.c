@@ -30,6 +30,7 @@ extern int shift_pressed;
 int keyboard_read_scancode() {
     unsigned char status;
     do {
+        fs_writeback_tick(); /* l'attente clavier sert de créneau au write-back */
         __asm__ __volatile__("inb %1, %0" : "=a"(status) : "Nd"(0x64));
     } while (!(status & 1));
 
@@ -24,4 +24,23 @@ static inline void outw(uint16_t port, uint16_t val) {
     asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
 }
 
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+/* Transferts "string" : count mots 16 bits entre le port et la mémoire */
+static inline void insw(uint16_t port, void *addr, uint32_t count) {
+    asm volatile ("cld; rep insw" : "+D"(addr), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void *addr, uint32_t count) {
+    asm volatile ("cld; rep outsw" : "+S"(addr), "+c"(count) : "d"(port) : "memory");
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "lz4.h"
+#include "utils.h"
+
+#define MINMATCH     4
+#define MFLIMIT      12   /* aucune correspondance ne commence dans les 12 derniers octets */
+#define LASTLITERALS 5    /* ... ni ne couvre les 5 derniers */
+#define HASH_BITS    12
+
+/* Dernière position vue pour chaque hash de 4 octets (0 = début, vérifié
+ * de toute façon par comparaison) */
+static uint16_t g_htab[1 << HASH_BITS];
+
+static uint32_t read32(const uint8_t* p) {
+    return *(const uint32_t*)p;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Suite d'une longueur >= 15 : octets 255 puis le reste */
+static uint8_t* put_len(uint8_t* op, uint32_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static int get_len(const uint8_t** ip, const uint8_t* iend, uint32_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+uint32_t lz4_compress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t cap) {
+    if (n > LZ4_MAX_INPUT) return 0;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + n;
+    uint8_t* op = dst;
+    uint32_t room = cap;
+
+    if (n > MFLIMIT) {
+        const uint8_t* mflimit = iend - MFLIMIT;
+        const uint8_t* mlimit = iend - LASTLITERALS;
+        memset(g_htab, 0, sizeof(g_htab));
+        ip++;
+        while (ip < mflimit) {
+            uint32_t v = read32(ip);
+            uint32_t h = hash4(v);
+            const uint8_t* ref = src + g_htab[h];
+            g_htab[h] = (uint16_t)(ip - src);
+            if (read32(ref) != v) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t* m = ip + MINMATCH;
+            const uint8_t* r = ref + MINMATCH;
+            while (m < mlimit && *m == *r) {
+                m++;
+                r++;
+            }
+            uint32_t lit = (uint32_t)(ip - anchor);
+            uint32_t mlen = (uint32_t)(m - ip) - MINMATCH;
+            uint32_t worst = 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1;
+            if (worst > room) return 0;
+
+            uint8_t* token = op++;
+            *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+            if (lit >= 15) op = put_len(op, lit - 15);
+            memcpy(op, anchor, lit);
+            op += lit;
+            uint32_t off = (uint32_t)(ip - ref);
+            *op++ = (uint8_t)(off & 0xFF);
+            *op++ = (uint8_t)(off >> 8);
+            *token |= (uint8_t)(mlen >= 15 ? 15 : mlen);
+            if (mlen >= 15) op = put_len(op, mlen - 15);
+            room = cap - (uint32_t)(op - dst);
+
+            ip = m;
+            anchor = ip;
+        }
+    }
+
+    /* Dernière séquence : littéraux seuls */
+    uint32_t lit = (uint32_t)(iend - anchor);
+    if (1 + lit / 255 + 1 + lit > room) return 0;
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) op = put_len(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+    return (uint32_t)(op - dst);
+}
+
+int lz4_decompress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t out) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + n;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + out;
+    if (out == 0) return 0;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+        uint32_t lit = token >> 4;
+        if (lit == 15 && get_len(&ip, iend, &lit) != 0) return -1;
+        if (lit > (uint32_t)(iend - ip) || lit > (uint32_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (op == oend) return 0;
+
+        if (iend - ip < 2) return -1;
+        uint32_t off = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        if (off == 0 || off > (uint32_t)(op - dst)) return -1;
+        uint32_t mlen = token & 15;
+        if (mlen == 15 && get_len(&ip, iend, &mlen) != 0) return -1;
+        mlen += MINMATCH;
+        if (mlen > (uint32_t)(oend - op)) return -1;
+
+        const uint8_t* r = op - off;
+        if (off >= mlen) {
+            memcpy(op, r, mlen);
+            op += mlen;
+        } else {
+            /* Recouvrement (répétition courte) : octet par octet */
+            while (mlen--) *op++ = *r++;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+
+/*
+ * lz4 — format de bloc LZ4 (séquences jeton / littéraux / offset / longueur),
+ * sans en-tête de trame. Compresseur glouton à table de hachage unique,
+ * statique : pas de malloc, un seul appel à la fois.
+ */
+
+#define LZ4_MAX_INPUT 65535   /* positions sur 16 bits dans la table */
+
+// Compresse n octets de src dans dst (cap octets au plus). Retourne la
+// taille compressée, ou 0 si elle dépasserait cap (données incompressibles)
+uint32_t lz4_compress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t cap);
+
+// Décompresse jusqu'à produire exactement `out` octets, sans lire au-delà de
+// src + n. Retourne 0, ou -1 si le flux est corrompu ou trop court
+int lz4_decompress(const uint8_t* src, uint32_t n, uint8_t* dst, uint32_t out);
+
+#endif
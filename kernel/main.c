@@ -6,6 +6,9 @@
 #include "io.h"
 #include "ata.h"
 #include "ui.h"
+#include "idt.h"
+#include "timer.h"
+#include "mem_boot.h"
 
 struct reapfs_global {
     struct reapfs_super super;
@@ -65,7 +68,7 @@ static int fs_write_file_impl(const char* name, const uint8_t* data, uint32_t si
     if (!name) return -1;
     char path[512]; build_path(name, path, sizeof(path));
     fs_create(path); /* create if not exists */
-    reapfs_fd_t fd = fs_open(path, 1);
+    reapfs_fd_t fd = fs_open(path, FS_O_WRITE | FS_O_TRUNC);
     if (fd < 0) return -1;
     int w = fs_write(fd, data, size);
     fs_close(fd);
@@ -292,17 +295,25 @@ void kmain(void) {
     print_string("ETAPE 1: Debut kmain()\n");
     
     print_string("ETAPE 2: Initialisation ecran\n");
+
+    print_string("ETAPE 3: Initialisation interruptions\n");
+    idt_init();
+    timer_init(1000);
+    interrupts_enable();
+
+    print_string("ETAPE 4: Initialisation memoire\n");
+    mem_boot_init(MEM_HIGH_BASE, mem_boot_detect());
     
-    print_string("ETAPE 2: Initialisation ata\n");
+    print_string("ETAPE 5: Initialisation ata\n");
     ata_init();
 
-    print_string("ETAPE 4: Initialisation fichiersystem\n");
+    print_string("ETAPE 6: Initialisation fichiersystem\n");
     fs_init();
     
-    print_string("ETAPE 5: Lancement shell\n");
+    print_string("ETAPE 7: Lancement shell\n");
     tetra_shell();  // ← Si crash ici, c'est le shell
     
-    print_string("ETAPE 6: Retour shell (anormal)\n");
+    print_string("ETAPE 8: Retour shell (anormal)\n");
     while(1) { asm volatile ("nop"); }
 }
 
@@ -382,16 +393,30 @@ void tetra_shell(void)
             print_string("  cat <file>      - Display file contents\n");
             print_string("  clear           - Clear the screen\n");
             print_string("  sl              - Fun command (train animation)\n");
+            print_string("  sync            - Write cached data to disk\n");
+            print_string("  fsck            - Check the filesystem (read-only)\n");
+            print_string("  formate         - Erase the disk and create an empty filesystem\n");
+            print_string("  compress on|off - LZ4 compression for new files\n");
             print_string("  exit            - Exit the shell\n");
 
         }
         else if (strcmp(s, "formate") == 0){
-            fs_init();
+            fs_format();
         }
 
         else if (strcmp(s, "exit") == 0) {
+            fs_sync();
             outw(0x604, 0x2000);
         }
+        else if (strcmp(s, "sync") == 0) {
+            if (fs_sync() != 0) print_string("sync: erreur disque\n");
+        }
+        else if (strcmp(s, "compress on") == 0) {
+            fs_set_compression(1);
+        }
+        else if (strcmp(s, "compress off") == 0) {
+            fs_set_compression(0);
+        }
         else if (strcmp(s, "clear") == 0) {
             clear_screen();
         }
@@ -401,6 +426,9 @@ void tetra_shell(void)
         else if (strcmp(s, "fs") == 0) {
             fs_debug_print();
         }
+        else if (strcmp(s, "fsck") == 0) {
+            fs_check();
+        }
         else if (strcmp(s, "pwd") == 0) {
             print_string("Vous etes ici : ");
             printf(g_cwd_path);
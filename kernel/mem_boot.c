@@ -1,5 +1,17 @@
 #include "mem_boot.h"
+#include "io.h"
 #include "src/mem/pfa.h"
 void mem_boot_init(uintptr_t phys_base, size_t phys_size) {
     pfa_init(phys_base, phys_size);
 }
+static uint8_t cmos_read(uint8_t reg) {
+    outb(0x70, reg);
+    return inb(0x71);
+}
+size_t mem_boot_detect(void) {
+    // CMOS : Kio entre 1 et 16 Mio (0x30/0x31), blocs de 64 Kio au-delà (0x34/0x35)
+    size_t kb = cmos_read(0x30) | ((size_t)cmos_read(0x31) << 8);
+    size_t blocks = cmos_read(0x34) | ((size_t)cmos_read(0x35) << 8);
+    if (blocks > 0) return (15 * 1024 * 1024) + blocks * 64 * 1024;
+    return kb * 1024;
+}
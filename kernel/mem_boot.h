@@ -1,4 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#define MEM_HIGH_BASE 0x100000   /* au-dessus de la VGA et du BIOS */
 void mem_boot_init(uintptr_t phys_base, size_t phys_size);
+// Mémoire au-dessus de 1 Mio, en octets, lue dans la CMOS
+size_t mem_boot_detect(void);
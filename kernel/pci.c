@@ -0,0 +1,105 @@
+#include "pci.h"
+#include "io.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+#define PCI_REG_VENDOR     0x00
+#define PCI_REG_COMMAND    0x04
+#define PCI_REG_CLASS      0x08
+#define PCI_REG_HEADER     0x0C
+#define PCI_REG_BAR0       0x10
+#define PCI_REG_IRQ        0x3C
+
+#define PCI_CMD_IO         0x0001
+#define PCI_CMD_MEMORY     0x0002
+#define PCI_CMD_BUS_MASTER 0x0004
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000u
+         | ((uint32_t)bus << 16)
+         | ((uint32_t)(slot & 0x1F) << 11)
+         | ((uint32_t)(func & 0x07) << 8)
+         | (offset & 0xFC);
+}
+
+uint32_t pci_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t v = pci_read32(bus, slot, func, offset);
+    return (uint16_t)(v >> ((offset & 2) * 8));
+}
+
+void pci_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+static void pci_fill(pci_device_t *dev, uint8_t bus, uint8_t slot, uint8_t func) {
+    uint32_t id  = pci_read32(bus, slot, func, PCI_REG_VENDOR);
+    uint32_t cls = pci_read32(bus, slot, func, PCI_REG_CLASS);
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor = (uint16_t)(id & 0xFFFF);
+    dev->device = (uint16_t)(id >> 16);
+    dev->class_code = (uint8_t)(cls >> 24);
+    dev->subclass = (uint8_t)(cls >> 16);
+    dev->prog_if = (uint8_t)(cls >> 8);
+    dev->irq_line = (uint8_t)(pci_read32(bus, slot, func, PCI_REG_IRQ) & 0xFF);
+}
+
+/* Parcourt toutes les fonctions présentes ; s'arrête au premier `match` vrai */
+static int pci_scan(int (*match)(uint8_t bus, uint8_t slot, uint8_t func, uint32_t a, uint32_t b),
+                    uint32_t a, uint32_t b, pci_device_t *out) {
+    for (uint32_t bus = 0; bus < 256; ++bus) {
+        for (uint8_t slot = 0; slot < 32; ++slot) {
+            if (pci_read16((uint8_t)bus, slot, 0, PCI_REG_VENDOR) == 0xFFFF) continue;
+            /* bit 7 du header type : périphérique multi-fonction */
+            uint8_t header = (uint8_t)(pci_read32((uint8_t)bus, slot, 0, PCI_REG_HEADER) >> 16);
+            uint8_t funcs = (header & 0x80) ? 8 : 1;
+            for (uint8_t func = 0; func < funcs; ++func) {
+                if (pci_read16((uint8_t)bus, slot, func, PCI_REG_VENDOR) == 0xFFFF) continue;
+                if (match((uint8_t)bus, slot, func, a, b)) {
+                    if (out) pci_fill(out, (uint8_t)bus, slot, func);
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static int match_class(uint8_t bus, uint8_t slot, uint8_t func, uint32_t class_code, uint32_t subclass) {
+    uint32_t cls = pci_read32(bus, slot, func, PCI_REG_CLASS);
+    return (cls >> 24) == class_code && ((cls >> 16) & 0xFF) == subclass;
+}
+
+static int match_id(uint8_t bus, uint8_t slot, uint8_t func, uint32_t vendor, uint32_t device) {
+    uint32_t id = pci_read32(bus, slot, func, PCI_REG_VENDOR);
+    return (id & 0xFFFF) == vendor && (id >> 16) == device;
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_device_t *out) {
+    return pci_scan(match_class, class_code, subclass, out);
+}
+
+int pci_find_device(uint16_t vendor, uint16_t device, pci_device_t *out) {
+    return pci_scan(match_id, vendor, device, out);
+}
+
+uint32_t pci_bar(const pci_device_t *dev, int bar) {
+    if (!dev || bar < 0 || bar > 5) return 0;
+    return pci_read32(dev->bus, dev->slot, dev->func, (uint8_t)(PCI_REG_BAR0 + bar * 4));
+}
+
+void pci_enable_bus_master(const pci_device_t *dev) {
+    if (!dev) return;
+    uint32_t cmd = pci_read32(dev->bus, dev->slot, dev->func, PCI_REG_COMMAND);
+    cmd |= PCI_CMD_IO | PCI_CMD_MEMORY | PCI_CMD_BUS_MASTER;
+    /* les 16 bits hauts (status) sont RW1C : ne pas les réécrire */
+    pci_write32(dev->bus, dev->slot, dev->func, PCI_REG_COMMAND, cmd & 0xFFFF);
+}
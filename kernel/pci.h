@@ -0,0 +1,38 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_CLASS_STORAGE        0x01
+#define PCI_SUBCLASS_IDE         0x01
+
+typedef struct {
+    uint8_t  bus;
+    uint8_t  slot;
+    uint8_t  func;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+    uint8_t  irq_line;   /* ligne PIC assignée par le BIOS (0xFF = aucune) */
+} pci_device_t;
+
+// Accès à l'espace de configuration (mécanisme #1, ports 0xCF8/0xCFC)
+uint32_t pci_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint16_t pci_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void pci_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value);
+
+// Recherche le premier périphérique de la classe donnée (0 = trouvé, -1 sinon)
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_device_t *out);
+
+// Recherche par identifiant vendeur/périphérique (0 = trouvé, -1 sinon)
+int pci_find_device(uint16_t vendor, uint16_t device, pci_device_t *out);
+
+// Valeur brute d'un BAR (0..5), bits de type inclus
+uint32_t pci_bar(const pci_device_t *dev, int bar);
+
+// Active le décodage I/O + mémoire et le bus mastering (DMA)
+void pci_enable_bus_master(const pci_device_t *dev);
+
+#endif
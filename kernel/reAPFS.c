@@ -15,9 +15,17 @@
 #include "screen.h"
 #include "input.h"
 #include "reapfs.h"
+#include "reapfs_format.h"
+#include "reapfs_check.h"
 #include "utils.h"
 #include "io.h"
 #include "ata.h"
+#include "blkq.h"
+#include "bcache.h"
+#include "crc32c.h"
+#include "lz4.h"
+#include "timer.h"
+#include "src/mem/pfa.h"
 
 /* Externs fournis par ton kernel : ne pas redéfinir */
 extern void print_string(const char *s);
@@ -26,48 +34,82 @@ extern void *memset(void *ptr, int value, size_t num);
 extern int snprintf(char *str, size_t size, const char *format, ...);
 
 /* ---------- Configuration FS ---------- */
-#define SECTOR_SIZE 512
-#define MAX_INODES 256
-#define INODE_TABLE_SECTORS 256
-#define SUPERBLOCK_SECTOR 128
-#define INODE_TABLE_START_SECTOR 129
-#define MAX_FILENAME 32
-#define MAX_DIR_ENTRIES 32
+/* Format sur disque (géométrie, structures) : reapfs_format.h */
 #define MAX_PATH 256
+#define DEFAULT_TOTAL_SECTORS 32768  /* image de 16 Mo si le disque ne dit rien */
 
-/* ---------- Structures ---------- */
-typedef struct {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t inode_table_sectors;
-    uint32_t inode_count;
-    uint32_t data_start_sector;
-    uint8_t reserved[SECTOR_SIZE - 20];
-} reapfs_super_t;
+/* Sommes de contrôle : les 4 derniers octets du superbloc, d'un inode, d'un
+ * seau de répertoire ou d'un bloc d'extents portent le CRC32C de tout ce qui
+ * précède. Posées à l'écriture, vérifiées à chaque lecture. */
+static uint32_t g_crc_errors = 0;
 
-typedef struct {
-    uint32_t ino;
-    uint32_t size; /* bytes: for file = file size, for dir = size of dirent table */
-    uint32_t blocks[12];
-    uint8_t used;
-    uint8_t is_dir;
-    char name[MAX_FILENAME];
-} reapfs_inode_t;
+static void crc_seal(void *p, uint32_t size) {
+    uint32_t c = crc32c(0, p, size - 4);
+    memcpy((uint8_t*)p + size - 4, &c, 4);
+}
 
-typedef struct {
-    char name[MAX_FILENAME];
-    uint32_t ino;
-} reapfs_dirent_t;
+static int crc_check(const void *p, uint32_t size) {
+    uint32_t c;
+    memcpy(&c, (const uint8_t*)p + size - 4, 4);
+    if (c == crc32c(0, p, size - 4)) return 0;
+    g_crc_errors++;
+    return -1;
+}
 
 /* ---------- In-memory state ---------- */
 static reapfs_super_t g_super;
-static reapfs_inode_t g_inodes[MAX_INODES];
-static uint8_t g_inode_used[MAX_INODES];
 
 /* cwd interne au module : utilisé pour résoudre chemins relatifs */
 static int g_cwd_ino = 0;
 static char g_cwd_path[MAX_PATH] = "/";
 
+/* Lecture anticipée par inode : la fenêtre double à chaque lecture qui
+ * reprend là où la précédente s'est arrêtée, et retombe à 0 sinon. Table
+ * hachée par numéro d'inode : un autre fichier au même rang repart de zéro. */
+#define RA_MIN_SECTORS 4
+#define RA_MAX_SECTORS 64
+#define RA_SLOTS 32   /* puissance de 2 */
+
+typedef struct {
+    uint32_t ino;
+    uint32_t next_off;   /* offset attendu si l'accès est séquentiel */
+    uint32_t window;     /* secteurs à précharger après la lecture */
+} ra_state_t;
+
+static ra_state_t g_ra[RA_SLOTS];
+
+static ra_state_t *ra_of(uint32_t ino) {
+    ra_state_t *ra = &g_ra[ino & (RA_SLOTS - 1)];
+    if (ra->ino != ino) {
+        ra->ino = ino;
+        ra->next_off = 0;
+        ra->window = 0;
+    }
+    return ra;
+}
+
+/* Table des fichiers ouverts : un descripteur = un curseur sur un inode */
+#ifndef FS_MAX_OPEN
+#define FS_MAX_OPEN 32
+#endif
+
+typedef struct {
+    uint8_t used;
+    uint8_t flags;      /* FS_O_* */
+    uint32_t ino;
+    uint32_t pos;       /* curseur de fs_read/fs_write */
+} open_file_t;
+
+static open_file_t g_files[FS_MAX_OPEN];
+
+/* Fichiers compressés : tampons d'un bloc (voir la section LZ4) */
+static uint8_t g_zplain[ZCHUNK_SIZE];   /* bloc décompressé */
+static uint8_t g_zdisk[ZCHUNK_SIZE];    /* bloc tel que sur disque */
+/* g_zplain est le bloc g_zc_idx de l'inode g_zc_ino (-1 : aucun) */
+static int g_zc_ino = -1;
+static uint32_t g_zc_idx = 0;
+static int g_compress = 0;              /* nouveaux fichiers compressés */
+
 /* ---------- Helpers disque (sans malloc) ---------- */
 
 static int disk_read_bytes(void *buf, uint64_t offset, size_t len) {
@@ -78,7 +120,7 @@ static int disk_read_bytes(void *buf, uint64_t offset, size_t len) {
     uint8_t *out = (uint8_t*)buf;
 
     if ((offset % SECTOR_SIZE) == 0 && (len % SECTOR_SIZE) == 0) {
-        if (ata_read((uint32_t)start, out, count) != 0) {
+        if (bcache_read((uint32_t)start, out, count) != 0) {
             print_string("ATA read failed (bulk)\n");
             return -1;
         }
@@ -90,7 +132,7 @@ static int disk_read_bytes(void *buf, uint64_t offset, size_t len) {
     size_t remaining = len;
 
     for (uint32_t s = 0; s < count; ++s) {
-        if (ata_read((uint32_t)(start + s), tmp, 1) != 0) {
+        if (bcache_read((uint32_t)(start + s), tmp, 1) != 0) {
             print_string("ATA read failed (partial)\n");
             return -1;
         }
@@ -107,219 +149,1428 @@ static int disk_read_bytes(void *buf, uint64_t offset, size_t len) {
     return 0;
 }
 
-static int disk_write_bytes(const void *buf, uint64_t offset, size_t len) {
-    if (len == 0) return 0;
-    uint64_t start = offset / SECTOR_SIZE;
-    uint64_t end = (offset + (uint64_t)len + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    uint32_t count = (uint32_t)(end - start);
-    const uint8_t *in = (const uint8_t*)buf;
+/* ---------- Super / inode persistence ---------- */
 
-    if ((offset % SECTOR_SIZE) == 0 && (len % SECTOR_SIZE) == 0) {
-        if (ata_write((uint32_t)start, in, count) != 0) {
-            print_string("ATA write failed (bulk)\n");
-            return -1;
+/* Capacité du disque (IDENTIFY), bornée à FS_MAX_SECTORS */
+static uint32_t fs_device_sectors(void) {
+    uint64_t n = ata_sector_count();
+    if (n == 0) return DEFAULT_TOTAL_SECTORS;
+    if (n > FS_MAX_SECTORS) return FS_MAX_SECTORS;
+    return (uint32_t)n;
+}
+
+static int reapfs_disk_read_wrapper(void *buf, uint64_t offset, size_t len) {
+    return disk_read_bytes(buf, offset, len) == 0 ? 0 : -1;
+}
+
+/* Write-back : délai max avant que des écritures en cache rejoignent le disque */
+#define FS_WRITEBACK_DELAY_MS 5000
+
+/* Métadonnées à réécrire : superbloc et secteurs des bitmaps (ceux de la
+ * table d'inodes sont suivis par le cache d'inodes) */
+static int g_meta_dirty = 0;
+static int g_super_dirty = 0;
+static uint8_t g_bm_dirty[BM_MAX_SECTORS];
+static uint8_t g_ibm_dirty[IBM_MAX_SECTORS];
+/* Secteurs que save_super épinglera au prochain commit (majorant) */
+static uint32_t g_meta_pending = 0;
+
+/* Copie en mémoire des bitmaps disque, et indices next-fit */
+static uint32_t g_bitmap[FS_MAX_SECTORS / 32];
+static uint32_t g_bm_hint = 0;
+static uint32_t g_ibitmap[FS_MAX_INODES / 32];
+static uint32_t g_ino_hint = 1;   /* 0 est la racine */
+static uint32_t g_free_inodes = 0;   /* recompté au montage, absent du superbloc */
+static uint32_t g_last_sync_ms = 0;
+
+static void mark_super_dirty(void) {
+    if (!g_super_dirty) g_meta_pending++;
+    g_super_dirty = 1;
+    g_meta_dirty = 1;
+}
+
+static int jnl_replay(void);
+
+/* Lit le superbloc dans g_super. -1 : pas de magic, le disque n'a jamais
+ * porté reAPFS ; -2 : volume reAPFS illisible ou abîmé. La somme est
+ * vérifiée avant tout autre champ : un bit retourné ne doit pas faire
+ * passer le volume pour vierge. */
+static int read_super(void) {
+    uint8_t buf[SECTOR_SIZE];
+    if (reapfs_disk_read_wrapper(buf, (uint64_t)SUPERBLOCK_SECTOR * SECTOR_SIZE, SECTOR_SIZE) != 0) {
+        print_string("FS: super read failed\n");
+        return -2;
+    }
+    memcpy(&g_super, buf, sizeof(reapfs_super_t));
+    if (g_super.magic != FS_SUPER_MAGIC) {
+        /* Volume d'avant la zone de boot agrandie : à ne pas prendre pour
+         * un disque vierge */
+        if (reapfs_disk_read_wrapper(buf, (uint64_t)LEGACY_SUPERBLOCK_SECTOR * SECTOR_SIZE, SECTOR_SIZE) == 0
+            && ((reapfs_super_t*)buf)->magic == FS_SUPER_MAGIC) {
+            print_string("FS: old layout (superblock at 128)\n");
+            return -2;
         }
-        return 0;
+        print_string("FS: invalid magic\n");
+        return -1;
+    }
+    if (crc_check(&g_super, sizeof(g_super)) != 0) {
+        print_string("FS: superblock checksum mismatch\n");
+        return -2;
     }
+    if (g_super.version != FS_FORMAT_VERSION) {
+        /* v1 : données à data_start + ino*100, sans bitmap ; non relu */
+        print_string("FS: unsupported version\n");
+        return -2;
+    }
+    return 0;
+}
 
-    uint8_t tmp[SECTOR_SIZE];
-    uint64_t cur_off = offset;
-    size_t remaining = len;
+/* 0 : monté ; -1 : pas de volume reAPFS ; -2 : volume corrompu ou
+ * illisible, à ne surtout pas reformater */
+static int load_super(void) {
+    int r = read_super();
+    if (r != 0) return r;
+    if (g_super.inode_count == 0 || g_super.inode_count > FS_MAX_INODES
+        || g_super.inode_table_sectors * INODES_PER_SECTOR < g_super.inode_count
+        || g_super.ibitmap_start != INODE_TABLE_START_SECTOR + g_super.inode_table_sectors
+        || g_super.ibitmap_sectors > IBM_MAX_SECTORS
+        || g_super.ibitmap_sectors * BM_BITS_PER_SECTOR < g_super.inode_count
+        || g_super.bitmap_start != g_super.ibitmap_start + g_super.ibitmap_sectors) {
+        print_string("FS: bad inode table geometry\n");
+        return -2;
+    }
+    if (g_super.total_sectors > FS_MAX_SECTORS || g_super.bitmap_sectors > BM_MAX_SECTORS
+        || g_super.bitmap_sectors * BM_BITS_PER_SECTOR < g_super.total_sectors) {
+        print_string("FS: bad bitmap geometry\n");
+        return -2;
+    }
+    if (g_super.journal_start != g_super.bitmap_start + g_super.bitmap_sectors
+        || g_super.journal_sectors < 2
+        || g_super.journal_start + g_super.journal_sectors > g_super.data_start_sector) {
+        print_string("FS: bad journal geometry\n");
+        return -2;
+    }
+    /* Le rejeu peut avoir réécrit le superbloc lui-même : on le relit */
+    if (jnl_replay() != 0) return -2;
+    if (read_super() != 0) return -2;
+    if (reapfs_disk_read_wrapper(g_bitmap, (uint64_t)g_super.bitmap_start * SECTOR_SIZE,
+                                 g_super.bitmap_sectors * SECTOR_SIZE) != 0) {
+        print_string("FS: bitmap read failed\n");
+        return -2;
+    }
+    g_bm_hint = g_super.data_start_sector;
+    if (reapfs_disk_read_wrapper(g_ibitmap, (uint64_t)g_super.ibitmap_start * SECTOR_SIZE,
+                                 g_super.ibitmap_sectors * SECTOR_SIZE) != 0) {
+        print_string("FS: inode bitmap read failed\n");
+        return -2;
+    }
+    g_ino_hint = 1;
+    g_free_inodes = 0;
+    for (uint32_t i = 0; i < g_super.inode_count; ++i)
+        if (!((g_ibitmap[i >> 5] >> (i & 31)) & 1)) g_free_inodes++;
+    /* La table d'inodes n'est pas lue ici : le cache d'inodes la charge
+     * secteur par secteur à la demande */
+    return 0;
+}
 
-    for (uint32_t s = 0; s < count; ++s) {
-        if (ata_read((uint32_t)(start + s), tmp, 1) != 0) {
-            print_string("ATA read before write failed\n");
+/* ---------- Journal des métadonnées ----------
+ *
+ * Toute écriture de métadonnée (superbloc, table d'inodes, bitmap,
+ * répertoires, blocs d'extents) reste épinglée dans bcache jusqu'au commit.
+ * Le commit recopie les secteurs épinglés à la suite dans le journal :
+ * descripteur(s) (liste des LBA), secteurs, bloc de commit avec la somme de
+ * contrôle du tout, et un seul FLUSH CACHE. Les secteurs sont alors relâchés
+ * et rejoignent leur place par le write-back ordinaire (checkpoint
+ * paresseux). Quand la zone est pleine, checkpoint : sync du cache, FLUSH,
+ * puis le journal repart du début avec la séquence suivante.
+ *
+ * Au montage, les transactions complètes à partir de l'en-tête sont rejouées.
+ * Les données des fichiers ne sont pas journalisées.
+ */
+#define JNL_GROUP_MAX 64              /* secteurs épinglés avant commit forcé */
+#define JNL_DEFER_MAX 256
+
+static uint32_t g_jhead = 0;       /* prochaine position libre dans la zone */
+static uint32_t g_jseq = 1;
+static int g_jnl_busy = 0;
+static uint32_t g_jlbas[BCACHE_MAX_BLOCKS];
+static uint32_t g_jpos[BCACHE_MAX_BLOCKS];
+/* Secteurs de métadonnées libérés : pas réutilisables avant le checkpoint,
+ * sinon un rejeu écraserait leur nouveau contenu */
+static uint32_t g_jdefer[JNL_DEFER_MAX][2];
+static uint32_t g_jdefer_n = 0;
+static uint32_t g_jcommits = 0;
+
+static int jnl_commit(int flush);
+static int save_super(void);
+static void bm_set_range(uint32_t lba, uint32_t n, int used);
+
+static uint32_t jnl_log_lba(uint32_t pos) {
+    return g_super.journal_start + 1 + pos;
+}
+
+static uint32_t jnl_log_size(void) {
+    return g_super.journal_sectors - 1;
+}
+
+/* En-tête écrit directement (jamais en cache), suivi d'un FLUSH */
+static int jnl_write_header(uint32_t seq) {
+    jnl_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = JNL_HDR_MAGIC;
+    h.seq = seq;
+    h.tail = 0;
+    if (blkq_submit(g_super.journal_start, (uint8_t*)&h, 1, 1) != 0 || blkq_dispatch() != 0
+        || ata_flush() != 0) {
+        print_string("FS: journal header write failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Métadonnée modifiée : reste en cache jusqu'au commit de fin d'opération
+ * (op_end, sync_all). Jamais de commit ici : l'opération n'est pas finie */
+static int meta_write(uint32_t lba, const void *buf, uint32_t count) {
+    return bcache_write_pinned(lba, (const uint8_t*)buf, count);
+}
+
+/* Assez pour un commit : JNL_GROUP_MAX épinglés, ou, avec ce que
+ * save_super y ajoutera, la moitié du budget réel du cache (16 secteurs
+ * sans pfa, 1 si on l'a réduit) */
+static int jnl_pressure(void) {
+    const bcache_stats_t *st = bcache_get_stats();
+    return st->pinned >= JNL_GROUP_MAX || (st->pinned + g_meta_pending) * 2 >= st->budget;
+}
+
+/* Opération trop longue pour une transaction (dir_grow) : commit à un point
+ * où le disque est cohérent, si les secteurs épinglés s'accumulent */
+static int jnl_relieve(void) {
+    return jnl_pressure() ? jnl_commit(0) : 0;
+}
+
+/* Demandé par bcache quand son pool n'est plus qu'épinglés */
+static int jnl_pin_flush(void) {
+    return jnl_commit(0);
+}
+
+static int jnl_checkpoint(void);
+static int jnl_read(uint32_t pos, void *buf);
+
+/* Libération d'une plage qui a pu être journalisée depuis le dernier
+ * checkpoint : son contenu en cache ne sert plus, ses bits attendent */
+static void meta_free(uint32_t lba, uint32_t n) {
+    bcache_discard(lba, n);
+    if (g_jdefer_n == JNL_DEFER_MAX) jnl_checkpoint();
+    if (g_jdefer_n < JNL_DEFER_MAX) {
+        g_jdefer[g_jdefer_n][0] = lba;
+        g_jdefer[g_jdefer_n][1] = n;
+        g_jdefer_n++;
+    }
+}
+
+/* Un secteur commité puis modifié à nouveau est épinglé : bcache_sync le
+ * saute, et sa version commitée n'existe plus qu'au journal. Sa dernière
+ * copie journalisée rejoint sa place avant que le journal soit effacé */
+static int jnl_rehome_pinned(void) {
+    /* Appelé depuis jnl_write_tx, g_jlbas reçoit les mêmes épinglés dans le
+     * même ordre ; les secteurs débordés qui les suivent restent intacts */
+    uint32_t n = (uint32_t)bcache_pinned(g_jlbas, BCACHE_MAX_BLOCKS);
+    if (n == 0 || g_jhead == 0) return 0;
+    for (uint32_t i = 0; i < n; ++i) g_jpos[i] = 0;   /* 0 : toujours un descripteur */
+
+    uint32_t pos = 0;
+    while (pos < g_jhead) {
+        jnl_desc_t desc;
+        if (jnl_read(pos++, &desc) != 0) return -1;
+        if (desc.magic != JNL_DESC_MAGIC || desc.count > JNL_DESC_LBAS) {
+            print_string("FS: journal corrupted before checkpoint\n");
             return -1;
         }
-        uint64_t sector_base = (uint64_t)(start + s) * SECTOR_SIZE;
-        uint64_t copy_start = (cur_off > sector_base) ? (cur_off - sector_base) : 0;
-        size_t copy_len = SECTOR_SIZE - copy_start;
-        if (copy_len > remaining) copy_len = remaining;
-        memcpy(tmp + copy_start, in, copy_len);
-        if (ata_write((uint32_t)(start + s), tmp, 1) != 0) {
-            print_string("ATA write failed (partial)\n");
-            return -1;
+        for (uint32_t k = 0; k < desc.count; ++k, ++pos)
+            for (uint32_t i = 0; i < n; ++i)
+                if (g_jlbas[i] == desc.lba[k]) { g_jpos[i] = pos; break; }
+        if (desc.last) pos++;   /* bloc de commit */
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        uint8_t sec[SECTOR_SIZE];
+        if (g_jpos[i] == 0) continue;
+        if (jnl_read(g_jpos[i], sec) != 0 || blkq_submit(g_jlbas[i], sec, 1, 1) != 0) return -1;
+    }
+    return blkq_dispatch();
+}
+
+/* Tout ce qui est commité rejoint sa place, puis le journal repart à zéro */
+static int jnl_checkpoint(void) {
+    if (bcache_sync() != 0 || jnl_rehome_pinned() != 0 || ata_flush() != 0) return -1;
+    if (jnl_write_header(g_jseq) != 0) return -1;
+    g_jhead = 0;
+    /* Les rejeux ne peuvent plus viser ces secteurs : ils redeviennent libres */
+    for (uint32_t i = 0; i < g_jdefer_n; ++i)
+        bm_set_range(g_jdefer[i][0], g_jdefer[i][1], 0);
+    g_jdefer_n = 0;
+    return 0;
+}
+
+/* Écrit une transaction de n secteurs épinglés (g_jlbas) à g_jhead */
+static int jnl_write_tx(uint32_t n) {
+    uint32_t ndesc = (n + JNL_DESC_LBAS - 1) / JNL_DESC_LBAS;
+    uint32_t need = ndesc + n + 1;
+    if (need > jnl_log_size()) {
+        print_string("FS: transaction too large\n");
+        return -1;
+    }
+    if (g_jhead + need > jnl_log_size() && jnl_checkpoint() != 0) return -1;
+
+    uint32_t pos = g_jhead;
+    uint32_t sum = 0;
+    uint32_t done = 0;
+    for (uint32_t d = 0; d < ndesc; ++d) {
+        jnl_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.magic = JNL_DESC_MAGIC;
+        desc.seq = g_jseq;
+        desc.count = n - done < JNL_DESC_LBAS ? n - done : JNL_DESC_LBAS;
+        desc.last = d + 1 == ndesc;
+        memcpy(desc.lba, &g_jlbas[done], desc.count * sizeof(uint32_t));
+        sum = crc32c(sum, &desc, SECTOR_SIZE);
+        if (blkq_submit(jnl_log_lba(pos++), (uint8_t*)&desc, 1, 1) != 0) return -1;
+        for (uint32_t k = 0; k < desc.count; ++k) {
+            uint8_t sec[SECTOR_SIZE];
+            if (bcache_read(desc.lba[k], sec, 1) != 0) return -1;
+            sum = crc32c(sum, sec, SECTOR_SIZE);
+            if (blkq_submit(jnl_log_lba(pos++), sec, 1, 1) != 0) return -1;
         }
-        in += copy_len;
-        cur_off += copy_len;
-        remaining -= copy_len;
-        if (remaining == 0) break;
+        done += desc.count;
     }
+
+    jnl_commit_t c;
+    memset(&c, 0, sizeof(c));
+    c.magic = JNL_COMMIT_MAGIC;
+    c.seq = g_jseq;
+    c.sum = sum;
+    c.blocks = need;
+    if (blkq_submit(jnl_log_lba(pos++), (uint8_t*)&c, 1, 1) != 0 || blkq_dispatch() != 0
+        || ata_flush() != 0)
+        return -1;
+
+    bcache_unpin_all();
+    g_jhead = pos;
+    g_jseq++;
+    g_jcommits++;
     return 0;
 }
 
-/* ---------- Super / inode persistence ---------- */
+/* Commit de groupe : toutes les métadonnées modifiées depuis le dernier
+ * commit partent en une transaction. Avec `flush`, FLUSH CACHE même s'il
+ * n'y avait rien à journaliser (données déjà envoyées). */
+static int jnl_commit(int flush) {
+    if (g_jnl_busy) return 0;
+    g_jnl_busy = 1;
+    int r = 0;
+    if (g_meta_dirty && save_super() != 0) r = -1;
+    uint32_t n = 0;
+    if (r == 0) {
+        n = (uint32_t)bcache_pinned(g_jlbas, BCACHE_MAX_BLOCKS);
+        n += (uint32_t)bcache_spilled(g_jlbas + n, BCACHE_MAX_BLOCKS - (int)n);
+    }
+    if (n > 0) {
+        if (jnl_write_tx(n) != 0) {
+            print_string("FS: journal commit failed\n");
+            r = -1;
+        }
+    } else if (flush && ata_flush() != 0) {
+        r = -1;
+    }
+    g_jnl_busy = 0;
+    return r;
+}
 
-static int reapfs_disk_read_wrapper(void *buf, uint64_t offset, size_t len) {
-    return disk_read_bytes(buf, offset, len) == 0 ? 0 : -1;
+/* Lit le secteur `pos` de la zone (hors cache : le journal n'y passe jamais) */
+static int jnl_read(uint32_t pos, void *buf) {
+    return blkq_read(jnl_log_lba(pos), (uint8_t*)buf, 1);
 }
-static int reapfs_disk_write_wrapper(const void *buf, uint64_t offset, size_t len) {
-    return disk_write_bytes(buf, offset, len) == 0 ? 0 : -1;
+
+/* Vérifie la transaction qui commence à `pos` ; renvoie sa longueur en
+ * secteurs, 0 si elle est absente, incomplète ou d'une autre séquence */
+static uint32_t jnl_check_tx(uint32_t pos) {
+    uint32_t start = pos;
+    uint32_t sum = 0;
+    for (;;) {
+        jnl_desc_t desc;
+        if (pos >= jnl_log_size() || jnl_read(pos, &desc) != 0) return 0;
+        if (desc.magic != JNL_DESC_MAGIC || desc.seq != g_jseq || desc.count > JNL_DESC_LBAS
+            || pos + 1 + desc.count + 1 > jnl_log_size())
+            return 0;
+        sum = crc32c(sum, &desc, SECTOR_SIZE);
+        pos++;
+        for (uint32_t k = 0; k < desc.count; ++k, ++pos) {
+            uint8_t sec[SECTOR_SIZE];
+            if (jnl_read(pos, sec) != 0) return 0;
+            sum = crc32c(sum, sec, SECTOR_SIZE);
+        }
+        if (desc.last) break;
+    }
+    jnl_commit_t c;
+    if (jnl_read(pos, &c) != 0) return 0;
+    if (c.magic != JNL_COMMIT_MAGIC || c.seq != g_jseq || c.sum != sum
+        || c.blocks != pos + 1 - start)
+        return 0;
+    return c.blocks;
 }
 
-static int load_super(void) {
-    uint8_t buf[SECTOR_SIZE];
-    if (reapfs_disk_read_wrapper(buf, (uint64_t)SUPERBLOCK_SECTOR * SECTOR_SIZE, SECTOR_SIZE) != 0) {
-        print_string("FS: super read failed\n");
+/* Rejoue les transactions commitées mais pas encore checkpointées */
+static int jnl_replay(void) {
+    jnl_header_t h;
+    if (blkq_read(g_super.journal_start, (uint8_t*)&h, 1) != 0 || h.magic != JNL_HDR_MAGIC
+        || h.tail >= jnl_log_size()) {
+        print_string("FS: bad journal header\n");
         return -1;
     }
-    memcpy(&g_super, buf, sizeof(reapfs_super_t));
-    if (g_super.magic != 0x52455046) {
-        print_string("FS: invalid magic\n");
-        return -1;
+    g_jseq = h.seq;
+    g_jhead = 0;
+    g_jdefer_n = 0;
+
+    uint32_t pos = h.tail;
+    uint32_t replayed = 0;
+    for (;;) {
+        uint32_t len = jnl_check_tx(pos);
+        if (len == 0) break;
+        uint32_t end = pos + len - 1;   /* bloc de commit */
+        while (pos < end) {
+            jnl_desc_t desc;
+            if (jnl_read(pos++, &desc) != 0) return -1;
+            for (uint32_t k = 0; k < desc.count; ++k) {
+                uint8_t sec[SECTOR_SIZE];
+                if (jnl_read(pos++, sec) != 0 || bcache_write(desc.lba[k], sec, 1) != 0) return -1;
+            }
+        }
+        pos++;
+        g_jseq++;
+        replayed++;
     }
-    if (g_super.inode_count > MAX_INODES) {
-        print_string("FS: inode_count too large\n");
+    if (replayed == 0) return 0;
+
+    if (bcache_sync() != 0 || ata_flush() != 0 || jnl_write_header(g_jseq) != 0) return -1;
+    char tmp[48];
+    snprintf(tmp, sizeof(tmp), "FS: journal replayed (%u tx)\n", replayed);
+    print_string(tmp);
+    return 0;
+}
+
+/* ---------- Cache d'inodes ----------
+ *
+ * Les secteurs de la table d'inodes arrivent à la demande dans
+ * ICACHE_SETS x ICACHE_WAYS emplacements (LRU par ensemble) : le montage ne
+ * lit plus la table et son coût ne dépend plus du nombre d'inodes. Un
+ * emplacement modifié est recopié dans bcache, donc dans la transaction en
+ * cours, au commit ou à son éviction.
+ *
+ * Un pointeur rendu par inode_get reste valable tant que l'opération ne
+ * charge pas ICACHE_WAYS autres secteurs du même ensemble ; aucune
+ * opération n'en tient plus de deux à la fois.
+ */
+#define ICACHE_SETS 16   /* puissance de 2 */
+#define ICACHE_WAYS 4
+
+typedef struct {
+    uint32_t sec;        /* secteur dans la table */
+    uint32_t stamp;      /* LRU dans l'ensemble */
+    uint8_t valid;
+    uint8_t dirty;
+    reapfs_inode_t ino[INODES_PER_SECTOR];
+} icache_slot_t;
+
+static icache_slot_t g_icache[ICACHE_SETS][ICACHE_WAYS];
+static uint32_t g_icache_clock = 0;
+static uint32_t g_icache_hits = 0;
+static uint32_t g_icache_misses = 0;
+
+static int icache_write(icache_slot_t *slot) {
+    for (uint32_t i = 0; i < INODES_PER_SECTOR; ++i)
+        crc_seal(&slot->ino[i], sizeof(reapfs_inode_t));
+    if (meta_write(INODE_TABLE_START_SECTOR + slot->sec, slot->ino, 1) != 0) {
+        print_string("FS: inode table write failed\n");
         return -1;
     }
-    size_t it_size = (size_t)g_super.inode_count * sizeof(reapfs_inode_t);
-    size_t it_sectors = (it_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    if (reapfs_disk_read_wrapper((uint8_t*)g_inodes, (uint64_t)INODE_TABLE_START_SECTOR * SECTOR_SIZE, it_sectors * SECTOR_SIZE) != 0) {
+    if (slot->dirty && g_meta_pending > 0) g_meta_pending--;
+    slot->dirty = 0;
+    return 0;
+}
+
+static icache_slot_t *icache_find(uint32_t sec) {
+    icache_slot_t *set = g_icache[sec & (ICACHE_SETS - 1)];
+    for (int w = 0; w < ICACHE_WAYS; ++w)
+        if (set[w].valid && set[w].sec == sec) return &set[w];
+    return NULL;
+}
+
+/* Secteur `sec` de la table, chargé si besoin à la place du moins récent
+ * de son ensemble. Un inode à la somme fausse y est mis en quarantaine. */
+static icache_slot_t *icache_get(uint32_t sec) {
+    icache_slot_t *slot = icache_find(sec);
+    if (slot) {
+        g_icache_hits++;
+        slot->stamp = ++g_icache_clock;
+        return slot;
+    }
+    g_icache_misses++;
+    icache_slot_t *set = g_icache[sec & (ICACHE_SETS - 1)];
+    slot = &set[0];
+    for (int w = 1; w < ICACHE_WAYS && slot->valid; ++w)
+        if (!set[w].valid || set[w].stamp < slot->stamp) slot = &set[w];
+    if (slot->valid && slot->dirty && icache_write(slot) != 0) return NULL;
+
+    slot->valid = 0;
+    if (bcache_read(INODE_TABLE_START_SECTOR + sec, (uint8_t*)slot->ino, 1) != 0) {
         print_string("FS: inode table read failed\n");
-        return -1;
+        return NULL;
+    }
+    for (uint32_t i = 0; i < INODES_PER_SECTOR; ++i) {
+        reapfs_inode_t *node = &slot->ino[i];
+        if (crc_check(node, sizeof(reapfs_inode_t)) == 0) continue;
+        uint32_t ino = sec * INODES_PER_SECTOR + i;
+        char tmp[48];
+        snprintf(tmp, sizeof(tmp), "FS: inode %u checksum mismatch\n", ino);
+        print_string(tmp);
+        memset(node, 0, sizeof(reapfs_inode_t));
+        node->ino = ino;
+        node->flags = INODE_F_BAD;
+    }
+    slot->sec = sec;
+    slot->valid = 1;
+    slot->dirty = 0;
+    slot->stamp = ++g_icache_clock;
+    return slot;
+}
+
+/* Inode `ino` (NULL : hors table ou erreur disque) */
+static reapfs_inode_t *inode_get(uint32_t ino) {
+    if (ino >= g_super.inode_count) return NULL;
+    icache_slot_t *slot = icache_get(ino / INODES_PER_SECTOR);
+    return slot ? &slot->ino[ino % INODES_PER_SECTOR] : NULL;
+}
+
+/* L'inode vient d'être modifié à travers inode_get : son secteur est en cache */
+static void mark_inode_dirty(uint32_t ino) {
+    icache_slot_t *slot = icache_find(ino / INODES_PER_SECTOR);
+    if (slot && !slot->dirty) {
+        slot->dirty = 1;
+        g_meta_pending++;
     }
-    for (uint32_t i = 0; i < g_super.inode_count && i < MAX_INODES; ++i) {
-        g_inode_used[i] = g_inodes[i].used ? 1 : 0;
+    g_meta_dirty = 1;
+}
+
+static int icache_sync(void) {
+    for (int s = 0; s < ICACHE_SETS; ++s)
+        for (int w = 0; w < ICACHE_WAYS; ++w)
+            if (g_icache[s][w].valid && g_icache[s][w].dirty && icache_write(&g_icache[s][w]) != 0)
+                return -1;
+    return 0;
+}
+
+static void icache_clear(void) {
+    memset(g_icache, 0, sizeof(g_icache));
+}
+
+/* Stage les plages contiguës de secteurs marqués dans `dirty` */
+static int write_dirty_runs(uint32_t lba, const void *base, uint8_t *dirty, uint32_t n) {
+    for (uint32_t s = 0; s < n; ) {
+        if (!dirty[s]) { s++; continue; }
+        uint32_t run = 1;
+        while (s + run < n && dirty[s + run]) run++;
+        if (meta_write(lba + s, (const uint8_t*)base + s * SECTOR_SIZE, run) != 0) return -1;
+        memset(&dirty[s], 0, run);
+        s += run;
     }
     return 0;
 }
 
+/* Stage le superbloc s'il a changé, puis seulement les secteurs de la
+ * table d'inodes et des bitmaps qui ont changé (plages contiguës groupées),
+ * dans la transaction en cours */
 static int save_super(void) {
-    uint8_t buf[SECTOR_SIZE];
-    memset(buf, 0, SECTOR_SIZE);
-    memcpy(buf, &g_super, sizeof(reapfs_super_t));
-    if (reapfs_disk_write_wrapper(buf, (uint64_t)SUPERBLOCK_SECTOR * SECTOR_SIZE, SECTOR_SIZE) != 0) {
-        print_string("FS: super write failed\n");
-        return -1;
+    if (g_super_dirty) {
+        uint8_t buf[SECTOR_SIZE];
+        crc_seal(&g_super, sizeof(g_super));
+        memcpy(buf, &g_super, sizeof(reapfs_super_t));
+        if (meta_write(SUPERBLOCK_SECTOR, buf, 1) != 0) {
+            print_string("FS: super write failed\n");
+            return -1;
+        }
+        g_super_dirty = 0;
     }
-    size_t it_size = (size_t)g_super.inode_count * sizeof(reapfs_inode_t);
-    size_t it_sectors = (it_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    if (reapfs_disk_write_wrapper((uint8_t*)g_inodes, (uint64_t)INODE_TABLE_START_SECTOR * SECTOR_SIZE, it_sectors * SECTOR_SIZE) != 0) {
-        print_string("FS: inode table write failed\n");
+    if (icache_sync() != 0) return -1;
+    if (write_dirty_runs(g_super.ibitmap_start, g_ibitmap, g_ibm_dirty, g_super.ibitmap_sectors) != 0
+        || write_dirty_runs(g_super.bitmap_start, g_bitmap, g_bm_dirty, g_super.bitmap_sectors) != 0) {
+        print_string("FS: bitmap write failed\n");
         return -1;
     }
+    g_meta_dirty = 0;
+    g_meta_pending = 0;
+    return 0;
+}
+
+/* Fin d'une opération publique : en write-through chaque opération est
+ * commitée ; en write-back les opérations s'accumulent dans la même
+ * transaction jusqu'au sync (ou jnl_pressure). Puis la file blkq. */
+static int op_end(void) {
+    int r = 0;
+    if (!bcache_writeback_enabled() || jnl_pressure()) {
+        if (jnl_commit(0) != 0) r = -1;
+    }
+    if (blkq_dispatch() != 0) r = -1;
+    return r;
+}
+
+/* Données sales du cache, puis commit des métadonnées : le FLUSH CACHE du
+ * commit couvre le tout */
+static int sync_all(void) {
+    int r = 0;
+    if (bcache_sync() != 0) r = -1;
+    if (jnl_commit(1) != 0) r = -1;
+    /* Des secteurs de métadonnées attendent un checkpoint pour être rendus :
+     * sans lui ils resteraient occupés après démontage */
+    if (r == 0 && g_jdefer_n > 0 && (jnl_checkpoint() != 0 || jnl_commit(1) != 0)) r = -1;
+    g_last_sync_ms = timer_ms();
+    if (r != 0) print_string("FS: sync failed\n");
+    return r;
+}
+
+
+/* ---------- Allocateur de secteurs (bitmap) ---------- */
+
+static int bm_test(uint32_t lba) {
+    return (g_bitmap[lba >> 5] >> (lba & 31)) & 1;
+}
+
+/* Passe [lba, lba+n) à `used` ; tient à jour free_sectors et les secteurs
+ * de bitmap à réécrire */
+static void bm_set_range(uint32_t lba, uint32_t n, int used) {
+    for (uint32_t i = 0; i < n; ++i, ++lba) {
+        uint32_t bit = 1u << (lba & 31);
+        uint32_t *w = &g_bitmap[lba >> 5];
+        if (used && !(*w & bit)) { *w |= bit; g_super.free_sectors--; }
+        else if (!used && (*w & bit)) { *w &= ~bit; g_super.free_sectors++; }
+        uint32_t s = lba / BM_BITS_PER_SECTOR;
+        if (!g_bm_dirty[s]) g_meta_pending++;
+        g_bm_dirty[s] = 1;
+    }
+    mark_super_dirty();
+}
+
+/* Longueur de la plage libre qui commence à `lba` (au plus `want`) ;
+ * les mots entièrement libres sont comptés 32 bits d'un coup */
+static uint32_t bm_free_len(uint32_t lba, uint32_t want) {
+    uint32_t total = g_super.total_sectors;
+    uint32_t len = 0;
+    while (lba < total && len < want) {
+        if ((lba & 31) == 0 && g_bitmap[lba >> 5] == 0 && len + 32 <= want && lba + 32 <= total) {
+            lba += 32;
+            len += 32;
+            continue;
+        }
+        if (bm_test(lba)) break;
+        lba++;
+        len++;
+    }
+    return len;
+}
+
+/* Next-fit depuis g_bm_hint : première plage d'au moins `want` secteurs,
+ * sinon la plus longue rencontrée sur un tour complet. Les mots pleins
+ * sont sautés d'un coup, ce qui garde le scan court sur un disque presque plein. */
+static uint32_t bm_find(uint32_t want, uint32_t *got) {
+    uint32_t total = g_super.total_sectors;
+    uint32_t data = g_super.data_start_sector;
+    uint32_t best = 0, best_len = 0;
+    uint32_t lba = (g_bm_hint >= data && g_bm_hint < total) ? g_bm_hint : data;
+    uint32_t scanned = 0;
+    uint32_t span = total - data;
+
+    while (scanned < span) {
+        if (lba >= total) lba = data;
+        if (g_bitmap[lba >> 5] == 0xFFFFFFFFu) {
+            uint32_t skip = 32 - (lba & 31);
+            lba += skip;
+            scanned += skip;
+            continue;
+        }
+        if (bm_test(lba)) {
+            lba++;
+            scanned++;
+            continue;
+        }
+        uint32_t len = bm_free_len(lba, want);
+        if (len >= want) {
+            *got = want;
+            return lba;
+        }
+        if (len > best_len) {
+            best = lba;
+            best_len = len;
+        }
+        lba += len;
+        scanned += len;
+    }
+    *got = best_len;
+    return best;
+}
+
+/* Alloue jusqu'à `want` secteurs contigus, de préférence à `goal` (suite
+ * directe du fichier). Retourne le premier LBA et la longueur dans *got
+ * (0 = disque plein). */
+static uint32_t bm_alloc(uint32_t goal, uint32_t want, uint32_t *got) {
+    uint32_t start = 0, len = 0;
+    if (goal >= g_super.data_start_sector && goal < g_super.total_sectors)
+        len = bm_free_len(goal, want);
+    if (len > 0) start = goal;
+    else start = bm_find(want, &len);
+    *got = len;
+    if (len == 0) return 0;
+    bm_set_range(start, len, 1);
+    g_bm_hint = start + len;
+    return start;
+}
+
+static void bm_free(uint32_t lba, uint32_t n) {
+    if (lba < g_super.data_start_sector || lba + n > g_super.total_sectors) return;
+    bm_set_range(lba, n, 0);
+}
+
+/* ---------- Allocateur d'inodes (bitmap) ----------
+ *
+ * Même principe que pour les secteurs : copie complète en mémoire (8 Kio
+ * au plus), bits au-delà de inode_count à 1, scan par mots depuis
+ * g_ino_hint. Allouer ne touche qu'un secteur de bitmap et un secteur de
+ * la table : le nombre d'inodes libres est recompté au montage plutôt que
+ * tenu dans le superbloc.
+ */
+
+static void ibm_set(uint32_t ino, int used) {
+    uint32_t bit = 1u << (ino & 31);
+    uint32_t *w = &g_ibitmap[ino >> 5];
+    if (used && !(*w & bit)) { *w |= bit; g_free_inodes--; }
+    else if (!used && (*w & bit)) { *w &= ~bit; g_free_inodes++; }
+    else return;
+    if (!g_ibm_dirty[ino / BM_BITS_PER_SECTOR]) g_meta_pending++;
+    g_ibm_dirty[ino / BM_BITS_PER_SECTOR] = 1;
+    g_meta_dirty = 1;
+}
+
+/* Premier bit libre à partir de g_ino_hint, -1 si aucun */
+static int ibm_find(void) {
+    uint32_t words = (g_super.inode_count + 31) / 32;
+    uint32_t w = (g_ino_hint / 32) % words;
+    for (uint32_t k = 0; k <= words; ++k, w = (w + 1) % words) {
+        uint32_t v = g_ibitmap[w];
+        if (v == 0xFFFFFFFFu) continue;
+        uint32_t b = 0;
+        /* Au premier mot, on commence au hint pour ne pas revenir en arrière */
+        if (k == 0) b = g_ino_hint & 31;
+        while (b < 32 && (v >> b) & 1) b++;
+        if (b < 32) return (int)(w * 32 + b);
+    }
+    return -1;
+}
+
+/* ---------- Inode management ---------- */
+
+/* Inode libre selon la bitmap. Un inode que la bitmap croit libre mais qui
+ * est occupé ou en quarantaine y est marqué, et on passe au suivant. */
+static int alloc_inode(void) {
+    while (g_free_inodes > 0) {
+        int i = ibm_find();
+        if (i < 0) return -1;
+        reapfs_inode_t *node = inode_get((uint32_t)i);
+        if (!node) return -1;
+        ibm_set((uint32_t)i, 1);
+        g_ino_hint = (uint32_t)i + 1;
+        if (node->used || (node->flags & INODE_F_BAD)) continue;
+        memset(node, 0, sizeof(reapfs_inode_t));
+        node->ino = (uint32_t)i;
+        node->used = 1;
+        mark_inode_dirty((uint32_t)i);
+        return i;
+    }
+    return -1;
+}
+
+static int ext_truncate(reapfs_inode_t *inode, uint32_t sectors);
+
+static void free_inode(uint32_t ino) {
+    reapfs_inode_t *node = inode_get(ino);
+    if (!node) return;
+    ext_truncate(node, 0);
+    ibm_set(ino, 0);
+    if (g_zc_ino == (int)ino) g_zc_ino = -1;
+    memset(node, 0, sizeof(reapfs_inode_t));
+    node->ino = ino;
+    ra_of(ino);   /* repart de zéro pour le prochain fichier à ce numéro */
+    /* Les descripteurs encore ouverts dessus ne doivent pas suivre le
+     * prochain fichier qui recevra ce numéro */
+    for (int i = 0; i < FS_MAX_OPEN; ++i)
+        if (g_files[i].used && g_files[i].ino == ino) g_files[i].used = 0;
+    mark_inode_dirty(ino);
+}
+
+/* ---------- Extents ---------- */
+
+/* Liste d'extents de l'opération en cours (le noyau n'a qu'un fil) */
+static reapfs_extent_t g_ext[FS_MAX_EXTENTS];
+static uint32_t g_ext_n = 0;
+static uint32_t g_ovf[EXT_MAX_BLOCKS];    /* LBA des blocs de débordement */
+static uint32_t g_ovf_n = 0;
+/* Inode dont g_ext est le reflet exact (-1 : aucun) : les accès répétés au
+ * même fichier ne relisent pas ses blocs de débordement */
+static int g_ext_owner = -1;
+
+/* Charge la liste complète de l'inode dans g_ext */
+static int ext_load(const reapfs_inode_t *inode) {
+    if (g_ext_owner == (int)inode->ino) return 0;
+    g_ext_owner = -1;
+    uint32_t n = inode->ext_count;
+    uint32_t inl = n < INODE_EXTENTS ? n : INODE_EXTENTS;
+    memcpy(g_ext, inode->ext, inl * sizeof(reapfs_extent_t));
+    g_ext_n = inl;
+    g_ovf_n = 0;
+
+    uint32_t lba = inode->ext_overflow;
+    while (g_ext_n < n) {
+        reapfs_extblock_t blk;
+        if (lba == 0 || g_ovf_n == EXT_MAX_BLOCKS
+            || reapfs_disk_read_wrapper(&blk, (uint64_t)lba * SECTOR_SIZE, SECTOR_SIZE) != 0
+            || blk.magic != EXT_BLOCK_MAGIC || blk.count > EXT_PER_BLOCK
+            || crc_check(&blk, sizeof(blk)) != 0) {
+            print_string("FS: bad extent block\n");
+            return -1;
+        }
+        g_ovf[g_ovf_n++] = lba;
+        uint32_t take = n - g_ext_n < blk.count ? n - g_ext_n : blk.count;
+        memcpy(&g_ext[g_ext_n], blk.ext, take * sizeof(reapfs_extent_t));
+        g_ext_n += take;
+        lba = blk.next;
+    }
+    g_ext_owner = (int)inode->ino;
+    return 0;
+}
+
+/* Réécrit g_ext dans l'inode et ses blocs de débordement (alloués ou
+ * rendus selon le besoin) */
+static int ext_store(reapfs_inode_t *inode) {
+    g_ext_owner = -1;
+    uint32_t n = g_ext_n;
+    uint32_t inl = n < INODE_EXTENTS ? n : INODE_EXTENTS;
+    uint32_t rest = n - inl;
+    uint32_t need = (rest + EXT_PER_BLOCK - 1) / EXT_PER_BLOCK;
+
+    while (g_ovf_n < need) {
+        uint32_t got;
+        uint32_t goal = g_ovf_n > 0 ? g_ovf[g_ovf_n - 1] + 1 : 0;
+        uint32_t lba = bm_alloc(goal, 1, &got);
+        if (got == 0) {
+            print_string("FS: disk full\n");
+            return -1;
+        }
+        g_ovf[g_ovf_n++] = lba;
+    }
+    while (g_ovf_n > need) meta_free(g_ovf[--g_ovf_n], 1);
+
+    memset(inode->ext, 0, sizeof(inode->ext));
+    memcpy(inode->ext, g_ext, inl * sizeof(reapfs_extent_t));
+    inode->ext_count = n;
+    inode->ext_overflow = need ? g_ovf[0] : 0;
+
+    for (uint32_t b = 0; b < need; ++b) {
+        reapfs_extblock_t blk;
+        uint32_t take = rest < EXT_PER_BLOCK ? rest : EXT_PER_BLOCK;
+        memset(&blk, 0, sizeof(blk));
+        blk.magic = EXT_BLOCK_MAGIC;
+        blk.count = take;
+        blk.next = b + 1 < need ? g_ovf[b + 1] : 0;
+        memcpy(blk.ext, &g_ext[n - rest], take * sizeof(reapfs_extent_t));
+        crc_seal(&blk, sizeof(blk));
+        if (meta_write(g_ovf[b], &blk, 1) != 0) {
+            print_string("FS: extent block write failed\n");
+            return -1;
+        }
+        rest -= take;
+    }
+    mark_inode_dirty(inode->ino);
+    g_ext_owner = (int)inode->ino;
+    return 0;
+}
+
+static void ext_free(uint32_t lba, uint32_t n, int meta) {
+    if (meta) meta_free(lba, n);
+    else bm_free(lba, n);
+}
+
+/* Ramène g_ext à `sectors` secteurs en rendant la fin à la bitmap ;
+ * `meta` : secteurs de répertoire, libérés au prochain checkpoint */
+static void ext_trim(uint32_t sectors, int meta) {
+    g_ext_owner = -1;
+    uint32_t base = 0, e = 0;
+    while (e < g_ext_n && base + g_ext[e].len <= sectors) base += g_ext[e++].len;
+    if (e < g_ext_n && base < sectors) {
+        uint32_t keep = sectors - base;
+        ext_free(g_ext[e].start + keep, g_ext[e].len - keep, meta);
+        g_ext[e].len = keep;
+        e++;
+    }
+    for (uint32_t k = e; k < g_ext_n; ++k) ext_free(g_ext[k].start, g_ext[k].len, meta);
+    g_ext_n = e;
+}
+
+/* Taille allouée en secteurs de la liste g_ext */
+static uint32_t ext_sectors(void) {
+    uint32_t n = 0;
+    for (uint32_t e = 0; e < g_ext_n; ++e) n += g_ext[e].len;
+    return n;
+}
+
+/* Raccourcit (ou vide) l'allocation d'un inode */
+static int ext_truncate(reapfs_inode_t *inode, uint32_t sectors) {
+    if (ext_load(inode) != 0) return -1;
+    ext_trim(sectors, inode->is_dir);
+    return ext_store(inode);
+}
+
+/* Agrandit g_ext de `want` secteurs : d'abord dans le prolongement du
+ * dernier extent, sinon par plages contiguës les plus longues possible */
+static int ext_grow(uint32_t want) {
+    g_ext_owner = -1;
+    uint32_t orig = ext_sectors();
+    while (want > 0) {
+        uint32_t goal = g_ext_n ? g_ext[g_ext_n - 1].start + g_ext[g_ext_n - 1].len : 0;
+        uint32_t got;
+        uint32_t start = bm_alloc(goal, want, &got);
+        if (got == 0 || (start != goal && g_ext_n == FS_MAX_EXTENTS)) {
+            if (got) bm_free(start, got);
+            print_string(got ? "FS: file too fragmented\n" : "FS: disk full\n");
+            ext_trim(orig, 0);   /* annule ce qui vient d'être pris */
+            return -1;
+        }
+        if (g_ext_n && start == goal) {
+            g_ext[g_ext_n - 1].len += got;
+        } else {
+            g_ext[g_ext_n].start = start;
+            g_ext[g_ext_n].len = got;
+            g_ext_n++;
+        }
+        want -= got;
+    }
+    return 0;
+}
+
+#define EXT_READ  0
+#define EXT_WRITE 1
+#define EXT_META  2   /* écriture journalisée (répertoires) */
+
+/* Secteurs de fichier [first, last] d'après g_ext : une requête par morceau
+ * d'extent. write (EXT_*) : données lues dans src ; sinon dst == NULL =>
+ * préchargement */
+static int ext_io(uint32_t first, uint32_t last, uint8_t *buf, int write, int direct) {
+    uint32_t base = 0;
+    int r = 0;
+    for (uint32_t e = 0; e < g_ext_n && base <= last; ++e) {
+        uint32_t e_end = base + g_ext[e].len;   /* exclu */
+        if (e_end > first) {
+            uint32_t from = first > base ? first : base;
+            uint32_t to = last + 1 < e_end ? last + 1 : e_end;
+            uint32_t lba = g_ext[e].start + (from - base);
+            uint8_t *p = buf ? buf + (from - first) * SECTOR_SIZE : 0;
+            if (write == EXT_META) r |= meta_write(lba, p, to - from);
+            else if (write) r |= bcache_write(lba, p, to - from);
+            else if (p) r |= bcache_queue_read(lba, p, to - from, direct);
+            else r |= bcache_prefetch(lba, to - from);
+        }
+        base = e_end;
+    }
+    return r ? -1 : 0;
+}
+
+/* ---------- Compression LZ4 ----------
+ *
+ * Un fichier INODE_F_LZ4 est découpé en blocs de ZCHUNK_SIZE octets,
+ * compressés chacun à part. Sa liste d'extents sert de table des blocs :
+ * g_ext[c] = secteurs du bloc c, len == 0 pour un bloc nul (trou). Un bloc
+ * reste brut si LZ4 ne gagne pas au moins un secteur : il est brut
+ * exactement quand len vaut le nombre de secteurs de ses octets valides.
+ * Un bloc de queue partiel est donc réécrit dès que la taille le dépasse.
+ */
+static uint32_t zc_sectors(uint32_t bytes) {
+    return (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+/* Octets valides du bloc c pour un fichier de `size` octets */
+static uint32_t zc_valid(uint32_t size, uint32_t c) {
+    uint32_t base = c * ZCHUNK_SIZE;
+    if (size <= base) return 0;
+    return size - base < ZCHUNK_SIZE ? size - base : ZCHUNK_SIZE;
+}
+
+/* `want` secteurs d'un seul tenant, à `goal` si possible. 0 = pas de place */
+static uint32_t zc_alloc(uint32_t goal, uint32_t want) {
+    uint32_t start = goal, got = 0;
+    if (goal < g_super.data_start_sector || goal >= g_super.total_sectors
+        || bm_free_len(goal, want) < want) {
+        start = bm_find(want, &got);
+        if (got < want) return 0;
+    }
+    bm_set_range(start, want, 1);
+    g_bm_hint = start + want;
+    return start;
+}
+
+/* Bloc c de l'inode (g_ext chargée) dans g_zplain, complété de zéros */
+static int zc_load(const reapfs_inode_t *inode, uint32_t c) {
+    if (g_zc_ino == (int)inode->ino && g_zc_idx == c) return 0;
+    g_zc_ino = -1;
+    uint32_t valid = zc_valid(inode->size, c);
+    memset(g_zplain, 0, ZCHUNK_SIZE);
+    if (c < g_ext_n && g_ext[c].len > 0 && valid > 0) {
+        uint32_t len = g_ext[c].len;
+        int raw = len == zc_sectors(valid);
+        if (len > ZCHUNK_SECTORS) {
+            print_string("FS: bad compressed chunk\n");
+            return -1;
+        }
+        if (bcache_queue_read(g_ext[c].start, raw ? g_zplain : g_zdisk, len, 1) != 0
+            || bcache_complete() != 0) {
+            print_string("FS: ata_read failed\n");
+            return -1;
+        }
+        if (!raw && lz4_decompress(g_zdisk, len * SECTOR_SIZE, g_zplain, valid) != 0) {
+            print_string("FS: bad compressed chunk\n");
+            return -1;
+        }
+        memset(g_zplain + valid, 0, ZCHUNK_SIZE - valid);
+    }
+    g_zc_ino = (int)inode->ino;
+    g_zc_idx = c;
+    return 0;
+}
+
+/* Range g_zplain comme bloc c d'un fichier de `size` octets : compressé si
+ * ça gagne un secteur, brut sinon, rien du tout s'il est nul. Réutilise les
+ * secteurs du bloc quand ils suffisent. ext_store reste à la charge de l'appelant. */
+static int zc_store(uint32_t c, uint32_t size) {
+    uint32_t valid = zc_valid(size, c);
+    uint32_t len = zc_sectors(valid);
+    const uint8_t *src = g_zplain;
+
+    uint32_t i = 0;
+    while (i < valid && g_zplain[i] == 0) i++;
+    if (i == valid) {
+        len = 0;
+    } else if (len > 1) {
+        uint32_t csz = lz4_compress(g_zplain, valid, g_zdisk, (len - 1) * SECTOR_SIZE);
+        if (csz > 0) {
+            len = zc_sectors(csz);
+            memset(g_zdisk + csz, 0, len * SECTOR_SIZE - csz);
+            src = g_zdisk;
+        }
+    }
+
+    g_ext_owner = -1;
+    while (g_ext_n <= c) {
+        g_ext[g_ext_n].start = 0;
+        g_ext[g_ext_n].len = 0;
+        g_ext_n++;
+    }
+    reapfs_extent_t *e = &g_ext[c];
+    if (len <= e->len) {
+        if (e->len > len) bm_free(e->start + len, e->len - len);
+        if (len == 0) e->start = 0;
+    } else {
+        uint32_t goal = e->len ? e->start
+                      : (c > 0 && g_ext[c - 1].len ? g_ext[c - 1].start + g_ext[c - 1].len : 0);
+        if (e->len) bm_free(e->start, e->len);
+        uint32_t start = zc_alloc(goal, len);
+        if (start == 0) {
+            if (e->len) bm_set_range(e->start, e->len, 1);
+            print_string("FS: disk full\n");
+            return -1;
+        }
+        e->start = start;
+    }
+    e->len = len;
+    if (len > 0 && bcache_write(e->start, src, len) != 0) return -1;
     return 0;
 }
 
+static int zfile_read_at(reapfs_inode_t *inode, uint32_t off, uint8_t *out, uint32_t len) {
+    if (ext_load(inode) != 0) return -1;
+    uint32_t end = off + len;
+    uint32_t last = (end - 1) / ZCHUNK_SIZE;
+    uint32_t ahead = 0;   /* premier bloc pas encore demandé */
+    for (uint32_t pos = off; pos < end; ) {
+        uint32_t c = pos / ZCHUNK_SIZE;
+        uint32_t lo = c * ZCHUNK_SIZE;
+        uint32_t to = end < lo + ZCHUNK_SIZE ? end : lo + ZCHUNK_SIZE;
+        /* Blocs suivants de la même lecture : dans le même dispatch que
+         * celui-ci (fusionnés s'ils se suivent), puis servis par le cache */
+        if (c >= ahead && (g_zc_ino != (int)inode->ino || g_zc_idx != c)) {
+            uint32_t room = RA_MAX_SECTORS;
+            uint32_t k = c + 1;
+            for (; k <= last && k < g_ext_n && g_ext[k].len <= room; ++k) {
+                if (g_ext[k].len) bcache_prefetch(g_ext[k].start, g_ext[k].len);
+                room -= g_ext[k].len;
+            }
+            ahead = k;
+        }
+        if (zc_load(inode, c) != 0) return -1;
+        memcpy(out + (pos - off), g_zplain + (pos - lo), to - pos);
+        pos = to;
+    }
+    return (int)len;
+}
 
+/* Écriture par blocs : chaque bloc touché est relu (sauf s'il est recouvert
+ * en entier), modifié, recompressé. */
+static int zfile_write_at(reapfs_inode_t *inode, uint32_t off, const uint8_t *in, uint32_t len) {
+    uint32_t end = off + len;
+    uint32_t size = end > inode->size ? end : inode->size;
+    uint32_t first = off / ZCHUNK_SIZE;
+    uint32_t last = (end - 1) / ZCHUNK_SIZE;
+    if (last >= FS_MAX_EXTENTS) {
+        print_string("FS: file too large\n");
+        return -1;
+    }
+    if (ext_load(inode) != 0) return -1;
 
-/* ---------- Inode management ---------- */
+    uint32_t from = first;
+    if (size > inode->size && inode->size % ZCHUNK_SIZE) {
+        uint32_t tail = (inode->size - 1) / ZCHUNK_SIZE;
+        if (tail < from) from = tail;
+    }
 
-static int alloc_inode(void) {
-    for (int i = 0; i < (int)g_super.inode_count && i < MAX_INODES; ++i) {
-        if (!g_inode_used[i]) {
-            g_inode_used[i] = 1;
-            memset(&g_inodes[i], 0, sizeof(reapfs_inode_t));
-            g_inodes[i].ino = (uint32_t)i;
-            g_inodes[i].used = 1;
-            save_super();
-            return i;
+    int r = 0;
+    uint32_t c;
+    for (c = from; c <= last; ++c) {
+        uint32_t lo = c * ZCHUNK_SIZE;
+        if (c < first) {
+            /* Ancien bloc de queue, hors écriture : seule sa taille change */
+            if (zc_load(inode, c) != 0 || zc_store(c, size) != 0) { r = -1; break; }
+            continue;
         }
+        uint32_t a = off > lo ? off : lo;
+        uint32_t b = end < lo + ZCHUNK_SIZE ? end : lo + ZCHUNK_SIZE;
+        if (a == lo && b >= lo + zc_valid(size, c)) {
+            g_zc_ino = -1;
+            memset(g_zplain + (b - lo), 0, ZCHUNK_SIZE - (b - lo));
+        } else if (zc_load(inode, c) != 0) {
+            r = -1;
+            break;
+        }
+        memcpy(g_zplain + (a - lo), in + (a - off), b - a);
+        g_zc_ino = -1;
+        if (zc_store(c, size) != 0) { r = -1; break; }
+        g_zc_ino = (int)inode->ino;
+        g_zc_idx = c;
     }
-    return -1;
-}
 
-static void free_inode(uint32_t ino) {
-    if (ino >= g_super.inode_count || ino >= MAX_INODES) return;
-    g_inode_used[ino] = 0;
-    memset(&g_inodes[ino], 0, sizeof(reapfs_inode_t));
-    save_super();
+    /* Sur erreur, les blocs avant c sont rangés pour la nouvelle taille :
+     * le fichier s'arrête là */
+    if (r != 0 && c * ZCHUNK_SIZE < size) size = c * ZCHUNK_SIZE > inode->size ? c * ZCHUNK_SIZE : inode->size;
+    if (ext_store(inode) != 0) r = -1;
+    inode->size = size;
+    mark_inode_dirty(inode->ino);
+    return r;
 }
 
-/* ---------- File data IO (simple direct blocks) ---------- */
+/* ---------- File data IO ---------- */
 
 static int write_file_data(reapfs_inode_t *inode, const void *buf, uint32_t size) {
     if (!inode) return -1;
+    if (inode->flags & INODE_F_LZ4) {
+        if (ext_load(inode) != 0) return -1;
+        ext_trim(0, 0);
+        if (g_zc_ino == (int)inode->ino) g_zc_ino = -1;
+        inode->size = 0;
+        if (ext_store(inode) != 0) return -1;
+        mark_inode_dirty(inode->ino);
+        return size ? zfile_write_at(inode, 0, (const uint8_t*)buf, size) : 0;
+    }
     uint32_t sectors_needed = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    if (sectors_needed > (uint32_t)(sizeof(inode->blocks)/sizeof(inode->blocks[0]))) {
-        print_string("FS: file too large\n");
+    if (ext_load(inode) != 0) return -1;
+    uint32_t sectors_have = ext_sectors();
+
+    if (sectors_needed > sectors_have) {
+        if (ext_grow(sectors_needed - sectors_have) != 0) return -1;
+    } else if (sectors_needed < sectors_have) {
+        ext_trim(sectors_needed, inode->is_dir);
+    }
+    if (ext_store(inode) != 0) {
+        /* Pas de place pour la liste : on rend ce qui vient d'être alloué */
+        if (sectors_needed > sectors_have) {
+            ext_trim(sectors_have, 0);
+            ext_store(inode);
+        }
         return -1;
     }
-    uint8_t sector_buf[SECTOR_SIZE];
+
+    /* Secteurs pleins : une requête par extent ; le dernier, partiel, complété de zéros */
     const uint8_t *in = (const uint8_t*)buf;
-    for (uint32_t s = 0; s < sectors_needed; ++s) {
-        uint32_t lba = g_super.data_start_sector + (inode->ino * 100) + s;
-        inode->blocks[s] = lba;
+    uint32_t full = size / SECTOR_SIZE;
+    int how = inode->is_dir ? EXT_META : EXT_WRITE;
+    if (full > 0 && ext_io(0, full - 1, (uint8_t*)in, how, 0) != 0) {
+        print_string("FS: ata_write failed\n");
+        return -1;
+    }
+    if (full < sectors_needed) {
+        uint8_t sector_buf[SECTOR_SIZE];
         memset(sector_buf, 0, SECTOR_SIZE);
-        size_t copy_len = SECTOR_SIZE;
-        if (s == sectors_needed - 1) {
-            uint32_t remain = size - (s * SECTOR_SIZE);
-            if (remain < copy_len) copy_len = remain;
-        }
-        memcpy(sector_buf, in + s * SECTOR_SIZE, copy_len);
-        if (ata_write(lba, sector_buf, 1) != 0) {
+        memcpy(sector_buf, in + full * SECTOR_SIZE, size - full * SECTOR_SIZE);
+        /* bcache/blkq copient le secteur : sector_buf est réutilisable tout de suite */
+        if (ext_io(full, full, sector_buf, how, 0) != 0) {
             print_string("FS: ata_write failed\n");
             return -1;
         }
     }
-    /* if size == 0, we won't write any block but still set size and save */
     inode->size = size;
-    save_super();
+    mark_inode_dirty(inode->ino);
     return 0;
 }
+static int dir_init(reapfs_inode_t *dir, uint32_t self, uint32_t parent);
+
 /* Inode après init de write file data */
+/* inode_count = 0 : un inode par FS_BYTES_PER_INODE de volume */
 static int format_super(uint32_t inode_count) {
     memset(&g_super, 0, sizeof(g_super));
-    g_super.magic = 0x52455046;
-    g_super.version = 1;
-    g_super.inode_table_sectors = INODE_TABLE_SECTORS;
-    g_super.inode_count = inode_count;
-    g_super.data_start_sector = INODE_TABLE_START_SECTOR + g_super.inode_table_sectors;
-    memset(g_inodes, 0, sizeof(g_inodes));
-    memset(g_inode_used, 0, sizeof(g_inode_used));
+    reapfs_layout(&g_super, fs_device_sectors(), inode_count);
+    inode_count = g_super.inode_count;
+    if (g_super.total_sectors <= g_super.data_start_sector) {
+        print_string("FS: disk too small\n");
+        return -1;
+    }
 
-    /* créer inode racine */
-    g_inode_used[0] = 1;
-    g_inodes[0].used = 1;
-    g_inodes[0].is_dir = 1;
-    g_inodes[0].ino = 0;
-    g_inodes[0].size = 0;
-    strncpy(g_inodes[0].name, "/", MAX_FILENAME - 1);
-    g_inodes[0].name[MAX_FILENAME - 1] = '\0';
+    /* Tout est occupé sauf la zone de données ; les bits au-delà de la fin
+     * du volume restent à 1 pour que le scan par mots ne les prenne jamais */
+    memset(g_bitmap, 0xFF, sizeof(g_bitmap));
+    g_super.free_sectors = 0;   /* compté par bm_set_range */
+    bm_set_range(g_super.data_start_sector, g_super.total_sectors - g_super.data_start_sector, 0);
+    g_bm_hint = g_super.data_start_sector;
+    g_ext_owner = -1;
+    g_zc_ino = -1;
+    memset(g_ibitmap, 0xFF, sizeof(g_ibitmap));
+    g_free_inodes = 0;   /* compté par ibm_set */
+    for (uint32_t i = 0; i < inode_count; ++i) ibm_set(i, 0);
+    g_ino_hint = 1;
+    icache_clear();
+    memset(g_ra, 0, sizeof(g_ra));
+    bcache_invalidate();
+
+    /* Table d'inodes vide, écrite d'un bloc hors journal : le volume est
+     * refait de toute façon, le cache d'inodes la relira à la demande */
+    {
+        reapfs_inode_t tmpl[INODES_PER_SECTOR];
+        memset(tmpl, 0, sizeof(tmpl));
+        for (uint32_t s = 0; s < g_super.inode_table_sectors; ++s) {
+            for (uint32_t i = 0; i < INODES_PER_SECTOR; ++i) {
+                tmpl[i].ino = s * INODES_PER_SECTOR + i;
+                crc_seal(&tmpl[i], sizeof(reapfs_inode_t));
+            }
+            if (blkq_submit(INODE_TABLE_START_SECTOR + s, (uint8_t*)tmpl, 1, 1) != 0) {
+                print_string("FS: inode table write failed\n");
+                return -1;
+            }
+        }
+        if (blkq_dispatch() != 0) {
+            print_string("FS: inode table write failed\n");
+            return -1;
+        }
+    }
 
-    /* Initialiser . et .. pour la racine (pointent vers lui-même) */
+    /* Journal vide. La séquence part au-delà de tout ce qu'un ancien journal
+     * au même endroit a pu contenir, pour que rien n'en soit rejoué. */
     {
-        reapfs_dirent_t root_entries[2];
-        strncpy(root_entries[0].name, ".", MAX_FILENAME - 1);
-        root_entries[0].name[MAX_FILENAME - 1] = '\0';
-        root_entries[0].ino = 0;
-        strncpy(root_entries[1].name, "..", MAX_FILENAME - 1);
-        root_entries[1].name[MAX_FILENAME - 1] = '\0';
-        root_entries[1].ino = 0;
-        write_file_data(&g_inodes[0], root_entries, (uint32_t)sizeof(root_entries));
-        g_inodes[0].size = (uint32_t)sizeof(root_entries);
+        jnl_header_t old;
+        uint32_t seq = 1;
+        if (blkq_read(g_super.journal_start, (uint8_t*)&old, 1) == 0 && old.magic == JNL_HDR_MAGIC)
+            seq = old.seq + jnl_log_size();
+        g_jseq = seq;
+        g_jhead = 0;
+        g_jdefer_n = 0;
+        if (jnl_write_header(g_jseq) != 0) return -1;
+    }
+
+    /* Bitmaps entières hors journal elles aussi : un petit cache ne
+     * pourrait pas les tenir toutes épinglées. Le superbloc suit au sync */
+    if (blkq_submit(g_super.ibitmap_start, (uint8_t*)g_ibitmap, g_super.ibitmap_sectors, 1) != 0
+        || blkq_submit(g_super.bitmap_start, (uint8_t*)g_bitmap, g_super.bitmap_sectors, 1) != 0
+        || blkq_dispatch() != 0) {
+        print_string("FS: bitmap write failed\n");
+        return -1;
     }
+    memset(g_bm_dirty, 0, sizeof(g_bm_dirty));
+    memset(g_ibm_dirty, 0, sizeof(g_ibm_dirty));
+    g_super_dirty = 0;
+    g_meta_pending = 0;
+    mark_super_dirty();
+
+    /* créer inode racine */
+    reapfs_inode_t *root = inode_get(0);
+    if (!root) return -1;
+    ibm_set(0, 1);
+    root->used = 1;
+    root->is_dir = 1;
+    root->size = 0;
+    strncpy(root->name, "/", MAX_FILENAME - 1);
+    root->name[MAX_FILENAME - 1] = '\0';
+    mark_inode_dirty(0);
+
+    /* Initialiser . et .. pour la racine (pointent vers lui-même) */
+    if (dir_init(root, 0, 0) != 0) return -1;
 
     /* initial cwd */
     g_cwd_ino = 0;
     strncpy(g_cwd_path, "/", MAX_PATH - 1);
     g_cwd_path[MAX_PATH - 1] = '\0';
 
-    if (save_super() != 0) return -1;
+    /* Tout à sa place tout de suite : le superbloc sur disque doit désigner
+     * le journal avant qu'un rejeu puisse servir */
+    if (sync_all() != 0 || jnl_checkpoint() != 0) return -1;
     print_string("FS: formatted new super\n");
     return 0;
 }
-static int read_file_data(reapfs_inode_t *inode, void *buf, uint32_t buf_size) {
+static int file_read_at(reapfs_inode_t *inode, uint32_t off, void *buf, uint32_t len) {
     if (!inode) return -1;
-    uint32_t to_read = inode->size;
-    if (to_read == 0) return 0;
-    if (buf_size < to_read) to_read = buf_size;
-    uint32_t sectors = (to_read + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    uint8_t sector_buf[SECTOR_SIZE];
-    for (uint32_t s = 0; s < sectors; ++s) {
-        uint32_t lba = inode->blocks[s];
-        if (ata_read(lba, sector_buf, 1) != 0) {
-            print_string("FS: ata_read failed\n");
+    if (off >= inode->size || len == 0) return 0;
+    uint32_t to_read = inode->size - off;
+    if (len < to_read) to_read = len;
+    if (inode->flags & INODE_F_LZ4) return zfile_read_at(inode, off, (uint8_t*)buf, to_read);
+
+    uint32_t end = off + to_read;
+    uint32_t first = off / SECTOR_SIZE;
+    uint32_t last = (end - 1) / SECTOR_SIZE;
+    uint32_t nblocks = (inode->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint8_t *out = (uint8_t*)buf;
+    uint8_t head_buf[SECTOR_SIZE];
+    uint8_t tail_buf[SECTOR_SIZE];
+
+    if (ext_load(inode) != 0) return -1;
+
+    ra_state_t *ra = ra_of(inode->ino);
+    if (off == ra->next_off) {
+        ra->window = ra->window ? ra->window * 2 : RA_MIN_SECTORS;
+        if (ra->window > RA_MAX_SECTORS) ra->window = RA_MAX_SECTORS;
+    } else {
+        ra->window = 0;
+    }
+    ra->next_off = end;
+
+    /* Secteurs partiels en tête et en queue : via des tampons locaux */
+    int head = (off % SECTOR_SIZE) != 0 || (first == last && end % SECTOR_SIZE != 0);
+    int tail = first != last && (end % SECTOR_SIZE) != 0;
+    if (head) ext_io(first, first, head_buf, 0, 0);
+    if (tail) ext_io(last, last, tail_buf, 0, 0);
+
+    /* Secteurs entiers : directement dans la destination. Les fichiers
+     * ordinaires alignés sur 512 ne passent pas par le cache ; les répertoires,
+     * relus à chaque résolution de chemin, y restent. */
+    uint32_t full_first = first + (head ? 1 : 0);
+    uint32_t full_end = last + 1 - (tail ? 1 : 0);   /* exclu */
+    if (full_first < full_end) {
+        uint8_t *dst = out + (full_first * SECTOR_SIZE - off);
+        int direct = !inode->is_dir && ((uintptr_t)dst % SECTOR_SIZE) == 0;
+        ext_io(full_first, full_end - 1, dst, 0, direct);
+    }
+
+    /* Préchargement : même lot, donc même dispatch que la lecture demandée */
+    if (ra->window && last + 1 < nblocks) {
+        uint32_t ra_last = last + ra->window;
+        if (ra_last >= nblocks) ra_last = nblocks - 1;
+        ext_io(last + 1, ra_last, NULL, 0, 0);
+    }
+
+    if (bcache_complete() != 0) {
+        print_string("FS: ata_read failed\n");
+        return -1;
+    }
+
+    if (head) {
+        uint32_t in_sec = off % SECTOR_SIZE;
+        uint32_t n = SECTOR_SIZE - in_sec;
+        if (n > to_read) n = to_read;
+        memcpy(out, head_buf + in_sec, n);
+    }
+    if (tail)
+        memcpy(out + (last * SECTOR_SIZE - off), tail_buf, end % SECTOR_SIZE);
+    return (int)to_read;
+}
+
+/* Secteur s touché partiellement par [off, end) : lecture-modification-
+ * écriture s'il contient déjà des données (s < valid), zéros sinon */
+static int write_partial(uint32_t s, uint32_t valid, uint32_t off, uint32_t end, const uint8_t *in) {
+    uint8_t sec[SECTOR_SIZE];
+    if (s < valid) {
+        ext_io(s, s, sec, 0, 0);
+        if (bcache_complete() != 0) return -1;
+    } else {
+        memset(sec, 0, SECTOR_SIZE);
+    }
+    uint32_t lo = s * SECTOR_SIZE;
+    uint32_t from = off > lo ? off : lo;
+    uint32_t to = end < lo + SECTOR_SIZE ? end : lo + SECTOR_SIZE;
+    memcpy(sec + (from - lo), in + (from - off), to - from);
+    return ext_io(s, s, sec, 1, 0);
+}
+
+/* Écrit len octets à l'offset off : seuls les secteurs touchés partent au
+ * disque et l'allocation ne grandit que de ce qui manque. Un trou entre
+ * l'ancienne fin et off se lit comme des zéros. */
+static int file_write_at(reapfs_inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
+    if (!inode || inode->is_dir) return -1;
+    if (len == 0) return 0;
+    uint32_t end = off + len;
+    if (end < off) return -1;
+    if (inode->flags & INODE_F_LZ4) return zfile_write_at(inode, off, (const uint8_t*)buf, len);
+
+    if (ext_load(inode) != 0) return -1;
+    uint32_t have = ext_sectors();
+    uint32_t need = (end + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (need > have) {
+        if (ext_grow(need - have) != 0) return -1;
+        if (ext_store(inode) != 0) {
+            ext_trim(have, 0);
+            ext_store(inode);
             return -1;
         }
-        size_t copy_len = SECTOR_SIZE;
-        if (s == sectors - 1) {
-            uint32_t remain = to_read - (s * SECTOR_SIZE);
-            if (remain < copy_len) copy_len = remain;
-        }
-        memcpy((uint8_t*)buf + s * SECTOR_SIZE, sector_buf, copy_len);
     }
-    return (int)to_read;
+
+    /* Au-delà de `valid`, les secteurs sont neufs : rien à relire */
+    uint32_t valid = (inode->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t first = off / SECTOR_SIZE;
+    uint32_t last = (end - 1) / SECTOR_SIZE;
+    const uint8_t *in = (const uint8_t*)buf;
+
+    if (first > valid) {
+        uint8_t zero[SECTOR_SIZE];
+        memset(zero, 0, SECTOR_SIZE);
+        for (uint32_t s = valid; s < first; ++s)
+            if (ext_io(s, s, zero, 1, 0) != 0) goto fail;
+    }
+
+    int head = (off % SECTOR_SIZE) != 0 || (first == last && end % SECTOR_SIZE != 0);
+    int tail = first != last && (end % SECTOR_SIZE) != 0;
+    if (head && write_partial(first, valid, off, end, in) != 0) goto fail;
+    if (tail && write_partial(last, valid, off, end, in) != 0) goto fail;
+
+    uint32_t full_first = first + (head ? 1 : 0);
+    uint32_t full_end = last + 1 - (tail ? 1 : 0);   /* exclu */
+    if (full_first < full_end
+        && ext_io(full_first, full_end - 1, (uint8_t*)in + (full_first * SECTOR_SIZE - off), 1, 0) != 0)
+        goto fail;
+
+    if (end > inode->size) inode->size = end;
+    mark_inode_dirty(inode->ino);
+    return 0;
+
+fail:
+    print_string("FS: ata_write failed\n");
+    return -1;
 }
 
 /* ---------- Utility path helpers ---------- */
@@ -440,99 +1691,378 @@ static int split_path(const char *path_in, char *parent_out, char *name_out) {
     return 0;
 }
 
-/* find_inode_by_path: parcours hiérarchique à partir de la racine
- * accepte chemins absolus ou relatifs (relatifs résolus via normalize_path_abs)
- */
-static int find_inode_by_path(const char *path) {
-    if (!path) return -1;
-    char abs[MAX_PATH];
-    if (normalize_path_abs(path, abs, sizeof(abs)) != 0) return -1;
-    if (strcmp(abs, "/") == 0) return 0;
+/* ---------- Cache de dentries ---------- */
 
-    const char *p = abs;
-    if (p[0] == '/') p++;
-    int current = 0; /* start at root */
-    char part[MAX_FILENAME];
+/* (parent, nom) -> ino, ou -1 pour une entrée négative (nom absent).
+ * Ensembles de DCACHE_WAYS entrées choisis par le hash du nom et du parent ;
+ * la plus ancienne de l'ensemble est remplacée. */
+#define DCACHE_SETS 128   /* puissance de 2 */
+#define DCACHE_WAYS 4
 
-    while (*p) {
-        size_t lenp = 0;
-        while (*p && *p != '/' && lenp + 1 < sizeof(part)) part[lenp++] = *p++;
-        part[lenp] = '\0';
-        if (*p == '/') p++;
+typedef struct {
+    uint32_t parent;
+    uint32_t hash;
+    int32_t ino;          /* -1 : négative */
+    uint32_t stamp;       /* 0 : emplacement libre */
+    char name[MAX_FILENAME];
+} dentry_t;
 
-        if (!g_inodes[current].is_dir) return -1;
+static dentry_t g_dcache[DCACHE_SETS][DCACHE_WAYS];
+static uint32_t g_dcache_clock = 0;
+static uint32_t g_dcache_hits = 0;
+static uint32_t g_dcache_misses = 0;
 
-        reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-        int bytes = read_file_data(&g_inodes[current], entries, sizeof(entries));
-        int count = bytes > 0 ? bytes / sizeof(reapfs_dirent_t) : 0;
+static dentry_t *dcache_set(uint32_t parent, uint32_t hash) {
+    return g_dcache[(hash ^ (parent * 2654435761u)) & (DCACHE_SETS - 1)];
+}
 
-        int found = 0;
-        for (int i = 0; i < count; ++i) {
-            if (strncmp(entries[i].name, part, MAX_FILENAME) == 0) {
-                current = (int)entries[i].ino;
-                found = 1;
-                break;
-            }
+static dentry_t *dcache_find(uint32_t parent, const char *name, uint32_t hash) {
+    dentry_t *set = dcache_set(parent, hash);
+    for (int w = 0; w < DCACHE_WAYS; ++w) {
+        dentry_t *d = &set[w];
+        if (d->stamp && d->parent == parent && d->hash == hash
+            && strncmp(d->name, name, MAX_FILENAME) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+static void dcache_insert(uint32_t parent, const char *name, int ino) {
+    uint32_t hash = dir_hash(name);
+    dentry_t *d = dcache_find(parent, name, hash);
+    if (!d) {
+        dentry_t *set = dcache_set(parent, hash);
+        d = &set[0];
+        for (int w = 1; w < DCACHE_WAYS && d->stamp; ++w)
+            if (set[w].stamp < d->stamp) d = &set[w];
+        d->parent = parent;
+        d->hash = hash;
+        strncpy(d->name, name, MAX_FILENAME - 1);
+        d->name[MAX_FILENAME - 1] = '\0';
+    }
+    d->ino = ino;
+    d->stamp = ++g_dcache_clock;
+}
+
+/* Oublie tout ce qui a été vu sous `parent` (répertoire supprimé : son
+ * numéro d'inode sera réutilisé) */
+static void dcache_purge_parent(uint32_t parent) {
+    for (int s = 0; s < DCACHE_SETS; ++s)
+        for (int w = 0; w < DCACHE_WAYS; ++w)
+            if (g_dcache[s][w].parent == parent) g_dcache[s][w].stamp = 0;
+}
+
+static void dcache_clear(void) {
+    memset(g_dcache, 0, sizeof(g_dcache));
+    g_dcache_clock = 0;
+}
+
+static uint32_t dir_blocks(const reapfs_inode_t *dir) {
+    return dir->size / SECTOR_SIZE;
+}
+
+static int dir_read_block(reapfs_inode_t *dir, uint32_t b, reapfs_dirblock_t *blk) {
+    if (file_read_at(dir, b * SECTOR_SIZE, blk, SECTOR_SIZE) != SECTOR_SIZE) return -1;
+    if (crc_check(blk, sizeof(*blk)) != 0) {
+        print_string("FS: directory block checksum mismatch\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int dir_write_block(reapfs_inode_t *dir, uint32_t b, reapfs_dirblock_t *blk) {
+    if (ext_load(dir) != 0) return -1;
+    crc_seal(blk, sizeof(*blk));
+    return ext_io(b, b, (uint8_t*)blk, EXT_META, 0);
+}
+
+/* Répertoire neuf : un seul seau avec . et .. */
+static int dir_init(reapfs_inode_t *dir, uint32_t self, uint32_t parent) {
+    reapfs_dirblock_t blk;
+    memset(&blk, 0, sizeof(blk));
+    strncpy(blk.ent[0].name, ".", MAX_FILENAME - 1);
+    blk.ent[0].ino = self;
+    strncpy(blk.ent[1].name, "..", MAX_FILENAME - 1);
+    blk.ent[1].ino = parent;
+    blk.count = 2;
+    crc_seal(&blk, sizeof(blk));
+    return write_file_data(dir, &blk, SECTOR_SIZE);
+}
+
+/* Entrée à sa place dans le seau b d'une table de nb seaux. Un dédoublement
+ * interrompu (dir_grow) laisse en bas des copies d'entrées déjà recopiées
+ * dans leur seau haut : ignorées partout, effacées au prochain passage */
+static int dir_ent_live(const reapfs_dirent_t *e, uint32_t b, uint32_t nb) {
+    return e->name[0] && (dir_hash(e->name) & (nb - 1)) == b;
+}
+
+/* Cherche `name` dans son seau. Retourne l'ino (ou -1) ; si blk/b/slot
+ * sont fournis, y laisse le seau lu et la position de l'entrée. */
+static int dir_lookup(reapfs_inode_t *dir, const char *name,
+                      reapfs_dirblock_t *blk, uint32_t *b, int *slot) {
+    reapfs_dirblock_t local;
+    if (!blk) blk = &local;
+    uint32_t nb = dir_blocks(dir);
+    if (!dir->is_dir || nb == 0) return -1;
+    uint32_t bucket = dir_hash(name) & (nb - 1);
+    if (dir_read_block(dir, bucket, blk) != 0) return -1;
+    if (b) *b = bucket;
+    for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+        if (blk->ent[i].name[0] && strncmp(blk->ent[i].name, name, MAX_FILENAME) == 0) {
+            if (slot) *slot = i;
+            return (int)blk->ent[i].ino;
         }
-        if (!found) return -1;
     }
-    return current;
+    return -1;
 }
 
-/* Ajoute une entrée dans un répertoire (parent_ino). Retourne 0 ou -1 */
-static int dir_add_entry(uint32_t parent_ino, const char *name, uint32_t child_ino) {
-    if (parent_ino >= MAX_INODES) return -1;
-    if (!g_inodes[parent_ino].is_dir) return -1;
+/* Efface du seau b (déjà lu dans blk) les entrées qui n'y sont plus à leur
+ * place. Retourne le nombre d'entrées effacées, -1 si l'écriture échoue */
+static int dir_purge_block(reapfs_inode_t *dir, uint32_t b, reapfs_dirblock_t *blk) {
+    uint32_t nb = dir_blocks(dir);
+    int n = 0;
+    for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+        if (!blk->ent[i].name[0] || dir_ent_live(&blk->ent[i], b, nb)) continue;
+        memset(&blk->ent[i], 0, sizeof(blk->ent[i]));
+        blk->count--;
+        n++;
+    }
+    if (n > 0 && dir_write_block(dir, b, blk) != 0) return -1;
+    return n;
+}
+
+/* Double la table : les entrées du seau b dont le bit `nb` du hash est à 1
+ * partent dans b + nb.
+ *
+ * Un grand répertoire ne tient pas dans une transaction (512 -> 1024 seaux
+ * épinglerait 1024 secteurs) : jnl_relieve commite en route, et chaque
+ * commit doit laisser un répertoire cohérent. D'abord les seaux hauts, hors
+ * de la taille donc invisibles, les seaux bas intacts ; puis la nouvelle
+ * taille ; enfin l'effacement des copies restées en bas, que dir_ent_live
+ * ignore d'ici là. */
+static int dir_grow(reapfs_inode_t *dir) {
+    uint32_t ino = dir->ino;
+    uint32_t nb = dir_blocks(dir);
+    if (nb * 2 > DIR_MAX_BLOCKS) {
+        print_string("FS: directory full\n");
+        return -1;
+    }
+    /* Un dédoublement interrompu a pu laisser les seaux hauts déjà alloués */
+    if (ext_load(dir) != 0) return -1;
+    uint32_t have = ext_sectors();
+    if (have < nb * 2) {
+        if (ext_grow(nb * 2 - have) != 0) return -1;
+        if (ext_store(dir) != 0) {
+            ext_trim(have, 0);
+            ext_store(dir);
+            return -1;
+        }
+    }
+
+    for (uint32_t b = 0; b < nb; ++b) {
+        reapfs_dirblock_t lo, hi;
+        if ((dir = inode_get(ino)) == NULL || dir_read_block(dir, b, &lo) != 0) return -1;
+        memset(&hi, 0, sizeof(hi));
+        for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+            if (!dir_ent_live(&lo.ent[i], b, nb) || !(dir_hash(lo.ent[i].name) & nb)) continue;
+            hi.ent[i] = lo.ent[i];
+            hi.count++;
+        }
+        if (dir_write_block(dir, b + nb, &hi) != 0) {
+            print_string("FS: ata_write failed\n");
+            return -1;
+        }
+        if (jnl_relieve() != 0) return -1;
+    }
+
+    if ((dir = inode_get(ino)) == NULL) return -1;
+    dir->size = nb * 2 * SECTOR_SIZE;
+    mark_inode_dirty(ino);
+
+    for (uint32_t b = 0; b < nb; ++b) {
+        reapfs_dirblock_t lo;
+        if ((dir = inode_get(ino)) == NULL || dir_read_block(dir, b, &lo) != 0
+            || dir_purge_block(dir, b, &lo) < 0)
+            return -1;
+        if (jnl_relieve() != 0) return -1;
+    }
+    return 0;
+}
 
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[parent_ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
-    if (count >= MAX_DIR_ENTRIES) return -1;
+/* Garantit une place libre pour `name` dans son seau. À appeler avant toute
+ * autre modification de l'opération : dir_grow peut commiter en route, et
+ * ce commit ne doit pas emporter une opération à moitié faite */
+static int dir_make_room(uint32_t parent_ino, const char *name) {
+    for (;;) {
+        reapfs_inode_t *dir = inode_get(parent_ino);
+        if (!dir || !dir->is_dir) return -1;
+        reapfs_dirblock_t blk;
+        uint32_t b = 0;
+        if (dir_lookup(dir, name, &blk, &b, NULL) >= 0) return -1; /* existe déjà */
+        if (blk.count < DIR_ENTRIES_PER_BLOCK) return 0;
+        int purged = dir_purge_block(dir, b, &blk);
+        if (purged < 0) return -1;
+        if (purged > 0) return 0;
+        if (dir_grow(dir) != 0) return -1;
+    }
+}
 
-    strncpy(entries[count].name, name, MAX_FILENAME - 1);
-    entries[count].name[MAX_FILENAME - 1] = '\0';
-    entries[count].ino = child_ino;
-    int nw = write_file_data(&g_inodes[parent_ino], entries, (uint32_t)((count + 1) * sizeof(reapfs_dirent_t)));
-    return nw == 0 ? 0 : -1;
+/* Ajoute une entrée dans un répertoire (parent_ino) : un seul secteur écrit,
+ * sauf quand le seau déborde. Retourne 0 ou -1 */
+static int dir_add_entry(uint32_t parent_ino, const char *name, uint32_t child_ino) {
+    if (dir_make_room(parent_ino, name) != 0) return -1;
+    reapfs_inode_t *dir = inode_get(parent_ino);
+    if (!dir) return -1;
+    reapfs_dirblock_t blk;
+    uint32_t b = 0;
+    if (dir_lookup(dir, name, &blk, &b, NULL) >= 0) return -1;
+    for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+        if (blk.ent[i].name[0]) continue;
+        strncpy(blk.ent[i].name, name, MAX_FILENAME - 1);
+        blk.ent[i].name[MAX_FILENAME - 1] = '\0';
+        blk.ent[i].ino = child_ino;
+        blk.count++;
+        if (dir_write_block(dir, b, &blk) != 0) return -1;
+        dcache_insert(parent_ino, name, (int)child_ino);
+        return 0;
+    }
+    return -1;
 }
 
-/* Retire une entrée d'un répertoire, retourne 0 ou -1 */
+/* Retire une entrée d'un répertoire, sur place. Retourne 0 ou -1 */
 static int dir_remove_entry(uint32_t parent_ino, const char *name) {
-    if (parent_ino >= MAX_INODES) return -1;
-    if (!g_inodes[parent_ino].is_dir) return -1;
-
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[parent_ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
-    int idx = -1;
-    for (int i = 0; i < count; ++i) {
-        if (strncmp(entries[i].name, name, MAX_FILENAME) == 0) { idx = i; break; }
-    }
-    if (idx < 0) return -1;
-    for (int i = idx; i < count - 1; ++i) entries[i] = entries[i+1];
-    if (count - 1 == 0) {
-        if (write_file_data(&g_inodes[parent_ino], NULL, 0) != 0) return -1;
-    } else {
-        if (write_file_data(&g_inodes[parent_ino], entries, (uint32_t)((count - 1) * sizeof(reapfs_dirent_t))) != 0) return -1;
+    reapfs_inode_t *dir = inode_get(parent_ino);
+    if (!dir) return -1;
+    reapfs_dirblock_t blk;
+    uint32_t b;
+    int slot;
+    if (dir_lookup(dir, name, &blk, &b, &slot) < 0) return -1;
+    memset(&blk.ent[slot], 0, sizeof(blk.ent[slot]));
+    blk.count--;
+    /* Négative même si l'écriture échoue : le disque fera foi au prochain coup */
+    dcache_insert(parent_ino, name, -1);
+    return dir_write_block(dir, b, &blk);
+}
+
+/* Nombre d'entrées (. et .. compris), arrêt dès que `stop` est atteint */
+static uint32_t dir_count(reapfs_inode_t *dir, uint32_t stop) {
+    uint32_t n = 0;
+    uint32_t nb = dir_blocks(dir);
+    for (uint32_t b = 0; b < nb && n < stop; ++b) {
+        reapfs_dirblock_t blk;
+        if (dir_read_block(dir, b, &blk) != 0) return stop;
+        for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i)
+            if (dir_ent_live(&blk.ent[i], b, nb)) n++;
     }
-    return 0;
+    return n;
+}
+
+/* Un composant de chemin : cache de dentries d'abord, seau sur disque sinon */
+static int dir_resolve(uint32_t parent_ino, const char *name) {
+    reapfs_inode_t *dir = inode_get(parent_ino);
+    if (!dir || !dir->is_dir) return -1;
+    dentry_t *d = dcache_find(parent_ino, name, dir_hash(name));
+    if (d) {
+        g_dcache_hits++;
+        d->stamp = ++g_dcache_clock;
+        return d->ino;
+    }
+    g_dcache_misses++;
+    int ino = dir_lookup(dir, name, NULL, NULL, NULL);
+    dcache_insert(parent_ino, name, ino);
+    return ino;
+}
+
+/* find_inode_by_path: parcours hiérarchique composant par composant,
+ * depuis la racine pour un chemin absolu, depuis l'inode du cwd sinon.
+ * . et .. sont les vraies entrées du répertoire (donc aussi en cache).
+ */
+static int find_inode_by_path(const char *path) {
+    if (!path) return -1;
+    const char *p = path;
+    int current = p[0] == '/' ? 0 : g_cwd_ino;
+    char part[MAX_FILENAME];
+
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+        size_t lenp = 0;
+        while (*p && *p != '/' && lenp + 1 < sizeof(part)) part[lenp++] = *p++;
+        part[lenp] = '\0';
+        while (*p && *p != '/') p++;   /* nom tronqué comme à la création */
+
+        reapfs_inode_t *node = inode_get((uint32_t)current);
+        if (!node || !node->is_dir) return -1;
+        if (strcmp(part, ".") == 0) continue;
+
+        current = dir_resolve((uint32_t)current, part);
+        /* Entrée vers un inode libre ou en quarantaine : introuvable */
+        if (current < 0) return -1;
+        node = inode_get((uint32_t)current);
+        if (!node || !node->used) return -1;
+    }
+    return current;
 }
 
 /* ---------- API exposée attendue par main.c (adaptée pour chemins) ---------- */
 
+/* Oublie le montage courant ; en write-back, ce qui reste de l'ancien
+ * montage est d'abord écrit */
+static void fs_reset(void) {
+    if (bcache_writeback_enabled()) sync_all();
+    icache_clear();
+    g_ino_hint = 1;
+    memset(g_ra, 0, sizeof(g_ra));
+    memset(g_files, 0, sizeof(g_files));
+    g_ext_owner = -1;
+    g_zc_ino = -1;
+    dcache_clear();
+    bcache_invalidate();
+    bcache_set_pin_flush(jnl_pin_flush);
+    g_meta_dirty = 0;
+    g_super_dirty = 0;
+    g_meta_pending = 0;
+    memset(g_bm_dirty, 0, sizeof(g_bm_dirty));
+    memset(g_ibm_dirty, 0, sizeof(g_ibm_dirty));
+    bcache_set_writeback(1);
+    g_last_sync_ms = timer_ms();
+    g_cwd_ino = 0;
+    strncpy(g_cwd_path, "/", MAX_PATH-1);
+    g_cwd_path[MAX_PATH-1] = '\0';
+}
+
 int fs_init(void) {
     print_string("FS: start\n");
-    memset(g_inode_used, 0, sizeof(g_inode_used));
-    memset(g_inodes, 0, sizeof(g_inodes));
-    if (load_super() == 0) {
+    fs_reset();
+    int r = load_super();
+    if (r == -2) {
+        /* Ne rien écrire : le volume reste tel quel pour fsck. Seul un
+         * formatage explicite (fs_format, mkfs.reapfs) peut l'effacer */
+        memset(&g_super, 0, sizeof(g_super));   /* inode_count 0 : inode_get rend NULL */
+        icache_clear();
+        g_free_inodes = 0;
+        g_jdefer_n = 0;
+        bcache_invalidate();
+        print_string("FS: volume not mounted (fsck to inspect, formate to erase)\n");
+        return -1;
+    }
+    if (r == 0) {
         print_string("FS: load_super ok\n");
-        /* ensure cwd valid */
-        g_cwd_ino = 0;
-        strncpy(g_cwd_path, "/", MAX_PATH-1);
-        g_cwd_path[MAX_PATH-1] = '\0';
         return 0;
     }
-    if (format_super(MAX_INODES) != 0) {
+    /* Pas de magic : disque vierge, rien à perdre */
+    if (format_super(0) != 0) {
+        print_string("FS: format failed\n");
+        return -1;
+    }
+    print_string("FS: formatted and initialized\n");
+    return 0;
+}
+
+int fs_format(void) {
+    print_string("FS: formatting\n");
+    fs_reset();
+    if (format_super(0) != 0) {
         print_string("FS: format failed\n");
         return -1;
     }
@@ -554,67 +2084,144 @@ int fs_create(const char *path) {
         return -1;
 
     int parent_ino = find_inode_by_path(parent);
-    if (parent_ino < 0 || !g_inodes[parent_ino].is_dir)
+    if (parent_ino < 0 || !fs_is_dir((uint32_t)parent_ino))
         return -1;
 
     // Vérifie que le fichier n'existe pas déjà
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[parent_ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
-    for (int i = 0; i < count; ++i) {
-        if (strncmp(entries[i].name, name, MAX_FILENAME) == 0)
-            return -1; // existe déjà
+    if (dir_resolve((uint32_t)parent_ino, name) >= 0)
+        return -1;
+
+    /* Le seau d'abord : son dédoublement peut commiter (dir_grow) */
+    if (dir_make_room((uint32_t)parent_ino, name) != 0) {
+        op_end();
+        return -1;
     }
 
     int ino = alloc_inode();
-    if (ino < 0) return -1;
+    if (ino < 0) {
+        op_end();
+        return -1;
+    }
 
-    reapfs_inode_t *node = &g_inodes[ino];
+    reapfs_inode_t *node = inode_get((uint32_t)ino);
     node->is_dir = 0;
+    if (g_compress) node->flags |= INODE_F_LZ4;
     strncpy(node->name, name, MAX_FILENAME - 1);
     node->name[MAX_FILENAME - 1] = '\0';
     node->size = 0;
 
     if (dir_add_entry((uint32_t)parent_ino, name, (uint32_t)ino) != 0) {
         free_inode((uint32_t)ino);
+        op_end();
         return -1;
     }
 
-    save_super();
+    mark_inode_dirty((uint32_t)ino);
+    if (op_end() != 0) return -1;
     return ino;
 }
 
 
-/* Open file by path -> returns inode number as "fd" or -1 */
-reapfs_fd_t fs_open(const char *path, int write) {
-    (void)write;
+static open_file_t *file_of(reapfs_fd_t fd) {
+    if (fd < 0 || fd >= FS_MAX_OPEN || !g_files[fd].used) return NULL;
+    return &g_files[fd];
+}
+
+/* Open file by path -> returns a descriptor or -1. Les répertoires ne
+ * s'ouvrent qu'en lecture. */
+reapfs_fd_t fs_open(const char *path, int flags) {
     if (!path) return -1;
 
-    char abs[MAX_PATH];
-    if (normalize_path_abs(path, abs, sizeof(abs)) != 0)
+    int ino = find_inode_by_path(path);
+    if (ino < 0) return -1;
+    reapfs_inode_t *node = inode_get((uint32_t)ino);
+    if (!node) return -1;
+    if (node->is_dir && (flags & (FS_O_WRITE | FS_O_TRUNC))) return -1;
+
+    int fd = 0;
+    while (fd < FS_MAX_OPEN && g_files[fd].used) fd++;
+    if (fd == FS_MAX_OPEN) {
+        print_string("FS: too many open files\n");
         return -1;
+    }
+
+    if ((flags & FS_O_TRUNC) && node->size > 0) {
+        int r = write_file_data(node, NULL, 0);
+        if (op_end() != 0 || r != 0) return -1;
+    }
+
+    g_files[fd].used = 1;
+    g_files[fd].flags = (uint8_t)flags;
+    g_files[fd].ino = (uint32_t)ino;
+    g_files[fd].pos = 0;
+    return fd;
+}
+
+/* Écrit à l'offset donné sans toucher au curseur. Returns bytes written or -1 */
+int fs_pwrite(reapfs_fd_t fd, const void *buf, uint32_t size, uint32_t off) {
+    open_file_t *f = file_of(fd);
+    if (!f || !(f->flags & FS_O_WRITE)) return -1;
+    int r = file_write_at(inode_get(f->ino), off, buf, size);
+    if (op_end() != 0) r = -1;
+    return r == 0 ? (int)size : -1;
+}
 
-    return find_inode_by_path(abs);
+/* Lit à l'offset donné sans toucher au curseur. Returns bytes read or -1 */
+int fs_pread(reapfs_fd_t fd, void *buf, uint32_t size, uint32_t off) {
+    open_file_t *f = file_of(fd);
+    if (!f) return -1;
+    return file_read_at(inode_get(f->ino), off, buf, size);
 }
 
+/* Write at the cursor (at the end with FS_O_APPEND). Returns bytes written or -1 */
+int fs_write(reapfs_fd_t fd, const void *buf, uint32_t size) {
+    open_file_t *f = file_of(fd);
+    if (!f) return -1;
+    if (f->flags & FS_O_APPEND) {
+        reapfs_inode_t *node = inode_get(f->ino);
+        if (!node) return -1;
+        f->pos = node->size;
+    }
+    int w = fs_pwrite(fd, buf, size, f->pos);
+    if (w > 0) f->pos += (uint32_t)w;
+    return w;
+}
 
-/* Write to file by "fd" (inode number). Returns bytes written or -1 */
-int fs_write(int fd, const void *buf, uint32_t size) {
-    if (fd < 0 || (uint32_t)fd >= g_super.inode_count) return -1;
-    if (!g_inode_used[fd]) return -1;
-    return write_file_data(&g_inodes[fd], buf, size) == 0 ? (int)size : -1;
+/* Read at the cursor. Returns bytes read or -1 */
+int fs_read(reapfs_fd_t fd, void *buf, uint32_t buf_size) {
+    open_file_t *f = file_of(fd);
+    if (!f) return -1;
+    int r = file_read_at(inode_get(f->ino), f->pos, buf, buf_size);
+    if (r > 0) f->pos += (uint32_t)r;
+    return r;
 }
 
-/* Read from file by "fd" (inode number). Returns bytes read or -1 */
-int fs_read(int fd, void *buf, uint32_t buf_size) {
-    if (fd < 0 || (uint32_t)fd >= g_super.inode_count) return -1;
-    if (!g_inode_used[fd]) return -1;
-    return read_file_data(&g_inodes[fd], buf, buf_size);
+/* Déplace le curseur ; retourne la nouvelle position ou -1 */
+int fs_lseek(reapfs_fd_t fd, int32_t off, int whence) {
+    open_file_t *f = file_of(fd);
+    if (!f) return -1;
+    int64_t base;
+    reapfs_inode_t *node;
+    switch (whence) {
+        case FS_SEEK_SET: base = 0; break;
+        case FS_SEEK_CUR: base = f->pos; break;
+        case FS_SEEK_END:
+            node = inode_get(f->ino);
+            if (!node) return -1;
+            base = node->size;
+            break;
+        default: return -1;
+    }
+    int64_t pos = base + off;
+    if (pos < 0 || pos > 0x7FFFFFFF) return -1;
+    f->pos = (uint32_t)pos;
+    return (int)pos;
 }
 
-/* Close (noop) */
+/* Libère le descripteur */
 void fs_close(reapfs_fd_t fd) {
-    (void)fd;
+    open_file_t *f = file_of(fd);
+    if (f) f->used = 0;
 }
 
 /* Remove file or empty directory by path */
@@ -633,31 +2240,23 @@ int fs_remove(const char *path) {
     int parent_ino = find_inode_by_path(parent);
     if (parent_ino < 0) return -1;
 
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[parent_ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
-    int target = -1;
-
-    for (int i = 0; i < count; ++i)
-        if (strncmp(entries[i].name, name, MAX_FILENAME) == 0)
-            target = (int)entries[i].ino;
-
+    int target = dir_resolve((uint32_t)parent_ino, name);
     if (target < 0) return -1;
 
+    reapfs_inode_t *node = inode_get((uint32_t)target);
+    if (!node) return -1;
+    int is_dir = node->is_dir;
+
     // Vérifie si répertoire vide (hors . et ..)
-    if (g_inodes[target].is_dir) {
-        reapfs_dirent_t tmp[MAX_DIR_ENTRIES];
-        int b = read_file_data(&g_inodes[target], tmp, sizeof(tmp));
-        int c = b > 0 ? b / (int)sizeof(reapfs_dirent_t) : 0;
-        if (c > 2) return -1; // non vide
-    }
+    if (is_dir && dir_count(node, 3) > 2)
+        return -1; // non vide
 
     if (dir_remove_entry((uint32_t)parent_ino, name) != 0)
         return -1;
 
+    if (is_dir) dcache_purge_parent((uint32_t)target);
     free_inode((uint32_t)target);
-    save_super();
-    return 0;
+    return op_end();
 }
 
 
@@ -672,28 +2271,33 @@ int fs_ls(const char *path, char *out, size_t out_sz) {
         strncpy(abs, g_cwd_path, sizeof(abs));
 
     ino = find_inode_by_path(abs);
-    if (ino < 0) return -1;
-    if (!g_inodes[ino].is_dir) return -1;
-
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
+    reapfs_inode_t *dir = ino < 0 ? NULL : inode_get((uint32_t)ino);
+    if (!dir || !dir->is_dir) return -1;
 
     print_string("FS: listing ");
     print_string(abs);
     print_string("\n");
 
-    for (int i = 0; i < count; ++i) {
-        // 🔽 Ignorer . et ..
-        if (strcmp(entries[i].name, ".") == 0 || strcmp(entries[i].name, "..") == 0)
-            continue;
-
-        print_string(" - ");
-        print_string(entries[i].name);
-        if (g_inodes[entries[i].ino].is_dir)
-            print_string("/\n");
-        else
-            print_string("\n");
+    /* Ordre des seaux puis des emplacements : stable tant que rien ne change.
+     * Le répertoire est repris à chaque seau : les fs_is_dir des entrées
+     * peuvent le sortir du cache d'inodes. */
+    uint32_t nb = dir_blocks(dir);
+    for (uint32_t b = 0; b < nb; ++b) {
+        reapfs_dirblock_t blk;
+        if (dir_read_block(inode_get((uint32_t)ino), b, &blk) != 0) return -1;
+        for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+            reapfs_dirent_t *e = &blk.ent[i];
+            // 🔽 Ignorer . et .. (et les emplacements libres)
+            if (!dir_ent_live(e, b, nb) || strcmp(e->name, ".") == 0 || strcmp(e->name, "..") == 0)
+                continue;
+
+            print_string(" - ");
+            print_string(e->name);
+            if (fs_is_dir(e->ino))
+                print_string("/\n");
+            else
+                print_string("\n");
+        }
     }
     return 0;
 }
@@ -713,49 +2317,46 @@ int fs_mkdir(const char *path) {
         return -1;
 
     int parent_ino = find_inode_by_path(parent);
-    if (parent_ino < 0 || !g_inodes[parent_ino].is_dir)
+    if (parent_ino < 0 || !fs_is_dir((uint32_t)parent_ino))
         return -1;
 
     // Vérifie que le répertoire n'existe pas déjà
-    reapfs_dirent_t entries[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[parent_ino], entries, sizeof(entries));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
-    for (int i = 0; i < count; ++i)
-        if (strncmp(entries[i].name, name, MAX_FILENAME) == 0)
-            return -1;
+    if (dir_resolve((uint32_t)parent_ino, name) >= 0)
+        return -1;
+
+    /* Le seau d'abord : son dédoublement peut commiter (dir_grow) */
+    if (dir_make_room((uint32_t)parent_ino, name) != 0) {
+        op_end();
+        return -1;
+    }
 
     int ino = alloc_inode();
-    if (ino < 0) return -1;
+    if (ino < 0) {
+        op_end();
+        return -1;
+    }
 
-    reapfs_inode_t *node = &g_inodes[ino];
+    reapfs_inode_t *node = inode_get((uint32_t)ino);
     node->is_dir = 1;
     strncpy(node->name, name, MAX_FILENAME - 1);
     node->name[MAX_FILENAME - 1] = '\0';
     node->size = 0;
 
     // Initialise les entrées . et ..
-    reapfs_dirent_t init_entries[2];
-    strncpy(init_entries[0].name, ".", MAX_FILENAME - 1);
-    init_entries[0].name[MAX_FILENAME - 1] = '\0';
-    init_entries[0].ino = (uint32_t)ino;
-
-    strncpy(init_entries[1].name, "..", MAX_FILENAME - 1);
-    init_entries[1].name[MAX_FILENAME - 1] = '\0';
-    init_entries[1].ino = (uint32_t)parent_ino;
-
-    if (write_file_data(node, init_entries, (uint32_t)sizeof(init_entries)) != 0) {
+    if (dir_init(node, (uint32_t)ino, (uint32_t)parent_ino) != 0) {
         free_inode((uint32_t)ino);
+        op_end();
         return -1;
     }
 
-    node->size = (uint32_t)sizeof(init_entries);
-
     if (dir_add_entry((uint32_t)parent_ino, name, (uint32_t)ino) != 0) {
         free_inode((uint32_t)ino);
+        op_end();
         return -1;
     }
 
-    save_super();
+    mark_inode_dirty((uint32_t)ino);
+    if (op_end() != 0) return -1;
     print_string("FS: mkdir ok\n");
     return ino;
 }
@@ -764,24 +2365,147 @@ int fs_mkdir(const char *path) {
 /* debug print */
 void fs_debug_print(void) {
     print_string("FS: debug\n");
-    for (uint32_t i = 0; i < g_super.inode_count && i < MAX_INODES; ++i) {
-        if (g_inode_used[i]) {
+    {
+        char tmp[64];
+        snprintf(tmp, sizeof(tmp), " volume=%d secteurs, data@%d, libres=%d\n",
+                 (int)g_super.total_sectors, (int)g_super.data_start_sector,
+                 (int)g_super.free_sectors);
+        print_string(tmp);
+        const bcache_stats_t *cs = bcache_get_stats();
+        snprintf(tmp, sizeof(tmp), " cache: %d hits, %d miss, %d/%d secteurs, %d sales\n",
+                 (int)cs->hits, (int)cs->misses, (int)cs->used, (int)cs->budget, (int)cs->dirty);
+        print_string(tmp);
+        snprintf(tmp, sizeof(tmp), " dentries: %d hits, %d miss\n",
+                 (int)g_dcache_hits, (int)g_dcache_misses);
+        print_string(tmp);
+        snprintf(tmp, sizeof(tmp), " journal: %d/%d, seq %d, %d commits\n",
+                 (int)g_jhead, (int)jnl_log_size(), (int)g_jseq, (int)g_jcommits);
+        print_string(tmp);
+        snprintf(tmp, sizeof(tmp), " lz4: %s\n", g_compress ? "nouveaux fichiers" : "non");
+        print_string(tmp);
+        snprintf(tmp, sizeof(tmp), " crc32c: %s, %d erreurs\n",
+                 crc32c_hw() ? "sse4.2" : "tables", (int)g_crc_errors);
+        print_string(tmp);
+        snprintf(tmp, sizeof(tmp), " inodes: %d (%d libres), cache %d hits, %d miss\n",
+                 (int)g_super.inode_count, (int)g_free_inodes,
+                 (int)g_icache_hits, (int)g_icache_misses);
+        print_string(tmp);
+    }
+    for (uint32_t i = 0; i < g_super.inode_count; ++i) {
+        reapfs_inode_t *node = inode_get(i);
+        if (!node) break;
+        if (node->used) {
             print_string(" ino=");
             char tmp[32];
             snprintf(tmp, sizeof(tmp), "%u", i);
             print_string(tmp);
             print_string(" name=");
-            print_string(g_inodes[i].name);
-            print_string(g_inodes[i].is_dir ? " (dir)\n" : "\n");
+            print_string(node->name);
+            if (node->flags & INODE_F_LZ4) print_string(" (lz4)");
+            print_string(node->is_dir ? " (dir)\n" : "\n");
         }
     }
 }
 
+/* ---------- fsck ---------- */
+
+/* À travers le cache sans le remplir : les secteurs présents (sales
+ * compris) font foi, les autres viennent du disque */
+static int ck_read(void *ctx, uint32_t lba, void *buf, uint32_t count) {
+    (void)ctx;
+    int r = bcache_queue_read(lba, (uint8_t*)buf, count, 1);
+    if (bcache_complete() != 0) r = -1;
+    return r;
+}
+
+static void ck_report(void *ctx, const char *msg) {
+    (void)ctx;
+    print_string("fsck: ");
+    print_string(msg);
+}
+
+/* Zone de travail du contrôle : prise au pfa, rendue à la fin de fs_check */
+static uintptr_t g_ck_work = 0;
+static uint32_t g_ck_work_frames = 0;
+
+static void *ck_alloc(void *ctx, uint32_t bytes) {
+    (void)ctx;
+    g_ck_work_frames = (bytes + PFA_FRAME_SIZE - 1) / PFA_FRAME_SIZE;
+    g_ck_work = pfa_alloc_run(g_ck_work_frames);
+    return (void*)g_ck_work;
+}
+
+int fs_check(void) {
+    reapfs_check_t ck;
+    memset(&ck, 0, sizeof(ck));
+    ck.read = ck_read;
+    ck.report = ck_report;
+    ck.alloc = ck_alloc;
+    /* g_zdisk ne sert qu'au milieu d'une opération sur un fichier LZ4 */
+    ck.buf = g_zdisk;
+    ck.buf_sectors = ZCHUNK_SECTORS;
+    uint64_t dev = ata_sector_count();   /* 0 : inconnue */
+    ck.dev_sectors = dev > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)dev;
+    /* Monté : tout ce qui est en mémoire passe au disque (journal compris),
+     * sinon le contrôle verrait des bitmaps en retard */
+    ck.live = g_super.magic == FS_SUPER_MAGIC;
+    if (ck.live && sync_all() != 0) return -1;
+
+    g_ck_work_frames = 0;
+    int r = reapfs_check(&ck);
+    int no_memory = g_ck_work_frames && !g_ck_work;   /* déjà signalé par le contrôle */
+    if (g_ck_work) pfa_free_run(g_ck_work, g_ck_work_frames);
+    g_ck_work = 0;
+    if (r != 0) {
+        if (!no_memory) print_string("fsck: volume unreadable\n");
+        return -1;
+    }
+    char tmp[96];
+    snprintf(tmp, sizeof(tmp), "fsck: %d files, %d directories, %d data sectors in use\n",
+             (int)ck.files, (int)ck.dirs, (int)ck.used_sectors);
+    print_string(tmp);
+    snprintf(tmp, sizeof(tmp), "fsck: %d errors, %d warnings\n", (int)ck.errors, (int)ck.warnings);
+    print_string(tmp);
+    return (int)ck.errors;
+}
+
+/* Écrit tout ce qui est en cache (métadonnées et données) puis FLUSH CACHE */
+int fs_sync(void) {
+    return sync_all();
+}
+
+/* 1 = write-back (défaut), 0 = write-through ; repasser en write-through synchronise */
+void fs_set_writeback(int on) {
+    if (!on && bcache_writeback_enabled()) {
+        sync_all();
+        bcache_set_writeback(0);
+        return;
+    }
+    bcache_set_writeback(on);
+}
+
+/* Les fichiers existants gardent leur mode : seuls les suivants changent */
+void fs_set_compression(int on) {
+    g_compress = on ? 1 : 0;
+}
+
+/* Appelé en boucle d'attente (clavier) : sync si des écritures attendent
+ * depuis plus de FS_WRITEBACK_DELAY_MS. Sans PIT, seul fs_sync() écrit. */
+void fs_writeback_tick(void) {
+    if (!g_meta_dirty && bcache_get_stats()->dirty == 0) return;
+    if (!timer_running()) return;
+    if (timer_ms() - g_last_sync_ms < FS_WRITEBACK_DELAY_MS) return;
+    sync_all();
+}
+
 /* utility to create file with content in one call */
 int fs_create_with_data(const char *path, const void *data, uint32_t size) {
     int ino = fs_create(path);
     if (ino < 0) return -1;
-    if (fs_write(ino, data, size) < 0) {
+    reapfs_fd_t fd = fs_open(path, FS_O_WRITE);
+    int w = fs_write(fd, data, size);
+    fs_close(fd);
+    if (w < 0) {
         fs_remove(path);
         return -1;
     }
@@ -794,7 +2518,7 @@ int fs_create_with_data(const char *path, const void *data, uint32_t size) {
 int fs_chdir(const char *path) {
     if (!path) return -1;
     int ino = find_inode_by_path(path);
-    if (ino < 0 || !g_inodes[ino].is_dir) return -1;
+    if (ino < 0 || !fs_is_dir((uint32_t)ino)) return -1;
     g_cwd_ino = ino;
     /* mettre à jour g_cwd_path */
     if (normalize_path_abs(path, g_cwd_path, sizeof(g_cwd_path)) != 0) return -1;
@@ -808,8 +2532,31 @@ const char *fs_get_cwd(void) {
 
 /* Renvoie 1 si l’inode est un répertoire, sinon 0 */
 int fs_is_dir(uint32_t ino) {
-    if (ino >= MAX_INODES) return 0;
-    return g_inodes[ino].is_dir ? 1 : 0;
+    reapfs_inode_t *node = inode_get(ino);
+    return node && node->is_dir ? 1 : 0;
+}
+
+int fs_stat(const char *path, fs_stat_t *st) {
+    char abs[MAX_PATH];
+    if (!path || !st || normalize_path_abs(path, abs, sizeof(abs)) != 0) return -1;
+    int ino = find_inode_by_path(abs);
+    reapfs_inode_t *node = ino < 0 ? NULL : inode_get((uint32_t)ino);
+    if (!node || !node->used) return -1;
+    st->ino = node->ino;
+    st->size = node->size;
+    st->is_dir = node->is_dir;
+    st->compressed = (node->flags & INODE_F_LZ4) ? 1 : 0;
+    st->sectors = ext_load(node) == 0 ? ext_sectors() : 0;
+    return 0;
+}
+
+int fs_statfs(fs_statfs_t *st) {
+    if (!st || g_super.magic != FS_SUPER_MAGIC) return -1;
+    st->data_sectors = g_super.total_sectors - g_super.data_start_sector;
+    st->free_sectors = g_super.free_sectors;
+    st->inode_count = g_super.inode_count;
+    st->free_inodes = g_free_inodes;
+    return 0;
 }
 
 /* Liste le contenu du répertoire courant dans un tableau fs_entry_t */
@@ -818,22 +2565,25 @@ int fs_list_dir(fs_entry_t *entries, int max_entries) {
 
     // Utiliser le répertoire courant (et non /)
     int ino = g_cwd_ino;
-    if (ino < 0 || ino >= MAX_INODES) return -1;
-    if (!g_inodes[ino].is_dir) return -1;
-
-    reapfs_dirent_t raw[MAX_DIR_ENTRIES];
-    int bytes = read_file_data(&g_inodes[ino], raw, sizeof(raw));
-    int count = bytes > 0 ? bytes / (int)sizeof(reapfs_dirent_t) : 0;
+    reapfs_inode_t *dir = ino < 0 ? NULL : inode_get((uint32_t)ino);
+    if (!dir || !dir->is_dir) return -1;
 
+    /* Répertoire repris à chaque seau, comme dans fs_ls */
     int j = 0;
-    for (int i = 0; i < count && j < max_entries; ++i) {
-        if (strcmp(raw[i].name, ".") == 0 || strcmp(raw[i].name, "..") == 0)
-            continue;
-        strncpy(entries[j].name, raw[i].name, MAX_FILENAME - 1);
-        entries[j].name[MAX_FILENAME - 1] = '\0';
-        entries[j].ino = raw[i].ino;
-        entries[j].is_dir = g_inodes[raw[i].ino].is_dir ? 1 : 0;
-        j++;
+    uint32_t nb = dir_blocks(dir);
+    for (uint32_t b = 0; b < nb && j < max_entries; ++b) {
+        reapfs_dirblock_t blk;
+        if (dir_read_block(inode_get((uint32_t)ino), b, &blk) != 0) return -1;
+        for (int i = 0; i < DIR_ENTRIES_PER_BLOCK && j < max_entries; ++i) {
+            reapfs_dirent_t *raw = &blk.ent[i];
+            if (!dir_ent_live(raw, b, nb) || strcmp(raw->name, ".") == 0 || strcmp(raw->name, "..") == 0)
+                continue;
+            strncpy(entries[j].name, raw->name, MAX_FILENAME - 1);
+            entries[j].name[MAX_FILENAME - 1] = '\0';
+            entries[j].ino = raw->ino;
+            entries[j].is_dir = (uint8_t)fs_is_dir(raw->ino);
+            j++;
+        }
     }
 
     return j; // nombre d'entrées trouvées
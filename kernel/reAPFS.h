@@ -54,11 +54,19 @@ typedef int reapfs_fd_t;
 /* === API publique === */
 
 /**
- * Initialise le FS. Charge le superblock si existant, sinon formate le disque.
+ * Initialise le FS. Charge le superblock si existant, formate un disque
+ * vierge (sans magic), refuse un volume abîmé ou d'une autre version.
  * Retourne FS_OK si succès, FS_ERR sinon.
  */
 int fs_init(void);
 
+/**
+ * Efface le disque et crée un volume vide, même sur un volume reAPFS
+ * existant (fs_init refuse d'y toucher s'il est abîmé ou d'une autre
+ * version). Retourne FS_OK si succès, FS_ERR sinon.
+ */
+int fs_format(void);
+
 /**
  * Crée un fichier vide avec le nom donné.
  * Retourne l’inode index (>=0) ou FS_ERR.
@@ -78,29 +86,55 @@ int fs_remove(const char *path);
 int fs_mkdir(const char *path);
 
 // normalise le chemin pour des utilisations comme dans fs_ls ...
-normalize_path_abs(const char *path_in, char *out, size_t out_sz);
+int normalize_path_abs(const char *path_in, char *out, size_t out_sz);
+
+/* Drapeaux de fs_open */
+#define FS_O_RDONLY 0
+#define FS_O_WRITE  1   /* écriture autorisée */
+#define FS_O_TRUNC  2   /* vide le fichier à l'ouverture */
+#define FS_O_APPEND 4   /* fs_write écrit toujours en fin de fichier */
+
+/* Origine de fs_lseek */
+#define FS_SEEK_SET 0
+#define FS_SEEK_CUR 1
+#define FS_SEEK_END 2
 
 /**
- * Ouvre un fichier (lecture/écriture selon `write`).
+ * Ouvre un fichier selon `flags` (FS_O_*), curseur à 0.
  * Retourne un descripteur (>=0) ou FS_ERR si échec.
  */
-reapfs_fd_t fs_open(const char *name, int write);
+reapfs_fd_t fs_open(const char *name, int flags);
 
 /**
- * Lit `sz` octets du fichier référencé par `fd` dans `buf`.
+ * Lit `sz` octets du fichier référencé par `fd` dans `buf`, depuis le
+ * curseur, qui avance d'autant.
  * Retourne le nombre d’octets lus ou FS_ERR.
  */
-int fs_read(reapfs_fd_t fd, void *buf, size_t sz);
+int fs_read(reapfs_fd_t fd, void *buf, uint32_t sz);
 
 /**
- * Écrit `sz` octets du buffer `buf` dans le fichier `fd`.
+ * Écrit `sz` octets du buffer `buf` dans le fichier `fd` au curseur, qui
+ * avance d'autant. Le fichier grandit si besoin.
  * Retourne le nombre d’octets écrits ou FS_ERR.
  */
-int fs_write(reapfs_fd_t fd, const void *buf, size_t sz);
+int fs_write(reapfs_fd_t fd, const void *buf, uint32_t sz);
 
 /**
- * Ferme un fichier (actuellement no-op).
- * Toujours retourne FS_OK.
+ * Lecture / écriture à l'offset `off`, sans toucher au curseur. Seuls les
+ * secteurs concernés sont lus ou écrits.
+ * Retourne le nombre d’octets transférés ou FS_ERR.
+ */
+int fs_pread(reapfs_fd_t fd, void *buf, uint32_t sz, uint32_t off);
+int fs_pwrite(reapfs_fd_t fd, const void *buf, uint32_t sz, uint32_t off);
+
+/**
+ * Place le curseur à `off` relativement à `whence` (FS_SEEK_*).
+ * Retourne la nouvelle position ou FS_ERR.
+ */
+int fs_lseek(reapfs_fd_t fd, int32_t off, int whence);
+
+/**
+ * Ferme un fichier et libère son descripteur.
  */
 void fs_close(reapfs_fd_t fd);
 
@@ -116,6 +150,35 @@ int fs_ls(const char *path, char *out, size_t out_sz);
  */
 void fs_debug_print(void);
 
+/**
+ * Contrôle de cohérence du volume, en lecture seule (commande fsck).
+ * Le volume monté est d'abord synchronisé ; un volume refusé au montage
+ * est lu tel quel. Retourne le nombre d'erreurs, -1 si illisible.
+ */
+int fs_check(void);
+
+/**
+ * Écrit les métadonnées et les blocs sales du cache, puis FLUSH CACHE.
+ * Retourne FS_OK si succès, FS_ERR sinon.
+ */
+int fs_sync(void);
+
+/**
+ * Write-back (1, défaut) ou write-through (0).
+ */
+void fs_set_writeback(int on);
+
+/**
+ * Compression LZ4 (1) ou non (0, défaut) des fichiers créés ensuite.
+ * Transparente pour fs_read/fs_write ; les répertoires ne sont jamais compressés.
+ */
+void fs_set_compression(int on);
+
+/**
+ * Sync périodique : à appeler depuis les boucles d'attente.
+ */
+void fs_writeback_tick(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -136,5 +199,32 @@ int fs_list_dir(fs_entry_t *entries, int max_entries);
 /* Retourne 1 si un inode est un répertoire, 0 sinon */
 int fs_is_dir(uint32_t ino);
 
+typedef struct {
+    uint32_t ino;
+    uint32_t size;         /* octets (répertoire : taille de sa table) */
+    uint32_t sectors;      /* secteurs alloués, compressés le cas échéant */
+    uint8_t is_dir;
+    uint8_t compressed;
+} fs_stat_t;
+
+/* Attributs d'un chemin : FS_OK, ou FS_ERR s'il n'existe pas */
+int fs_stat(const char *path, fs_stat_t *st);
+
+typedef struct {
+    uint32_t data_sectors;   /* zone de données */
+    uint32_t free_sectors;
+    uint32_t inode_count;
+    uint32_t free_inodes;
+} fs_statfs_t;
+
+/* Occupation du volume monté : FS_OK ou FS_ERR */
+int fs_statfs(fs_statfs_t *st);
+
+/* Change le répertoire courant (chemin relatif ou absolu) : FS_OK ou FS_ERR */
+int fs_chdir(const char *path);
+
+/* Chemin absolu du répertoire courant (chaîne interne, lecture seule) */
+const char *fs_get_cwd(void);
+
 
 #endif /* REAPFS_H */
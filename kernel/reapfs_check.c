@@ -0,0 +1,682 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "reapfs_check.h"
+#include "crc32c.h"
+#include "utils.h"
+
+/* État par inode, rempli par la table puis par le parcours de l'arbre */
+#define CK_USED 1
+#define CK_DIR  2
+#define CK_REF  4    /* une entrée de répertoire le désigne */
+#define CK_BAD  8    /* contenu illisible : ni parcouru ni comparé à la bitmap */
+
+/* Au-delà, les défauts sont comptés sans être décrits */
+#define CK_MAX_REPORTS 200
+
+/* Tables taillées sur la géométrie du volume, dans la zone de travail
+ * fournie par ck->alloc */
+static uint8_t *g_ck_state;
+static uint32_t *g_ck_parent;                      /* répertoire qui le référence */
+static uint32_t *g_ck_owned;                       /* 1 bit par secteur revendiqué */
+static uint32_t *g_ck_queue;                       /* répertoires à voir (reapfs_check) */
+static uint32_t g_ck_ninodes = 0;                  /* inodes couverts par les tables */
+static uint32_t g_ck_nsectors = 0;                 /* secteurs couverts par g_ck_owned */
+static uint32_t g_ck_qhead = 0;
+static uint32_t g_ck_qtail = 0;
+static uint32_t g_ck_reported = 0;
+static int g_ck_walked = 0;                        /* arbre parcouru depuis la racine */
+
+/* Transactions du journal pas encore rejouées : LBA en place -> secteur du
+ * journal qui le remplace (le plus récent gagne), superposé aux lectures */
+#define CK_JMAP_SIZE (2 * JNL_SECTORS)             /* puissance de 2 */
+static uint32_t *g_ck_jlba;                        /* LBA + 1, 0 = libre */
+static uint32_t *g_ck_jsrc;
+static uint32_t g_ck_jn = 0;
+
+/* Les compteurs sont partagés entre les threads de l'hôte */
+static void ck_say(reapfs_check_t *ck, int error, const char *msg) {
+    __atomic_fetch_add(error ? &ck->errors : &ck->warnings, 1, __ATOMIC_RELAXED);
+    if (__atomic_fetch_add(&g_ck_reported, 1, __ATOMIC_RELAXED) < CK_MAX_REPORTS)
+        ck->report(ck->ctx, msg);
+}
+
+static uint32_t *ck_jslot(uint32_t lba) {
+    uint32_t h = (lba * 2654435761u) & (CK_JMAP_SIZE - 1);
+    while (g_ck_jlba[h] && g_ck_jlba[h] != lba + 1) h = (h + 1) & (CK_JMAP_SIZE - 1);
+    return &g_ck_jlba[h];
+}
+
+static int ck_read(reapfs_check_t *ck, uint32_t lba, void *buf, uint32_t count) {
+    int r = ck->read(ck->ctx, lba, buf, count);
+    for (uint32_t k = 0; r == 0 && g_ck_jn && k < count; ++k) {
+        uint32_t *slot = ck_jslot(lba + k);
+        if (*slot) r = ck->read(ck->ctx, g_ck_jsrc[slot - g_ck_jlba], (uint8_t*)buf + k * SECTOR_SIZE, 1);
+    }
+    if (r == 0) return 0;
+    char m[64];
+    snprintf(m, sizeof(m), "read error at sector %d\n", (int)lba);
+    ck_say(ck, 1, m);
+    return -1;
+}
+
+static int ck_sum_ok(const void *p, uint32_t size) {
+    uint32_t c;
+    memcpy(&c, (const uint8_t*)p + size - 4, 4);
+    return crc32c(0, p, size - 4) == c;
+}
+
+static int ck_name_ok(const char *name) {
+    for (int i = 0; i < MAX_FILENAME; ++i)
+        if (name[i] == '\0') return 1;
+    return 0;
+}
+
+static uint32_t ck_min(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
+/* ---------- Superbloc et journal ---------- */
+
+/* Superbloc déjà lu dans ck->sb : 0 si la suite du contrôle a un sens */
+static int ck_super_ok(reapfs_check_t *ck) {
+    reapfs_super_t *sb = &ck->sb;
+    char m[128];
+    if (sb->magic != FS_SUPER_MAGIC) {
+        uint32_t old[SECTOR_SIZE / 4];
+        if (ck->read(ck->ctx, LEGACY_SUPERBLOCK_SECTOR, old, 1) == 0 && old[0] == FS_SUPER_MAGIC)
+            ck_say(ck, 1, "superblock: old layout (superblock at 128), not checked\n");
+        else
+            ck_say(ck, 1, "superblock: bad magic, not a reAPFS volume\n");
+        return -1;
+    }
+    if (sb->version != FS_FORMAT_VERSION) {
+        snprintf(m, sizeof(m), "superblock: format version %d, expected %d\n",
+                 (int)sb->version, FS_FORMAT_VERSION);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+    if (!ck_sum_ok(sb, sizeof(*sb)))
+        ck_say(ck, 1, "superblock: checksum mismatch\n");
+    if (sb->total_sectors == 0 || sb->total_sectors > FS_MAX_SECTORS
+        || sb->inode_count == 0 || sb->inode_count > FS_MAX_INODES) {
+        snprintf(m, sizeof(m), "superblock: %d sectors, %d inodes out of range\n",
+                 (int)sb->total_sectors, (int)sb->inode_count);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+
+    /* Toute la géométrie découle de la taille et du nombre d'inodes */
+    reapfs_super_t want;
+    memset(&want, 0, sizeof(want));
+    reapfs_layout(&want, sb->total_sectors, sb->inode_count);
+    if (sb->inode_table_sectors != want.inode_table_sectors
+        || sb->ibitmap_start != want.ibitmap_start || sb->ibitmap_sectors != want.ibitmap_sectors
+        || sb->bitmap_start != want.bitmap_start || sb->bitmap_sectors != want.bitmap_sectors
+        || sb->journal_start != want.journal_start || sb->journal_sectors != want.journal_sectors
+        || sb->data_start_sector != want.data_start_sector
+        || sb->data_start_sector >= sb->total_sectors) {
+        snprintf(m, sizeof(m), "superblock: layout does not match %d sectors / %d inodes\n",
+                 (int)sb->total_sectors, (int)sb->inode_count);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+    if (ck->dev_sectors && sb->total_sectors > ck->dev_sectors) {
+        snprintf(m, sizeof(m), "superblock: volume is %d sectors, disk only %d\n",
+                 (int)sb->total_sectors, (int)ck->dev_sectors);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+    if (sb->free_sectors > sb->total_sectors - sb->data_start_sector) {
+        snprintf(m, sizeof(m), "superblock: %d free sectors, more than the data area\n",
+                 (int)sb->free_sectors);
+        ck_say(ck, 1, m);
+    }
+    return 0;
+}
+
+/* Longueur de la transaction valide à `pos` (0 : aucune), comme au rejeu :
+ * descripteurs de la bonne séquence, puis un commit dont la somme couvre
+ * descripteurs et secteurs */
+static uint32_t ck_jnl_tx(reapfs_check_t *ck, uint32_t pos, uint32_t seq) {
+    uint32_t log = ck->sb.journal_sectors - 1;
+    uint32_t base = ck->sb.journal_start + 1;
+    uint32_t start = pos, sum = 0;
+    uint8_t sec[SECTOR_SIZE];
+    for (;;) {
+        jnl_desc_t d;
+        if (pos >= log || ck->read(ck->ctx, base + pos, &d, 1) != 0) return 0;
+        if (d.magic != JNL_DESC_MAGIC || d.seq != seq || d.count > JNL_DESC_LBAS
+            || pos + 1 + d.count + 1 > log)
+            return 0;
+        sum = crc32c(sum, &d, SECTOR_SIZE);
+        pos++;
+        for (uint32_t k = 0; k < d.count; ++k, ++pos) {
+            if (ck->read(ck->ctx, base + pos, sec, 1) != 0) return 0;
+            sum = crc32c(sum, sec, SECTOR_SIZE);
+        }
+        if (d.last) break;
+    }
+    jnl_commit_t c;
+    if (ck->read(ck->ctx, base + pos, &c, 1) != 0) return 0;
+    if (c.magic != JNL_COMMIT_MAGIC || c.seq != seq || c.sum != sum || c.blocks != pos + 1 - start)
+        return 0;
+    return c.blocks;
+}
+
+/* Hors montage : les transactions validées mais pas rejouées remplacent,
+ * pour toutes les lectures qui suivent, les secteurs qu'elles portent */
+static void ck_journal(reapfs_check_t *ck, const jnl_header_t *h) {
+    uint32_t base = ck->sb.journal_start + 1;
+    uint32_t pos = h->tail, seq = h->seq, txs = 0;
+    for (;;) {
+        uint32_t len = ck_jnl_tx(ck, pos, seq);
+        if (len == 0) break;
+        uint32_t end = pos + len - 1;   /* bloc de commit */
+        while (pos < end) {
+            jnl_desc_t d;
+            if (ck->read(ck->ctx, base + pos++, &d, 1) != 0) return;
+            for (uint32_t k = 0; k < d.count; ++k, ++pos) {
+                uint32_t *slot = ck_jslot(d.lba[k]);
+                if (!*slot) g_ck_jn++;
+                *slot = d.lba[k] + 1;
+                g_ck_jsrc[slot - g_ck_jlba] = base + pos;
+            }
+        }
+        pos++;
+        seq++;
+        txs++;
+    }
+    if (txs) {
+        char m[96];
+        snprintf(m, sizeof(m), "journal: %d transactions not replayed, checked as replayed\n", (int)txs);
+        ck->report(ck->ctx, m);
+    }
+}
+
+/* Zone de travail pour la géométrie de ck->sb, tables remises à zéro.
+ * 0, ou -1 si l'appelant n'a pas la mémoire */
+static int ck_setup(reapfs_check_t *ck) {
+    uint32_t inodes = ck->sb.inode_count;
+    uint32_t words = (ck->sb.total_sectors + 31) / 32;
+    uint32_t state = (inodes + 3) & ~3u;
+    uint32_t bytes = state + inodes * 8 + words * 4 + CK_JMAP_SIZE * 8;
+    uint8_t *p = ck->alloc(ck->ctx, bytes);
+    if (!p) {
+        char m[96];
+        snprintf(m, sizeof(m), "not enough memory to check (%d KB)\n", (int)(bytes / 1024));
+        ck->report(ck->ctx, m);
+        return -1;
+    }
+    memset(p, 0, bytes);
+    g_ck_state = p;                            p += state;
+    g_ck_parent = (uint32_t*)p;                p += inodes * 4;
+    g_ck_queue = (uint32_t*)p;                 p += inodes * 4;
+    g_ck_owned = (uint32_t*)p;                 p += words * 4;
+    g_ck_jlba = (uint32_t*)p;                  p += CK_JMAP_SIZE * 4;
+    g_ck_jsrc = (uint32_t*)p;
+    g_ck_ninodes = inodes;
+    g_ck_nsectors = ck->sb.total_sectors;
+    return 0;
+}
+
+int reapfs_check_super(reapfs_check_t *ck) {
+    reapfs_super_t *sb = &ck->sb;
+
+    g_ck_jn = 0;
+    g_ck_qhead = g_ck_qtail = 0;
+    g_ck_reported = 0;
+    g_ck_walked = 0;
+    ck->errors = ck->warnings = 0;
+    ck->files = ck->dirs = ck->used_sectors = 0;
+
+    if (ck_read(ck, SUPERBLOCK_SECTOR, sb, 1) != 0 || ck_super_ok(ck) != 0) return -1;
+    if (ck_setup(ck) != 0) return -1;
+
+    jnl_header_t h;
+    if (ck_read(ck, sb->journal_start, &h, 1) != 0) return 0;
+    if (h.magic != JNL_HDR_MAGIC || h.tail >= sb->journal_sectors - 1) {
+        ck_say(ck, 1, "journal: bad header\n");
+        return 0;
+    }
+    /* Le rejeu peut réécrire le superbloc lui-même : relu à travers le journal */
+    if (!ck->live) {
+        ck_journal(ck, &h);
+        if (*ck_jslot(SUPERBLOCK_SECTOR)) {
+            uint32_t errors = ck->errors;
+            if (ck_read(ck, SUPERBLOCK_SECTOR, sb, 1) != 0 || ck_super_ok(ck) != 0) return -1;
+            if (ck->errors != errors) return -1;
+            /* Les tables suivent la géométrie lue avant le journal */
+            if (sb->inode_count > g_ck_ninodes || sb->total_sectors > g_ck_nsectors) {
+                ck_say(ck, 1, "superblock: journal changes the volume geometry\n");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* ---------- Extents ---------- */
+
+/* Parcourt les extents d'un inode, blocs de débordement compris */
+typedef struct {
+    const reapfs_inode_t *in;
+    uint32_t i;          /* extents déjà rendus */
+    uint32_t k;          /* position dans blk */
+    uint32_t blocks;     /* blocs de débordement lus */
+    int claim;           /* revendique les blocs de débordement */
+    reapfs_extblock_t blk;
+} ck_extit_t;
+
+/* Revendique [lba, lba + n) pour `ino` : dans la zone de données et à
+ * personne d'autre. 0 ou -1 */
+static int ck_claim(reapfs_check_t *ck, uint32_t ino, uint32_t lba, uint32_t n) {
+    reapfs_super_t *sb = &ck->sb;
+    char m[128];
+    if (lba < sb->data_start_sector || lba >= sb->total_sectors || n > sb->total_sectors - lba) {
+        snprintf(m, sizeof(m), "inode %d: extent %d+%d outside the data area\n",
+                 (int)ino, (int)lba, (int)n);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+    uint32_t dup = 0, first = 0;
+    for (uint32_t s = lba; s < lba + n; ++s) {
+        uint32_t bit = 1u << (s & 31);
+        if (g_ck_owned[s >> 5] & bit) {
+            if (dup++ == 0) first = s;
+        } else {
+            g_ck_owned[s >> 5] |= bit;
+        }
+    }
+    ck->used_sectors += n - dup;
+    if (dup) {
+        snprintf(m, sizeof(m), "inode %d: %d sectors from %d already belong to another inode\n",
+                 (int)ino, (int)dup, (int)first);
+        ck_say(ck, 1, m);
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 : extent suivant dans *out ; 0 : fin ; -1 : liste illisible (signalé) */
+static int ck_ext_next(reapfs_check_t *ck, ck_extit_t *it, reapfs_extent_t *out) {
+    const reapfs_inode_t *in = it->in;
+    if (it->i >= in->ext_count) return 0;
+    if (it->i < INODE_EXTENTS) {
+        *out = in->ext[it->i++];
+        return 1;
+    }
+    if (it->i == INODE_EXTENTS || it->k == it->blk.count) {
+        uint32_t lba = it->i == INODE_EXTENTS ? in->ext_overflow : it->blk.next;
+        char m[128];
+        if (lba == 0 || it->blocks == EXT_MAX_BLOCKS) {
+            snprintf(m, sizeof(m), "inode %d: extent list ends after %d of %d\n",
+                     (int)in->ino, (int)it->i, (int)in->ext_count);
+            ck_say(ck, 1, m);
+            return -1;
+        }
+        if (it->claim && ck_claim(ck, in->ino, lba, 1) != 0) return -1;
+        if (!it->claim && (lba < ck->sb.data_start_sector || lba >= ck->sb.total_sectors)) return -1;
+        if (ck_read(ck, lba, &it->blk, 1) != 0) return -1;
+        if (it->blk.magic != EXT_BLOCK_MAGIC || it->blk.count == 0 || it->blk.count > EXT_PER_BLOCK
+            || !ck_sum_ok(&it->blk, sizeof(it->blk))) {
+            snprintf(m, sizeof(m), "inode %d: bad extent block at %d\n", (int)in->ino, (int)lba);
+            ck_say(ck, 1, m);
+            return -1;
+        }
+        it->blocks++;
+        it->k = 0;
+    }
+    *out = it->blk.ext[it->k++];
+    it->i++;
+    return 1;
+}
+
+/* ---------- Table d'inodes ---------- */
+
+static void ck_inode(reapfs_check_t *ck, uint32_t ino, const reapfs_inode_t *in) {
+    char m[128];
+    if (!ck_sum_ok(in, sizeof(*in))) {
+        snprintf(m, sizeof(m), "inode %d: checksum mismatch\n", (int)ino);
+        ck_say(ck, 1, m);
+        g_ck_state[ino] = CK_BAD;
+        return;
+    }
+    if (in->ino != ino) {
+        snprintf(m, sizeof(m), "inode %d: records number %d\n", (int)ino, (int)in->ino);
+        ck_say(ck, 1, m);
+        g_ck_state[ino] = CK_BAD;
+        return;
+    }
+    if (!in->used) return;
+
+    uint8_t st = CK_USED | (in->is_dir ? CK_DIR : 0);
+    int lz4 = (in->flags & INODE_F_LZ4) != 0;
+    uint32_t nb = in->size / SECTOR_SIZE;
+    if (in->is_dir) ck->dirs++;
+    else ck->files++;
+
+    if (!ck_name_ok(in->name)) {
+        snprintf(m, sizeof(m), "inode %d: name not terminated\n", (int)ino);
+        ck_say(ck, 1, m);
+    }
+    if (in->flags & ~INODE_F_LZ4) {
+        snprintf(m, sizeof(m), "inode %d: unknown flags 0x%x\n", (int)ino, (uint32_t)in->flags);
+        ck_say(ck, 1, m);
+    }
+    if (in->is_dir && (lz4 || in->size % SECTOR_SIZE || nb == 0 || nb > DIR_MAX_BLOCKS || (nb & (nb - 1)))) {
+        snprintf(m, sizeof(m), "directory %d: bad size %d%s\n", (int)ino, (int)in->size,
+                 lz4 ? " (compressed)" : "");
+        ck_say(ck, 1, m);
+        st |= CK_BAD;
+    }
+    if (in->ext_count > FS_MAX_EXTENTS) {
+        snprintf(m, sizeof(m), "inode %d: %d extents, at most %d\n",
+                 (int)ino, (int)in->ext_count, FS_MAX_EXTENTS);
+        ck_say(ck, 1, m);
+        g_ck_state[ino] = st | CK_BAD;
+        return;
+    }
+
+    ck_extit_t it;
+    memset(&it, 0, sizeof(it));
+    it.in = in;
+    it.claim = 1;
+    reapfs_extent_t e;
+    uint32_t sum = 0;
+    int r;
+    while ((r = ck_ext_next(ck, &it, &e)) > 0) {
+        if (e.len == 0) {
+            /* Bloc nul d'un fichier compressé : un trou */
+            if (!lz4) {
+                snprintf(m, sizeof(m), "inode %d: empty extent %d\n", (int)ino, (int)it.i - 1);
+                ck_say(ck, 1, m);
+            }
+            continue;
+        }
+        if (lz4 && e.len > ZCHUNK_SECTORS) {
+            snprintf(m, sizeof(m), "inode %d: compressed chunk %d spans %d sectors\n",
+                     (int)ino, (int)it.i - 1, (int)e.len);
+            ck_say(ck, 1, m);
+        }
+        ck_claim(ck, ino, e.start, e.len);
+        sum += e.len;
+    }
+    if (r < 0) {
+        st |= CK_BAD;
+    } else if (!lz4) {
+        uint32_t need = in->is_dir ? nb : in->size / SECTOR_SIZE + (in->size % SECTOR_SIZE != 0);
+        if (sum < need) {
+            snprintf(m, sizeof(m), "inode %d: %d sectors allocated for %d bytes\n",
+                     (int)ino, (int)sum, (int)in->size);
+            ck_say(ck, 1, m);
+            if (in->is_dir) st |= CK_BAD;
+        }
+    }
+    g_ck_state[ino] = st;
+}
+
+int reapfs_check_inodes(reapfs_check_t *ck) {
+    reapfs_super_t *sb = &ck->sb;
+
+    /* Zone fixe : MBR, kernel, superbloc, tables et journal */
+    for (uint32_t s = 0; s < sb->data_start_sector; ++s)
+        g_ck_owned[s >> 5] |= 1u << (s & 31);
+
+    /* Lecture par lots : la table est contiguë */
+    for (uint32_t s = 0; s < sb->inode_table_sectors; ) {
+        uint32_t n = ck_min(ck->buf_sectors, sb->inode_table_sectors - s);
+        int ok = ck_read(ck, INODE_TABLE_START_SECTOR + s, ck->buf, n) == 0;
+        for (uint32_t k = 0; k < n * INODES_PER_SECTOR; ++k) {
+            uint32_t ino = s * INODES_PER_SECTOR + k;
+            if (ino >= sb->inode_count) break;
+            if (ok) ck_inode(ck, ino, (const reapfs_inode_t*)ck->buf + k);
+            else g_ck_state[ino] = CK_BAD;
+        }
+        s += n;
+    }
+
+    uint8_t root = g_ck_state[0];
+    if (!(root & CK_USED) || !(root & CK_DIR) || (root & CK_BAD)) {
+        ck_say(ck, 1, "root directory (inode 0) unusable, tree not checked\n");
+        return -1;
+    }
+    g_ck_state[0] |= CK_REF;
+    g_ck_parent[0] = 0;
+    g_ck_walked = 1;
+    return 0;
+}
+
+/* ---------- Répertoires ---------- */
+
+typedef struct {
+    uint32_t ino;
+    uint32_t nb;         /* seaux */
+    uint32_t parent;
+    int dot;
+    int dotdot;
+} ck_dir_t;
+
+static void ck_entry(reapfs_check_t *ck, ck_dir_t *d, const reapfs_dirent_t *e) {
+    char m[128];
+    uint32_t c = e->ino;
+    if (strcmp(e->name, ".") == 0) {
+        d->dot = 1;
+        if (c != d->ino) {
+            snprintf(m, sizeof(m), "directory %d: '.' points to %d\n", (int)d->ino, (int)c);
+            ck_say(ck, 1, m);
+        }
+        return;
+    }
+    if (strcmp(e->name, "..") == 0) {
+        d->dotdot = 1;
+        if (c != d->parent) {
+            snprintf(m, sizeof(m), "directory %d: '..' points to %d, parent is %d\n",
+                     (int)d->ino, (int)c, (int)d->parent);
+            ck_say(ck, 1, m);
+        }
+        return;
+    }
+    if (c >= ck->sb.inode_count) {
+        snprintf(m, sizeof(m), "directory %d: '%s' points past the inode table (%d)\n",
+                 (int)d->ino, e->name, (int)c);
+        ck_say(ck, 1, m);
+        return;
+    }
+    /* Le premier qui pose CK_REF descend ; les suivants sont des doublons
+     * (deux entrées, ou un répertoire qui contient un de ses ancêtres) */
+    uint8_t old = __atomic_fetch_or(&g_ck_state[c], (uint8_t)CK_REF, __ATOMIC_RELAXED);
+    if (!(old & (CK_USED | CK_BAD))) {
+        snprintf(m, sizeof(m), "directory %d: '%s' points to free inode %d\n",
+                 (int)d->ino, e->name, (int)c);
+        ck_say(ck, 1, m);
+        return;
+    }
+    if (old & CK_REF) {
+        snprintf(m, sizeof(m), "directory %d: '%s' links inode %d a second time (cycle?)\n",
+                 (int)d->ino, e->name, (int)c);
+        ck_say(ck, 1, m);
+        return;
+    }
+    if ((old & CK_DIR) && !(old & CK_BAD)) {
+        g_ck_parent[c] = d->ino;
+        if (ck->dir_found) ck->dir_found(ck->ctx, c);
+        else g_ck_queue[g_ck_qtail++] = c;
+    }
+}
+
+static void ck_dirblock(reapfs_check_t *ck, ck_dir_t *d, uint32_t b, const reapfs_dirblock_t *blk) {
+    char m[128];
+    if (!ck_sum_ok(blk, sizeof(*blk))) {
+        snprintf(m, sizeof(m), "directory %d: block %d checksum mismatch\n", (int)d->ino, (int)b);
+        ck_say(ck, 1, m);
+        return;
+    }
+    uint32_t n = 0;
+    for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; ++i) {
+        const reapfs_dirent_t *e = &blk->ent[i];
+        if (!e->name[0]) continue;
+        n++;
+        if (!ck_name_ok(e->name)) {
+            snprintf(m, sizeof(m), "directory %d: unterminated name in block %d\n", (int)d->ino, (int)b);
+            ck_say(ck, 1, m);
+            continue;
+        }
+        uint32_t want = dir_hash(e->name) & (d->nb - 1);
+        if (want != b) {
+            /* Encore à sa place dans une table plus petite : copie laissée par
+             * un dédoublement interrompu, ignorée par le FS. Si l'entrée
+             * manque dans son seau, l'inode ressort orphelin */
+            uint32_t small = 1;
+            while (small <= b) small <<= 1;
+            if ((want & (small - 1)) == b) {
+                snprintf(m, sizeof(m), "directory %d: stale '%s' in bucket %d (interrupted split)\n",
+                         (int)d->ino, e->name, (int)b);
+                ck_say(ck, 0, m);
+                continue;
+            }
+            snprintf(m, sizeof(m), "directory %d: '%s' in bucket %d, belongs in %d\n",
+                     (int)d->ino, e->name, (int)b, (int)want);
+            ck_say(ck, 1, m);
+        }
+        int twice = 0;
+        for (int j = 0; j < i && !twice; ++j)
+            twice = strncmp(blk->ent[j].name, e->name, MAX_FILENAME) == 0;
+        if (twice) {
+            snprintf(m, sizeof(m), "directory %d: '%s' listed twice\n", (int)d->ino, e->name);
+            ck_say(ck, 1, m);
+            continue;
+        }
+        ck_entry(ck, d, e);
+    }
+    if (n != blk->count) {
+        snprintf(m, sizeof(m), "directory %d: block %d counts %d entries, holds %d\n",
+                 (int)d->ino, (int)b, (int)blk->count, (int)n);
+        ck_say(ck, 1, m);
+    }
+}
+
+int reapfs_check_dir(reapfs_check_t *ck, uint32_t ino, uint8_t *buf, uint32_t buf_sectors) {
+    uint8_t sec[SECTOR_SIZE];
+    reapfs_inode_t in;
+    if (ck_read(ck, INODE_TABLE_START_SECTOR + ino / INODES_PER_SECTOR, sec, 1) != 0) return -1;
+    memcpy(&in, sec + (ino % INODES_PER_SECTOR) * sizeof(in), sizeof(in));
+
+    ck_dir_t d;
+    memset(&d, 0, sizeof(d));
+    d.ino = ino;
+    d.nb = in.size / SECTOR_SIZE;
+    d.parent = g_ck_parent[ino];
+
+    /* Les seaux d'un extent sont lus d'un bloc, par lots de buf_sectors */
+    ck_extit_t it;
+    memset(&it, 0, sizeof(it));
+    it.in = &in;
+    reapfs_extent_t e;
+    uint32_t b = 0;
+    int r = 0;
+    while (b < d.nb && (r = ck_ext_next(ck, &it, &e)) > 0) {
+        uint32_t lba = e.start;
+        uint32_t left = ck_min(e.len, d.nb - b);
+        while (left > 0) {
+            uint32_t n = ck_min(left, buf_sectors);
+            if (ck_read(ck, lba, buf, n) != 0) return -1;
+            for (uint32_t k = 0; k < n; ++k)
+                ck_dirblock(ck, &d, b + k, (const reapfs_dirblock_t*)(buf + k * SECTOR_SIZE));
+            b += n;
+            lba += n;
+            left -= n;
+        }
+    }
+    if (r < 0) return -1;
+
+    char m[64];
+    if (!d.dot) {
+        snprintf(m, sizeof(m), "directory %d: no '.' entry\n", (int)ino);
+        ck_say(ck, 1, m);
+    }
+    if (!d.dotdot) {
+        snprintf(m, sizeof(m), "directory %d: no '..' entry\n", (int)ino);
+        ck_say(ck, 1, m);
+    }
+    return 0;
+}
+
+/* ---------- Bitmaps ---------- */
+
+/* Compare une bitmap du disque à ce que le contrôle a trouvé : bitmap
+ * d'inodes si `inodes`, sinon celle des secteurs */
+static void ck_bitmap(reapfs_check_t *ck, uint32_t start, uint32_t sectors, uint32_t limit, int inodes) {
+    const char *what = inodes ? "inode" : "sector";
+    uint32_t missing = 0, first = 0, leaked = 0, free_bits = 0;
+    char m[128];
+
+    for (uint32_t s = 0; s < sectors; ) {
+        uint32_t n = ck_min(ck->buf_sectors, sectors - s);
+        if (ck_read(ck, start + s, ck->buf, n) != 0) return;
+        for (uint32_t i = 0; i < n * BM_BITS_PER_SECTOR; ++i) {
+            uint32_t u = s * BM_BITS_PER_SECTOR + i;
+            if (u >= limit) break;
+            int bit = (ck->buf[i >> 3] >> (i & 7)) & 1;
+            int used;
+            if (inodes) {
+                if (g_ck_state[u] & CK_BAD) continue;
+                used = g_ck_state[u] & CK_USED;
+            } else {
+                used = (g_ck_owned[u >> 5] >> (u & 31)) & 1;
+            }
+            if (!bit) free_bits++;
+            if (bit && !used) leaked++;
+            else if (!bit && used && missing++ == 0) first = u;
+        }
+        s += n;
+    }
+
+    if (missing) {
+        snprintf(m, sizeof(m), "%s bitmap: %d in use but marked free (first %d)\n",
+                 what, (int)missing, (int)first);
+        ck_say(ck, 1, m);
+    }
+    if (leaked) {
+        snprintf(m, sizeof(m), "%s bitmap: %d marked in use but unreferenced\n", what, (int)leaked);
+        ck_say(ck, 0, m);
+    }
+    if (!inodes && free_bits != ck->sb.free_sectors) {
+        snprintf(m, sizeof(m), "superblock: %d free sectors recorded, bitmap has %d\n",
+                 (int)ck->sb.free_sectors, (int)free_bits);
+        ck_say(ck, 1, m);
+    }
+}
+
+void reapfs_check_finish(reapfs_check_t *ck) {
+    reapfs_super_t *sb = &ck->sb;
+    char m[96];
+
+    /* Sans parcours, tout inode passerait pour orphelin */
+    if (g_ck_walked) {
+        for (uint32_t i = 0; i < sb->inode_count; ++i) {
+            uint8_t st = g_ck_state[i];
+            if ((st & CK_USED) && !(st & (CK_REF | CK_BAD))) {
+                snprintf(m, sizeof(m), "inode %d: orphan, no directory entry\n", (int)i);
+                ck_say(ck, 1, m);
+            }
+        }
+    }
+    ck_bitmap(ck, sb->ibitmap_start, sb->ibitmap_sectors, sb->inode_count, 1);
+    ck_bitmap(ck, sb->bitmap_start, sb->bitmap_sectors, sb->total_sectors, 0);
+
+    if (g_ck_reported > CK_MAX_REPORTS) {
+        snprintf(m, sizeof(m), "... %d more problems not shown\n", (int)(g_ck_reported - CK_MAX_REPORTS));
+        ck->report(ck->ctx, m);
+    }
+}
+
+int reapfs_check(reapfs_check_t *ck) {
+    if (reapfs_check_super(ck) != 0) return -1;
+    if (reapfs_check_inodes(ck) == 0) {
+        reapfs_check_dir(ck, 0, ck->buf, ck->buf_sectors);
+        while (g_ck_qhead < g_ck_qtail)
+            reapfs_check_dir(ck, g_ck_queue[g_ck_qhead++], ck->buf, ck->buf_sectors);
+    }
+    reapfs_check_finish(ck);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef REAPFS_CHECK_H
+#define REAPFS_CHECK_H
+
+#include <stdint.h>
+#include "reapfs_format.h"
+
+/*
+ * reapfs_check — contrôle de cohérence d'un volume reAPFS, en lecture seule.
+ *
+ * Le même code sert la commande fsck du shell (un seul fil, à travers le
+ * cache) et fsck.reapfs sur l'hôte (image fichier, répertoires répartis
+ * entre plusieurs threads). Rien n'est corrigé : chaque défaut est décrit
+ * par report() et compté.
+ *
+ *   reapfs_check_super   magic, version, somme, géométrie, journal
+ *   reapfs_check_inodes  table d'inodes lue par lots de buf_sectors ;
+ *                        extents dans le volume, chaque secteur n'ayant
+ *                        qu'un seul propriétaire
+ *   reapfs_check_dir     un répertoire : sommes, seaux, . et .., entrées
+ *                        vers des inodes libres, inode référencé deux fois
+ *                        (lien en double ou cycle). Chaque sous-répertoire
+ *                        trouvé passe par dir_found ; deux appels sur des
+ *                        répertoires différents peuvent tourner en même temps
+ *   reapfs_check_finish  inodes orphelins, bitmaps, secteurs libres
+ *
+ * reapfs_check() enchaîne les quatre sur un seul fil. L'état (propriétaires
+ * des secteurs, références) vit dans une zone de travail demandée à alloc()
+ * une fois la géométrie connue (30 Kio pour 16 Mio, 624 Kio au plus) ;
+ * l'appelant la libère après reapfs_check_finish. Un contrôle à la fois.
+ */
+
+typedef struct {
+    /* Fourni par l'appelant */
+    int (*read)(void *ctx, uint32_t lba, void *buf, uint32_t count);   /* 0 = succès */
+    void (*report)(void *ctx, const char *msg);   /* une ligne, '\n' compris */
+    void (*dir_found)(void *ctx, uint32_t ino);   /* NULL : file interne (reapfs_check) */
+    void *(*alloc)(void *ctx, uint32_t bytes);    /* zone de travail, NULL = pas de mémoire */
+    void *ctx;
+    uint8_t *buf;             /* lots des lectures séquentielles */
+    uint32_t buf_sectors;
+    uint32_t dev_sectors;     /* taille du disque, 0 = inconnue */
+    int live;                 /* volume monté : journal déjà rejoué */
+
+    /* Résultats */
+    reapfs_super_t sb;
+    uint32_t errors;
+    uint32_t warnings;
+    uint32_t files;
+    uint32_t dirs;
+    uint32_t used_sectors;    /* secteurs de données revendiqués par les inodes */
+} reapfs_check_t;
+
+// 0 si la suite du contrôle a un sens, -1 sinon (superbloc inutilisable)
+int reapfs_check_super(reapfs_check_t *ck);
+// 0, ou -1 si la racine est inutilisable (pas de parcours de l'arbre)
+int reapfs_check_inodes(reapfs_check_t *ck);
+// Répertoire `ino`, déjà signalé par dir_found (ou la racine, 0)
+int reapfs_check_dir(reapfs_check_t *ck, uint32_t ino, uint8_t *buf, uint32_t buf_sectors);
+void reapfs_check_finish(reapfs_check_t *ck);
+
+// Tout le contrôle sur un seul fil : 0, ou -1 si le volume est illisible
+int reapfs_check(reapfs_check_t *ck);
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef REAPFS_FORMAT_H
+#define REAPFS_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * reapfs_format.h — format sur disque de reAPFS, partagé par le kernel
+ * (reAPFS.c) et les outils hôte de host/.
+ *
+ * Disposition, en secteurs de 512 octets :
+ *   0             MBR (bootloader)
+ *   1..511        kernel (zone de boot, chargée à 0x10000 par le MBR)
+ *   512           superbloc
+ *   513..         table d'inodes, bitmap d'inodes, bitmap des secteurs,
+ *                 journal (en-tête + zone circulaire), puis les données
+ */
+
+/* ---------- Géométrie ---------- */
+#define SECTOR_SIZE 512
+#define FS_SUPER_MAGIC 0x52455046    /* "REPF" */
+#define FS_FORMAT_VERSION 10         /* 2 : bitmap, 3 : extents, 4 : répertoires hachés, 5 : journal, 6 : CRC32C, 7 : LZ4, 8 : table d'inodes dimensionnée au formatage, 9 : bitmap d'inodes, 10 : zone de boot de 511 secteurs */
+#define FS_MAX_INODES 65536          /* borne du nombre d'inodes choisi au formatage */
+#define FS_BYTES_PER_INODE 16384     /* densité par défaut : un inode pour 16 Kio de volume */
+#define FS_MIN_INODES 64
+#define SUPERBLOCK_SECTOR 512         /* garder KERNEL_SECTORS (bootloader.asm) et linker.ld d'accord */
+#define INODE_TABLE_START_SECTOR 513
+#define LEGACY_SUPERBLOCK_SECTOR 128  /* versions 9 et avant : kernel limité à 127 secteurs */
+#define MAX_FILENAME 32
+#define FS_MAX_SECTORS 262144        /* 128 Mio : borne la bitmap en mémoire */
+#define BM_BITS_PER_SECTOR (SECTOR_SIZE * 8)
+#define BM_MAX_SECTORS (FS_MAX_SECTORS / BM_BITS_PER_SECTOR)
+#define IBM_MAX_SECTORS (FS_MAX_INODES / BM_BITS_PER_SECTOR)
+#define JNL_SECTORS 1024
+
+/* ---------- Structures ---------- */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t inode_table_sectors;
+    uint32_t inode_count;
+    uint32_t data_start_sector;
+    uint32_t total_sectors;     /* taille du volume, lue sur le disque au formatage */
+    uint32_t bitmap_start;      /* bitmap : 1 bit par LBA du volume, 1 = occupé */
+    uint32_t bitmap_sectors;
+    uint32_t free_sectors;
+    uint32_t journal_start;     /* en-tête du journal, puis la zone circulaire */
+    uint32_t journal_sectors;   /* en-tête compris */
+    uint32_t ibitmap_start;     /* bitmap d'inodes : 1 bit par inode, 1 = occupé */
+    uint32_t ibitmap_sectors;
+    uint8_t reserved[SECTOR_SIZE - 56];
+    uint32_t crc;
+} reapfs_super_t;
+
+/* Plage de secteurs contigus d'un fichier */
+typedef struct {
+    uint32_t start;   /* LBA du premier secteur */
+    uint32_t len;     /* en secteurs */
+} reapfs_extent_t;
+
+#define INODE_EXTENTS 9
+#define INODE_F_LZ4 1   /* données compressées par blocs de ZCHUNK_SIZE (voir reAPFS.c) */
+#define INODE_F_BAD 0x8000   /* somme fausse à la lecture : vidé, jamais réalloué */
+
+/* INODE_F_LZ4 : l'extent c porte le bloc c, au plus ZCHUNK_SECTORS secteurs
+ * (len == 0 : trou) */
+#define ZCHUNK_SECTORS 32
+#define ZCHUNK_SIZE (ZCHUNK_SECTORS * SECTOR_SIZE)
+
+/* 128 octets : 4 inodes par secteur, aucun à cheval sur deux secteurs */
+typedef struct {
+    uint32_t ino;
+    uint32_t size; /* bytes: for file = file size, for dir = size of dirent table */
+    uint8_t used;
+    uint8_t is_dir;
+    uint16_t flags;     /* INODE_F_* */
+    char name[MAX_FILENAME];
+    uint32_t ext_count;                    /* extents au total, débordement compris */
+    uint32_t ext_overflow;                 /* LBA du 1er bloc de débordement, 0 = aucun */
+    reapfs_extent_t ext[INODE_EXTENTS];
+    uint32_t crc;
+} reapfs_inode_t;
+
+#define INODES_PER_SECTOR (SECTOR_SIZE / sizeof(reapfs_inode_t))
+
+/* Bloc de débordement : suite de la liste d'extents, chaînée par `next` */
+#define EXT_BLOCK_MAGIC 0x45585442   /* "EXTB" */
+#define EXT_PER_BLOCK 62
+#define EXT_MAX_BLOCKS 8
+#define FS_MAX_EXTENTS (INODE_EXTENTS + EXT_PER_BLOCK * EXT_MAX_BLOCKS)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t next;
+    reapfs_extent_t ext[EXT_PER_BLOCK];
+    uint32_t crc;
+} reapfs_extblock_t;
+
+typedef struct {
+    char name[MAX_FILENAME];   /* name[0] == 0 : emplacement libre */
+    uint32_t ino;
+} reapfs_dirent_t;
+
+/* Répertoire = table de hachage de 2^k secteurs ; le nom choisit le seau
+ * (hash & (nb - 1)). Un seau plein double la table : chaque seau b se
+ * partage entre b et b + nb, sans jamais relire toute la table d'un coup. */
+#define DIR_ENTRIES_PER_BLOCK 14
+#define DIR_MAX_BLOCKS 1024           /* 14336 entrées au plus */
+
+typedef struct {
+    uint32_t count;                   /* emplacements occupés */
+    reapfs_dirent_t ent[DIR_ENTRIES_PER_BLOCK];
+    uint32_t crc;
+} reapfs_dirblock_t;
+
+/* ---------- Journal ---------- */
+#define JNL_HDR_MAGIC    0x4A484452   /* "JHDR" */
+#define JNL_DESC_MAGIC   0x4A445343   /* "JDSC" */
+#define JNL_COMMIT_MAGIC 0x4A434D54   /* "JCMT" */
+#define JNL_DESC_LBAS 124
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;       /* séquence attendue à `tail` */
+    uint32_t tail;      /* position de la plus ancienne transaction non checkpointée */
+    uint8_t pad[SECTOR_SIZE - 12];
+} jnl_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;     /* LBA dans ce descripteur, les secteurs suivent */
+    uint32_t last;      /* 1 : le bloc de commit suit */
+    uint32_t lba[JNL_DESC_LBAS];
+} jnl_desc_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t sum;       /* CRC32C des descripteurs et secteurs de la transaction */
+    uint32_t blocks;
+    uint8_t pad[SECTOR_SIZE - 16];
+} jnl_commit_t;
+
+/* ---------- Calculs partagés ---------- */
+
+/* FNV-1a du nom : choisit le seau d'un répertoire */
+static inline uint32_t dir_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < MAX_FILENAME && name[i]; ++i) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Remplit la géométrie du superbloc pour un volume de `total` secteurs.
+ * inode_count = 0 : un inode par FS_BYTES_PER_INODE. Les compteurs et la
+ * somme restent à poser. */
+static inline void reapfs_layout(reapfs_super_t *sb, uint32_t total, uint32_t inode_count) {
+    if (inode_count == 0)
+        inode_count = (uint32_t)((uint64_t)total * SECTOR_SIZE / FS_BYTES_PER_INODE);
+    if (inode_count < FS_MIN_INODES) inode_count = FS_MIN_INODES;
+    if (inode_count > FS_MAX_INODES) inode_count = FS_MAX_INODES;
+    sb->magic = FS_SUPER_MAGIC;
+    sb->version = FS_FORMAT_VERSION;
+    sb->total_sectors = total;
+    sb->inode_count = inode_count;
+    sb->inode_table_sectors = (inode_count + INODES_PER_SECTOR - 1) / INODES_PER_SECTOR;
+    sb->ibitmap_start = INODE_TABLE_START_SECTOR + sb->inode_table_sectors;
+    sb->ibitmap_sectors = (inode_count + BM_BITS_PER_SECTOR - 1) / BM_BITS_PER_SECTOR;
+    sb->bitmap_start = sb->ibitmap_start + sb->ibitmap_sectors;
+    sb->bitmap_sectors = (total + BM_BITS_PER_SECTOR - 1) / BM_BITS_PER_SECTOR;
+    sb->journal_start = sb->bitmap_start + sb->bitmap_sectors;
+    sb->journal_sectors = JNL_SECTORS;
+    sb->data_start_sector = sb->journal_start + sb->journal_sectors;
+}
+
+#endif
@@ -1,11 +1,12 @@
 #include "pfa.h"
 #include "utils.h"
-#define FRAME_SIZE 4096U
+#define FRAME_SIZE PFA_FRAME_SIZE
 static uint8_t *bitmap = 0;
 static size_t bitmap_bits = 0;
 static uintptr_t phys_base_addr = 0;
 static size_t total_frames = 0;
-static uint8_t bitmap_storage[1<<20];
+/* 8 Kio de bitmap : 256 Mio gérés, le reste de la RAM est ignoré */
+static uint8_t bitmap_storage[PFA_MAX_FRAMES / 8];
 static inline void set_bit(size_t i) { bitmap[i >> 3] |= (1 << (i & 7)); }
 static inline void clear_bit(size_t i) { bitmap[i >> 3] &= ~(1 << (i & 7)); }
 static inline int test_bit(size_t i) { return (bitmap[i >> 3] >> (i & 7)) & 1; }
@@ -16,12 +17,11 @@ void pfa_init(uintptr_t phys_base, size_t mem_size_bytes) {
     size_t bitmap_bytes = (bitmap_bits + 7) / 8;
     bitmap = bitmap_storage;
     if (bitmap_bytes > sizeof(bitmap_storage)) {
-        memset(bitmap, 0xFF, sizeof(bitmap_storage));
         bitmap_bits = sizeof(bitmap_storage)*8;
         total_frames = bitmap_bits;
-    } else {
-        memset(bitmap, 0, bitmap_bytes);
+        bitmap_bytes = sizeof(bitmap_storage);
     }
+    memset(bitmap, 0, bitmap_bytes);
     if (bitmap_bits > 0) set_bit(0);
 }
 uintptr_t pfa_alloc_frame(void) {
@@ -30,6 +30,21 @@ uintptr_t pfa_alloc_frame(void) {
     }
     return (uintptr_t)0;
 }
+uintptr_t pfa_alloc_run(size_t count) {
+    size_t run = 0;
+    for (size_t i = 0; i < bitmap_bits && count > 0; ++i) {
+        run = test_bit(i) ? 0 : run + 1;
+        if (run == count) {
+            size_t first = i + 1 - count;
+            for (size_t j = first; j <= i; ++j) set_bit(j);
+            return phys_base_addr + first * FRAME_SIZE;
+        }
+    }
+    return (uintptr_t)0;
+}
+void pfa_free_run(uintptr_t addr, size_t count) {
+    for (size_t i = 0; i < count; ++i) pfa_free_frame(addr + i * FRAME_SIZE);
+}
 void pfa_free_frame(uintptr_t frame_addr) {
     if (frame_addr < phys_base_addr) return;
     size_t idx = (frame_addr - phys_base_addr) / FRAME_SIZE;
@@ -1,8 +1,13 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#define PFA_FRAME_SIZE 4096U
+#define PFA_MAX_FRAMES 65536U   /* 256 Mio au-dessus de phys_base */
 void pfa_init(uintptr_t phys_base, size_t mem_size_bytes);
 uintptr_t pfa_alloc_frame(void);
 void pfa_free_frame(uintptr_t frame_addr);
+// Cadres physiquement contigus (tampons DMA, pools) ; 0 si aucun trou assez grand
+uintptr_t pfa_alloc_run(size_t count);
+void pfa_free_run(uintptr_t addr, size_t count);
 size_t pfa_total_frames(void);
 size_t pfa_free_frames(void);
@@ -0,0 +1,45 @@
+#include "timer.h"
+#include "idt.h"
+#include "io.h"
+
+#define PIT_CHANNEL0  0x40
+#define PIT_CMD       0x43
+#define PIT_BASE_HZ   1193182
+
+static volatile uint32_t g_ticks = 0;
+static uint32_t g_hz = 0;
+
+static void timer_irq(interrupt_frame_t *frame) {
+    (void)frame;
+    g_ticks++;
+}
+
+void timer_init(uint32_t hz) {
+    if (hz == 0) hz = 1000;
+    uint32_t divisor = PIT_BASE_HZ / hz;
+    if (divisor == 0) divisor = 1;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    g_hz = PIT_BASE_HZ / divisor;
+
+    outb(PIT_CMD, 0x36); /* canal 0, lobyte/hibyte, mode 3 (onde carrée) */
+    outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)(divisor >> 8));
+
+    irq_register(0, timer_irq);
+    irq_unmask(0);
+}
+
+int timer_running(void) {
+    uint32_t flags;
+    asm volatile ("pushfl; popl %0" : "=r"(flags));
+    return g_hz != 0 && (flags & 0x200);
+}
+
+uint32_t timer_ticks(void) {
+    return g_ticks;
+}
+
+uint32_t timer_ms(void) {
+    if (g_hz == 0) return 0;
+    return (uint32_t)(((uint64_t)g_ticks * 1000) / g_hz);
+}
@@ -0,0 +1,16 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Programme le PIT (canal 0) à `hz` et branche l'IRQ0
+void timer_init(uint32_t hz);
+
+// 1 si le PIT tourne (IDT installée, IRQ0 démasquée, interruptions actives)
+int timer_running(void);
+
+// Ticks depuis timer_init, et le même compteur converti en millisecondes
+uint32_t timer_ticks(void);
+uint32_t timer_ms(void);
+
+#endif
@@ -20,9 +20,10 @@ void fs_draw_ls(void) {
     const char *dir_name = last_slash ? last_slash + 1 : clean_path;
     if (dir_name[0] == '\0') dir_name = "/";
 
-    // Ouvrir le répertoire courant
-    int ino = fs_open(cwd, 0);
-    if (ino < 0) return;
+    // Vérifier que le répertoire courant existe
+    reapfs_fd_t fd = fs_open(cwd, FS_O_RDONLY);
+    if (fd < 0) return;
+    fs_close(fd);
 
     // Lire le contenu (fs_list_dir ignore déjà . et ..)
     fs_entry_t entries[MAX_DIR_ENTRIES];
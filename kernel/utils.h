@@ -23,6 +23,7 @@ char* strncpy(char* dest, const char* src, size_t n);
 char* strcat(char* dest, const char* src);
 
 size_t strlen(const char* str);
+char* strrchr(const char* s, int c);
 
 // ========================
 // Fonctions de formatage
@@ -22,3 +22,9 @@ void print_char(char c) {
 void print_string(const char* str) {
     while (*str) print_char(*str++);
 }
+
+void print_hex(uint32_t value) {
+    const char* digits = "0123456789ABCDEF";
+    print_string("0x");
+    for (int shift = 28; shift >= 0; shift -= 4) print_char(digits[(value >> shift) & 0xF]);
+}
@@ -1,8 +1,11 @@
 #ifndef VGA_H
 #define VGA_H
 
+#include <stdint.h>
+
 void clear_screen();
 void print_char(char c);
 void print_string(const char* str);
+void print_hex(uint32_t value);
 
 #endif
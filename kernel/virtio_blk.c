@@ -0,0 +1,386 @@
+#include "virtio_blk.h"
+#include "idt.h"
+#include "io.h"
+#include "pci.h"
+#include "screen.h"
+#include "vga.h"
+#include "timer.h"
+#include "utils.h"
+
+/* ---------- Interface PCI legacy (BAR0 I/O) ---------- */
+#define VIO_DEVICE_FEATURES  0x00
+#define VIO_GUEST_FEATURES   0x04
+#define VIO_QUEUE_PFN        0x08
+#define VIO_QUEUE_SIZE       0x0C
+#define VIO_QUEUE_SELECT     0x0E
+#define VIO_QUEUE_NOTIFY     0x10
+#define VIO_DEVICE_STATUS    0x12
+#define VIO_ISR_STATUS       0x13
+#define VIO_BLK_CAPACITY     0x14   /* config device (pas de MSI-X) */
+
+#define VIO_STATUS_ACK       0x01
+#define VIO_STATUS_DRIVER    0x02
+#define VIO_STATUS_DRIVER_OK 0x04
+#define VIO_STATUS_FAILED    0x80
+
+#define VIRTIO_BLK_F_FLUSH          (1u << 9)
+#define VIRTIO_RING_F_INDIRECT_DESC (1u << 28)
+
+#define VIRTIO_BLK_T_IN      0
+#define VIRTIO_BLK_T_OUT     1
+#define VIRTIO_BLK_T_FLUSH   4
+#define VIRTIO_BLK_S_OK      0
+
+/* ---------- Virtqueue "split" ---------- */
+#define VRING_DESC_F_NEXT     1
+#define VRING_DESC_F_WRITE    2   /* buffer écrit par le device */
+#define VRING_DESC_F_INDIRECT 4
+#define VRING_USED_F_NO_NOTIFY 1
+
+#define VQ_MAX_SIZE          256
+#define VQ_ALIGN             4096
+#define VBLK_MAX_REQS        32
+#define VBLK_SECTORS_PER_REQ 128
+#define VBLK_TIMEOUT_MS      5000
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+};
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct vring_used_elem ring[];
+};
+
+struct virtio_blk_outhdr {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+};
+
+/* Une requête = en-tête + segments + octet de statut. Avec les descripteurs
+ * indirects, elle n'occupe qu'une seule entrée de l'anneau. */
+typedef struct {
+    struct virtio_blk_outhdr hdr;
+    struct vring_desc table[VIRTIO_BLK_MAX_SEGS + 2];
+    volatile uint8_t status;
+    volatile uint8_t done;
+    uint8_t in_use;
+    uint16_t head;
+    uint16_t ndesc;
+} __attribute__((aligned(16))) vblk_req_t;
+
+/* Taille legacy : desc + avail, aligné 4096, puis used */
+#define VQ_BYTES(n) ((((16u * (n)) + 6u + 2u * (n)) + VQ_ALIGN - 1) / VQ_ALIGN * VQ_ALIGN \
+                     + (((6u + 8u * (n)) + VQ_ALIGN - 1) / VQ_ALIGN * VQ_ALIGN))
+
+static uint8_t g_vq_mem[VQ_BYTES(VQ_MAX_SIZE)] __attribute__((aligned(VQ_ALIGN)));
+static vblk_req_t g_reqs[VBLK_MAX_REQS];
+static int16_t g_head_owner[VQ_MAX_SIZE];
+
+static uint16_t g_io = 0;
+static uint16_t g_qsize = 0;
+static struct vring_desc *g_desc = 0;
+static struct vring_avail *g_avail = 0;
+static struct vring_used *g_used = 0;
+static uint16_t g_free_head = 0;
+static uint16_t g_num_free = 0;
+static uint16_t g_last_used = 0;
+static int g_indirect = 0;
+static int g_flush = 0;
+static int g_irq_mode = 0;
+static uint64_t g_capacity = 0;
+
+#define barrier() asm volatile ("" : : : "memory")
+
+/* ---------- Descripteurs libres (liste chaînée par `next`) ---------- */
+
+static int desc_alloc(void) {
+    if (g_num_free == 0) return -1;
+    uint16_t d = g_free_head;
+    g_free_head = g_desc[d].next;
+    g_num_free--;
+    return d;
+}
+
+static void desc_free_chain(uint16_t head) {
+    uint16_t d = head;
+    for (;;) {
+        uint16_t flags = g_desc[d].flags;
+        uint16_t next = g_desc[d].next;
+        g_desc[d].next = g_free_head;
+        g_free_head = d;
+        g_num_free++;
+        if (!(flags & VRING_DESC_F_NEXT)) break;
+        d = next;
+    }
+}
+
+/* Ramasse les requêtes terminées dans l'anneau "used" (IF=0 ou depuis l'IRQ) */
+static void vblk_reap(void) {
+    while (g_last_used != g_used->idx) {
+        barrier();
+        struct vring_used_elem *e = &g_used->ring[g_last_used % g_qsize];
+        uint16_t head = (uint16_t)e->id;
+        int16_t owner = g_head_owner[head];
+        desc_free_chain(head);
+        g_head_owner[head] = -1;
+        if (owner >= 0) g_reqs[owner].done = 1;
+        g_last_used++;
+    }
+}
+
+static void vblk_irq_handler(interrupt_frame_t *frame) {
+    (void)frame;
+    inb(g_io + VIO_ISR_STATUS); /* lecture = acquittement */
+    vblk_reap();
+}
+
+/* ---------- Initialisation ---------- */
+
+int virtio_blk_init(void) {
+    pci_device_t dev;
+    if (pci_find_device(VIRTIO_PCI_VENDOR, VIRTIO_PCI_DEVICE_BLK, &dev) != 0) return -1;
+
+    uint32_t bar0 = pci_bar(&dev, 0);
+    if (!(bar0 & 1)) return -1;
+    pci_enable_bus_master(&dev);
+    g_io = (uint16_t)(bar0 & ~3u);
+
+    outb(g_io + VIO_DEVICE_STATUS, 0);
+    outb(g_io + VIO_DEVICE_STATUS, VIO_STATUS_ACK);
+    outb(g_io + VIO_DEVICE_STATUS, VIO_STATUS_ACK | VIO_STATUS_DRIVER);
+
+    uint32_t features = inl(g_io + VIO_DEVICE_FEATURES);
+    uint32_t wanted = features & (VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_BLK_F_FLUSH);
+    outl(g_io + VIO_GUEST_FEATURES, wanted);
+    g_indirect = (wanted & VIRTIO_RING_F_INDIRECT_DESC) != 0;
+    g_flush = (wanted & VIRTIO_BLK_F_FLUSH) != 0;
+
+    outw(g_io + VIO_QUEUE_SELECT, 0);
+    g_qsize = inw(g_io + VIO_QUEUE_SIZE);
+    if (g_qsize == 0 || g_qsize > VQ_MAX_SIZE) {
+        print_string("VIRTIO: taille de file non supportee\n");
+        outb(g_io + VIO_DEVICE_STATUS, VIO_STATUS_FAILED);
+        g_io = 0;
+        return -1;
+    }
+
+    memset(g_vq_mem, 0, sizeof(g_vq_mem));
+    g_desc = (struct vring_desc *)g_vq_mem;
+    g_avail = (struct vring_avail *)(g_vq_mem + 16u * g_qsize);
+    uint32_t used_off = (16u * g_qsize + 6u + 2u * g_qsize + VQ_ALIGN - 1) / VQ_ALIGN * VQ_ALIGN;
+    g_used = (struct vring_used *)(g_vq_mem + used_off);
+
+    for (uint16_t i = 0; i < g_qsize; ++i) {
+        g_desc[i].next = (uint16_t)(i + 1);
+        g_head_owner[i] = -1;
+    }
+    g_free_head = 0;
+    g_num_free = g_qsize;
+    g_last_used = 0;
+    memset(g_reqs, 0, sizeof(g_reqs));
+
+    /* Le noyau tourne sans pagination : adresse = adresse physique */
+    outl(g_io + VIO_QUEUE_PFN, (uint32_t)(uintptr_t)g_vq_mem / VQ_ALIGN);
+
+    if (timer_running() && dev.irq_line < 16) {
+        irq_register(dev.irq_line, vblk_irq_handler);
+        irq_unmask(dev.irq_line);
+        g_irq_mode = 1;
+    }
+
+    outb(g_io + VIO_DEVICE_STATUS, VIO_STATUS_ACK | VIO_STATUS_DRIVER | VIO_STATUS_DRIVER_OK);
+
+    g_capacity = (uint64_t)inl(g_io + VIO_BLK_CAPACITY)
+               | ((uint64_t)inl(g_io + VIO_BLK_CAPACITY + 4) << 32);
+
+    print_string("VIRTIO: virtio-blk pret, file=");
+    print_hex(g_qsize);
+    print_string(g_indirect ? " (indirect)\n" : "\n");
+    return 0;
+}
+
+int virtio_blk_present(void) {
+    return g_io != 0;
+}
+
+uint64_t virtio_blk_sector_count(void) {
+    return g_capacity;
+}
+
+/* ---------- Soumission ---------- */
+
+/* nseg = 0 seulement pour FLUSH : en-tête + statut */
+static int vblk_queue(uint32_t type, uint64_t sector, const virtio_blk_seg_t* segs, int nseg) {
+    if (!g_io || nseg < 0 || nseg > VIRTIO_BLK_MAX_SEGS) return -1;
+    int write = (type != VIRTIO_BLK_T_IN);
+
+    int id = -1;
+    for (int i = 0; i < VBLK_MAX_REQS; ++i) {
+        if (!g_reqs[i].in_use) { id = i; break; }
+    }
+    if (id < 0) return -1;
+
+    uint16_t ndesc = (uint16_t)(nseg + 2);
+    if (g_num_free < (g_indirect ? 1 : ndesc)) return -1;
+
+    vblk_req_t *req = &g_reqs[id];
+    req->in_use = 1;
+    req->done = 0;
+    req->status = 0xFF;
+    req->ndesc = ndesc;
+    req->hdr.type = type;
+    req->hdr.ioprio = 0;
+    req->hdr.sector = sector;
+
+    /* en-tête (lu par le device), données, statut (écrit par le device) */
+    struct vring_desc *t = req->table;
+    t[0].addr = (uint32_t)(uintptr_t)&req->hdr;
+    t[0].len = sizeof(req->hdr);
+    t[0].flags = VRING_DESC_F_NEXT;
+    for (int i = 0; i < nseg; ++i) {
+        t[1 + i].addr = (uint32_t)(uintptr_t)segs[i].buf;
+        t[1 + i].len = segs[i].len;
+        t[1 + i].flags = (uint16_t)(VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE));
+    }
+    t[ndesc - 1].addr = (uint32_t)(uintptr_t)&req->status;
+    t[ndesc - 1].len = 1;
+    t[ndesc - 1].flags = VRING_DESC_F_WRITE;
+
+    interrupts_disable();
+    uint16_t head;
+    if (g_indirect) {
+        for (uint16_t i = 0; i + 1 < ndesc; ++i) t[i].next = (uint16_t)(i + 1);
+        head = (uint16_t)desc_alloc();
+        g_desc[head].addr = (uint32_t)(uintptr_t)t;
+        g_desc[head].len = ndesc * sizeof(struct vring_desc);
+        g_desc[head].flags = VRING_DESC_F_INDIRECT;
+    } else {
+        /* Pas d'indirect : chaîne directe de ndesc entrées de l'anneau */
+        head = (uint16_t)desc_alloc();
+        uint16_t d = head;
+        for (uint16_t i = 0; i < ndesc; ++i) {
+            g_desc[d].addr = t[i].addr;
+            g_desc[d].len = t[i].len;
+            g_desc[d].flags = t[i].flags;
+            if (i + 1 < ndesc) {
+                uint16_t nd = (uint16_t)desc_alloc();
+                g_desc[d].next = nd;
+                d = nd;
+            }
+        }
+    }
+    req->head = head;
+    g_head_owner[head] = (int16_t)id;
+
+    g_avail->ring[g_avail->idx % g_qsize] = head;
+    barrier();
+    g_avail->idx++;
+    interrupts_enable();
+    return id;
+}
+
+int virtio_blk_queue(uint64_t sector, const virtio_blk_seg_t* segs, int nseg, int write) {
+    if (nseg <= 0) return -1;
+    return vblk_queue(write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, sector, segs, nseg);
+}
+
+void virtio_blk_kick(void) {
+    if (!g_io) return;
+    barrier();
+    if (!(g_used->flags & VRING_USED_F_NO_NOTIFY))
+        outw(g_io + VIO_QUEUE_NOTIFY, 0);
+}
+
+int virtio_blk_wait(int id) {
+    if (!g_io || id < 0 || id >= VBLK_MAX_REQS || !g_reqs[id].in_use) return -1;
+    vblk_req_t *req = &g_reqs[id];
+
+    uint32_t start = timer_ms();
+    uint32_t spins = 0;
+    for (;;) {
+        interrupts_disable();
+        vblk_reap();
+        if (req->done) {
+            interrupts_enable();
+            break;
+        }
+        if (g_irq_mode) cpu_wait_for_interrupt();
+        else interrupts_enable();
+
+        if (timer_running() ? (timer_ms() - start) >= VBLK_TIMEOUT_MS
+                            : ++spins >= VBLK_TIMEOUT_MS * 1000) {
+            print_string("VIRTIO: timeout\n");
+            return -1; /* la requête reste réservée : le device peut encore y écrire */
+        }
+    }
+
+    int r = (req->status == VIRTIO_BLK_S_OK) ? 0 : -1;
+    req->in_use = 0;
+    return r;
+}
+
+/* Découpe en requêtes de VBLK_SECTORS_PER_REQ, un seul kick par lot */
+static int vblk_transfer(uint32_t lba, uint8_t* buffer, uint32_t count, int write) {
+    int ids[VBLK_MAX_REQS];
+    int r = 0;
+
+    while (count > 0 && r == 0) {
+        int n_ids = 0;
+        while (count > 0 && n_ids < VBLK_MAX_REQS) {
+            uint32_t n = count < VBLK_SECTORS_PER_REQ ? count : VBLK_SECTORS_PER_REQ;
+            virtio_blk_seg_t seg = { buffer, n * 512 };
+            int id = virtio_blk_queue(lba, &seg, 1, write);
+            if (id < 0) break; /* anneau plein : on envoie ce qu'on a */
+            ids[n_ids++] = id;
+            lba += n;
+            buffer += n * 512;
+            count -= n;
+        }
+        if (n_ids == 0) return -1;
+        virtio_blk_kick();
+        for (int i = 0; i < n_ids; ++i) {
+            if (virtio_blk_wait(ids[i]) != 0) r = -1;
+        }
+    }
+    if (r != 0) print_string("VIRTIO: I/O error\n");
+    return r;
+}
+
+int virtio_blk_read(uint32_t lba, uint8_t* buffer, uint32_t count) {
+    return vblk_transfer(lba, buffer, count, 0);
+}
+
+int virtio_blk_write(uint32_t lba, const uint8_t* buffer, uint32_t count) {
+    return vblk_transfer(lba, (uint8_t*)buffer, count, 1);
+}
+
+/* Sans VIRTIO_BLK_F_FLUSH le device est write-through : rien à faire */
+int virtio_blk_flush(void) {
+    if (!g_io) return -1;
+    if (!g_flush) return 0;
+    int id = vblk_queue(VIRTIO_BLK_T_FLUSH, 0, 0, 0);
+    if (id < 0) return -1;
+    virtio_blk_kick();
+    if (virtio_blk_wait(id) != 0) {
+        print_string("VIRTIO: flush failed\n");
+        return -1;
+    }
+    return 0;
+}
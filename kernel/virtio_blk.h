@@ -0,0 +1,39 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+#define VIRTIO_PCI_VENDOR        0x1AF4
+#define VIRTIO_PCI_DEVICE_BLK    0x1001   /* virtio-blk transitionnel (interface legacy) */
+
+/* Segments max par requête (liste scatter-gather d'une table indirecte) */
+#define VIRTIO_BLK_MAX_SEGS      16
+
+typedef struct {
+    void*    buf;
+    uint32_t len;   /* multiple de 512 */
+} virtio_blk_seg_t;
+
+// Détecte et initialise le périphérique (0 = prêt, -1 = absent)
+int virtio_blk_init(void);
+int virtio_blk_present(void);
+
+// Capacité en secteurs de 512 octets (espace de configuration du device)
+uint64_t virtio_blk_sector_count(void);
+
+// Même contrat que ata_read/ata_write (0 = succès)
+int virtio_blk_read(uint32_t lba, uint8_t* buffer, uint32_t count);
+int virtio_blk_write(uint32_t lba, const uint8_t* buffer, uint32_t count);
+
+// Vide le cache d'écriture du device (VIRTIO_BLK_T_FLUSH), 0 = succès
+int virtio_blk_flush(void);
+
+// Soumission par lots : virtio_blk_queue place une requête dans l'anneau
+// sans prévenir le device et retourne son identifiant (-1 si plein),
+// virtio_blk_kick notifie une seule fois pour tout le lot, virtio_blk_wait
+// attend la fin d'une requête et la libère.
+int virtio_blk_queue(uint64_t sector, const virtio_blk_seg_t* segs, int nseg, int write);
+void virtio_blk_kick(void);
+int virtio_blk_wait(int id);
+
+#endif
@@ -23,7 +23,7 @@ if errorlevel 1 goto error
 
 REM === COMPILATION DU KERNEL ===
 echo Compilation des fichiers du kernel...
-set FILES=main input reapfs screen utils ata boot_info mem_boot ui
+set FILES=main input reapfs screen utils ata boot_info mem_boot ui idt timer pci ahci virtio_blk blkq bcache crc32c lz4 reapfs_check
 
 for %%f in (%FILES%) do (
     echo Compilation de kernel\%%f.c...
@@ -53,6 +53,16 @@ kernel\ata.o ^
 kernel\boot_info.o ^
 kernel\mem_boot.o ^
 kernel\ui.o ^
+kernel\idt.o ^
+kernel\timer.o ^
+kernel\pci.o ^
+kernel\ahci.o ^
+kernel\virtio_blk.o ^
+kernel\blkq.o ^
+kernel\bcache.o ^
+kernel\crc32c.o ^
+kernel\lz4.o ^
+kernel\reapfs_check.o ^
 kernel\src\mem\pfa.o
 
 
@@ -61,6 +71,17 @@ echo Extraction du binaire pur...
 %OBJCOPY% -O binary kernel.elf kernel.bin
 if errorlevel 1 goto error
 
+REM === TAILLE DU KERNEL ===
+REM Zone de boot : secteurs 1..511, le superbloc reAPFS est au 512
+REM (KERNEL_SECTORS dans bootloader.asm, BOOT_SECTORS dans mkfs.reapfs)
+set KERNEL_MAX=261632
+for %%A in (kernel.bin) do set KSIZE=%%~zA
+echo kernel.bin : !KSIZE! octets (max !KERNEL_MAX!)
+if !KSIZE! GTR !KERNEL_MAX! (
+    echo kernel.bin depasse la zone de boot de 511 secteurs
+    goto error
+)
+
 REM === CREATION DU DISQUE RAW ===
 echo Création de os.img vide de 16 Mo...
 fsutil file createnew os.img 16777216 >nul
@@ -72,7 +93,7 @@ if errorlevel 1 goto error
 
 REM === ECRITURE DU KERNEL A PARTIR DU SECTEUR 1 ===
 echo Insertion du kernel.bin à partir du secteur 1 (offset 512)...
-python write_lba.py os.img kernel.bin 1 40
+python write_lba.py os.img kernel.bin 1 511
 if errorlevel 1 goto error
 
 REM === DEMARRAGE QEMU ===
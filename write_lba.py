@@ -10,6 +10,11 @@ def write_lba(img_file, bin_file, lba_start, num_sectors=0):
             # Vérifier taille pour le MBR
             if lba_start == 0 and len(data) > 512:
                 raise ValueError("Le bootloader dépasse 512 octets")
+
+            # Zone réservée : ne pas déborder sur ce qui suit (superbloc)
+            if num_sectors > 1 and len(data) > num_sectors * 512:
+                raise ValueError(f"{bin_file} fait {len(data)} octets, "
+                                 f"la zone n'en a que {num_sectors * 512}")
             
             img.write(data)
             